@@ -0,0 +1,208 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+// utfcpp20bench: throughput of the hot paths over generated corpora.
+//
+//    utfcpp20bench [--size MiB] [--warmup N] [--repeat N] [--filter TEXT] [--csv]
+//
+// Each corpus is generated from a fixed seed, so numbers are comparable across versions.
+// Every benchmark runs warmup times untimed and repeat times timed; the throughput is
+// reported for the median and the best run, in GB/s of input and in millions of code
+// points per second. With --csv, one line per benchmark is printed for tracking.
+
+#include "utfcpp20.hpp"
+#include "core.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    struct corpus {
+        std::string name;
+        std::u8string utf8;
+        std::u16string utf16;
+        size_t code_points;
+    };
+
+    struct options {
+        size_t size {16u << 20};
+        int warmup {2};
+        int repeat {10};
+        std::string filter;
+        bool csv {false};
+    };
+
+    // Appends random code points from the given ranges until the UTF-8 text reaches size bytes
+    std::u8string generate(size_t size, std::vector<std::pair<char32_t, char32_t>> ranges, unsigned seed) {
+        std::mt19937 random(seed);
+        std::u8string utf8;
+        while (utf8.size() < size) {
+            const auto& [first, last] = ranges[random() % ranges.size()];
+            utfcpp::append_to_utf8(utf8, first + static_cast<char32_t>(random() % (last - first + 1)));
+        }
+        return utf8;
+    }
+
+    corpus make_corpus(std::string name, std::u8string utf8, size_t malformed_per_mille, unsigned seed) {
+        corpus c{std::move(name), std::move(utf8), {}, 0};
+        c.utf16 = utfcpp::utf8_to_16(c.utf8);
+        if (malformed_per_mille > 0) {
+            // Overwrite code units with a stray trail byte and a lone surrogate
+            std::mt19937 random(seed);
+            for (size_t i = 0; i < c.utf8.size() * malformed_per_mille / 1000; ++i)
+                c.utf8[random() % c.utf8.size()] = 0x80;
+            for (size_t i = 0; i < c.utf16.size() * malformed_per_mille / 1000; ++i)
+                c.utf16[random() % c.utf16.size()] = 0xdc00;
+        }
+        for (auto cp : utfcpp::u8_view(c.utf8, utfcpp::error_mode::replace)) {
+            static_cast<void>(cp);
+            ++c.code_points;
+        }
+        return c;
+    }
+
+    std::vector<corpus> make_corpora(size_t size) {
+        const std::pair<char32_t, char32_t> ascii{0x20, 0x7e};
+        std::vector<corpus> corpora;
+        corpora.push_back(make_corpus("ascii", generate(size, {ascii}, 1), 0, 0));
+        corpora.push_back(make_corpus("latin1", generate(size, {ascii, {0xa0, 0xff}}, 2), 0, 0));
+        corpora.push_back(make_corpus("cyrillic", generate(size, {{0x20, 0x20}, {0x410, 0x44f}}, 3), 0, 0));
+        corpora.push_back(make_corpus("cjk", generate(size, {{0x4e00, 0x9fff}}, 4), 0, 0));
+        corpora.push_back(make_corpus("emoji", generate(size, {{0x1f300, 0x1f64f}, {0x20000, 0x2a6df}}, 5), 0, 0));
+        const std::vector<std::pair<char32_t, char32_t>> mixed{ascii, ascii, ascii, {0x410, 0x44f},
+                                                               {0x4e00, 0x9fff}, {0x1f300, 0x1f64f}};
+        corpora.push_back(make_corpus("mixed", generate(size, mixed, 6), 0, 0));
+        corpora.push_back(make_corpus("malformed", generate(size, mixed, 7), 1, 8));
+        return corpora;
+    }
+
+    struct benchmark {
+        std::string name;
+        bool utf16_input;                         // Whether the throughput is of the UTF-16 text
+        std::function<size_t(const corpus&)> run; // Returns a value that depends on the work done
+    };
+
+    // Conversions and iteration use replacement so that they run over malformed input as well
+    std::vector<benchmark> make_benchmarks() {
+        using utfcpp::error_mode;
+        return {
+            {"utf8_to_16", false, [](const corpus& c) { return utfcpp::utf8_to_16(c.utf8, error_mode::replace).size(); }},
+            {"utf16_to_8", true, [](const corpus& c) { return utfcpp::utf16_to_8(c.utf16, error_mode::replace).size(); }},
+            {"utf8_to_16_view", false, [](const corpus& c) {
+                size_t sum{0};
+                for (char16_t unit : c.utf8 | utfcpp::views::to_utf16(error_mode::replace))
+                    sum += unit;
+                return sum;
+            }},
+            {"u8_iterator", false, [](const corpus& c) {
+                size_t sum{0};
+                for (char32_t cp : utfcpp::u8_view(c.utf8, error_mode::replace))
+                    sum += cp;
+                return sum;
+            }},
+            {"estimate16", false, [](const corpus& c) { return utfcpp::internal::estimate16(c.utf8); }},
+            {"estimate8", true, [](const corpus& c) { return utfcpp::internal::estimate8(c.utf16); }},
+            {"utf16_length_from_utf8", false, [](const corpus& c) { return utfcpp::utf16_length_from_utf8(c.utf8); }},
+            {"utf8_length_from_utf16", true, [](const corpus& c) { return utfcpp::utf8_length_from_utf16(c.utf16); }},
+            {"count_code_points", false, [](const corpus& c) { return utfcpp::count_code_points(c.utf8); }},
+            {"is_valid_utf8", false, [](const corpus& c) { return static_cast<size_t>(utfcpp::is_valid_utf8(c.utf8)); }},
+            {"find_invalid_utf8", false, [](const corpus& c) { return utfcpp::find_invalid_utf8(c.utf8); }},
+            {"sanitize_utf8", false, [](const corpus& c) { return utfcpp::sanitize_utf8(c.utf8).size(); }},
+            {"equal_utf8_utf16", false, [](const corpus& c) { return static_cast<size_t>(utfcpp::equal(c.utf8, c.utf16)); }},
+            {"hash_code_points", false, [](const corpus& c) { return static_cast<size_t>(utfcpp::hash_code_points(c.utf8)); }},
+        };
+    }
+
+    bool parse_options(int argc, char* argv[], options& opts) {
+        for (int i = 1; i < argc; ++i) {
+            const bool has_value = (i + 1 < argc);
+            if (std::strcmp(argv[i], "--csv") == 0)
+                opts.csv = true;
+            else if (std::strcmp(argv[i], "--size") == 0 && has_value)
+                opts.size = std::strtoull(argv[++i], nullptr, 10) << 20;
+            else if (std::strcmp(argv[i], "--warmup") == 0 && has_value)
+                opts.warmup = std::atoi(argv[++i]);
+            else if (std::strcmp(argv[i], "--repeat") == 0 && has_value)
+                opts.repeat = std::atoi(argv[++i]);
+            else if (std::strcmp(argv[i], "--filter") == 0 && has_value)
+                opts.filter = argv[++i];
+            else
+                return false;
+        }
+        return opts.size > 0 && opts.warmup >= 0 && opts.repeat > 0;
+    }
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    options opts;
+    if (!parse_options(argc, argv, opts)) {
+        std::fprintf(stderr, "usage: utfcpp20bench [--size MiB] [--warmup N] [--repeat N] [--filter TEXT] [--csv]\n");
+        return 2;
+    }
+
+    const std::vector<corpus> corpora = make_corpora(opts.size);
+    volatile size_t sink{0};
+
+    // Kept off stdout so the CSV stays parseable
+    std::fprintf(stderr, "implementation: %s\n", utfcpp::implementation_name(utfcpp::active_implementation()));
+    if (opts.csv)
+        std::printf("benchmark,corpus,bytes,code_points,median_gbps,best_gbps,stddev_gbps,median_mcps\n");
+    else
+        std::printf("%-24s %-10s %12s %12s %12s %14s\n", "benchmark", "corpus", "median GB/s", "best GB/s",
+                    "stddev GB/s", "median Mcp/s");
+
+    for (const benchmark& bench : make_benchmarks()) {
+        for (const corpus& c : corpora) {
+            const std::string full_name = bench.name + "/" + c.name;
+            if (full_name.find(opts.filter) == std::string::npos)
+                continue;
+
+            const size_t bytes = bench.utf16_input ? c.utf16.size() * sizeof(char16_t) : c.utf8.size();
+            for (int i = 0; i < opts.warmup; ++i)
+                sink = sink + bench.run(c);
+            std::vector<double> gbps;
+            for (int i = 0; i < opts.repeat; ++i) {
+                const auto start = std::chrono::steady_clock::now();
+                sink = sink + bench.run(c);
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                gbps.push_back(static_cast<double>(bytes) / elapsed.count() / 1e9);
+            }
+
+            std::sort(gbps.begin(), gbps.end());
+            const double median = gbps[gbps.size() / 2];
+            double mean{0}, variance{0};
+            for (double g : gbps)
+                mean += g / static_cast<double>(gbps.size());
+            for (double g : gbps)
+                variance += (g - mean) * (g - mean) / static_cast<double>(gbps.size());
+            const double mcps = median * 1e3 * static_cast<double>(c.code_points) / static_cast<double>(bytes);
+
+            if (opts.csv)
+                std::printf("%s,%s,%zu,%zu,%.4f,%.4f,%.4f,%.2f\n", bench.name.c_str(), c.name.c_str(), bytes,
+                            c.code_points, median, gbps.back(), std::sqrt(variance), mcps);
+            else
+                std::printf("%-24s %-10s %12.3f %12.3f %12.3f %14.1f\n", bench.name.c_str(), c.name.c_str(),
+                            median, gbps.back(), std::sqrt(variance), mcps);
+        }
+    }
+    return 0;
+}
@@ -15,8 +15,20 @@
 #ifndef uftcpp20_H_de558932_1371_4b17_a2e1_ceaad0fcb1cd
 #define uftcpp20_H_de558932_1371_4b17_a2e1_ceaad0fcb1cd
 
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <memory_resource>
+#include <ranges>
+#include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 /** 
  * \brief Namespace for the utfcpp20 library
@@ -55,17 +67,86 @@ namespace utfcpp {
      */
     class exception_with_position : public exception {
     public:
-        exception_with_position(size_t pos, std::string msg = "UTF error at position")
+        exception_with_position(size_t pos, std::string msg)
             : position_(pos), message_(std::move(msg)) {}
+        /**
+         * \brief Constructs the exception, keeping a short message inside the object.
+         * 
+         * Messages of up to 42 characters, like all the messages of the library, are copied
+         * into the exception object, so that neither throwing nor `what` allocates memory.
+         */
+        exception_with_position(size_t pos, const char* msg = "UTF error at position")
+            : position_(pos) {
+            const size_t length = std::char_traits<char>::length(msg);
+            if (length + max_position_digits + 2 <= sizeof(inline_msg_)) {
+                std::copy_n(msg, length, inline_msg_);
+                inline_length_ = length;
+                is_inline_ = true;
+            } else {
+                message_ = msg;
+            }
+        }
         size_t position() const noexcept override { return position_; }
         const char* what() const noexcept override {
-            full_msg_ = message_ + " " + std::to_string(position_);
-            return full_msg_.c_str();
+            if (!is_inline_) {
+                full_msg_ = message_ + " " + std::to_string(position_);
+                return full_msg_.c_str();
+            }
+            inline_msg_[inline_length_] = ' ';
+            *std::to_chars(inline_msg_ + inline_length_ + 1, inline_msg_ + sizeof(inline_msg_) - 1, position_).ptr = '\0';
+            return inline_msg_;
         }
     private:
+        static constexpr size_t max_position_digits {20};
+
         size_t position_;
         std::string message_;
         mutable std::string full_msg_;
+        mutable char inline_msg_[64]{};     // The message, followed by the position once `what` is called
+        size_t inline_length_{0};
+        bool is_inline_{false};
+    };
+
+    /**
+     * \brief Status of a conversion that reports errors without throwing.
+     */
+    enum class conversion_status {
+        ok,                  ///< The input was converted successfully.
+        incomplete_sequence, ///< A sequence is cut short by the end of input or by a missing trail.
+        invalid_lead,        ///< A sequence starts with a code unit that cannot start a sequence.
+        overlong_sequence,   ///< A code point is encoded with more bytes than necessary.
+        invalid_code_point,  ///< A sequence decodes to a surrogate or to a value above U+10FFFF.
+        buffer_too_small,    ///< The output buffer cannot hold the converted string.
+        unrepresentable      ///< A valid code point has no encoding in the output, e.g. above U+00FF in Latin-1.
+    };
+
+    /**
+     * \brief How conversions and iterators handle invalid input.
+     */
+    enum class error_mode {
+        throw_exception,    ///< Throw an exception at the first invalid sequence.
+        replace             ///< Replace each invalid sequence with U+FFFD and never throw.
+    };
+
+    /**
+     * \brief Result of a conversion that reports errors without throwing.
+     */
+    struct conversion_result {
+        conversion_status status; ///< `conversion_status::ok` if the whole input was converted.
+        size_t position;          ///< The position of the error in the input, or the input length on success
+                                  ///< and with `conversion_status::buffer_too_small`, which is reported
+                                  ///< before the input is checked.
+        size_t written;           ///< The number of code units written to the output or, with
+                                  ///< `conversion_status::buffer_too_small`, the size the output needs.
+    };
+
+    /**
+     * \brief How a conversion of a large string is split among threads.
+     */
+    struct parallel_policy {
+        unsigned thread_count {0};               ///< Number of threads, including the calling one, or 0 for one
+                                                 ///< per hardware thread.
+        size_t min_chunk_size {size_t{1} << 20}; ///< Inputs are not split into chunks shorter than this, in code units.
     };
 
     /**
@@ -99,53 +180,906 @@ namespace utfcpp {
     std::u16string utf8_to_16(std::u8string_view utf8_string);
 
     /**
-     * \brief Converts a UTF-16 encoded string to UTF-8.
-     * 
-     * Decodes a UTF-16 string and encodes its content as UTF-8.
-     * 
-     * \param utf16_string A view to a UTF-8 encoded string to convert to UTF-16.
-     * \return A UTF-16 encoded string.
+     * \brief Converts a UTF-16 encoded string to UTF-8.
+     * 
+     * Decodes a UTF-16 string and encodes its content as UTF-8.
+     * 
+     * \param utf16_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \return A UTF-16 encoded string.
+     */
+    std::u8string  utf16_to_8(std::u16string_view utf16_string);
+
+    /**
+     * \brief Converts a UTF-8 encoded string to UTF-16, handling invalid input as requested.
+     * 
+     * With `error_mode::replace`, each maximal subpart of an ill-formed sequence, i.e. the
+     * longest prefix of a well-formed sequence or else a single byte, is converted to U+FFFD,
+     * as recommended by the Unicode Standard, and the function does not throw on invalid input.
+     * With `error_mode::throw_exception`, it behaves like the overload without a mode.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \param mode How to handle invalid sequences.
+     * \return A UTF-16 encoded string.
+     */
+    std::u16string utf8_to_16(std::u8string_view utf8_string, error_mode mode);
+
+    /**
+     * \brief Converts a UTF-16 encoded string to UTF-8, handling invalid input as requested.
+     * 
+     * With `error_mode::replace`, each unpaired surrogate is converted to U+FFFD and the
+     * function does not throw on invalid input. With `error_mode::throw_exception`, it behaves
+     * like the overload without a mode.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to UTF-8.
+     * \param mode How to handle invalid sequences.
+     * \return A UTF-8 encoded string.
+     */
+    std::u8string  utf16_to_8(std::u16string_view utf16_string, error_mode mode);
+
+    /**
+     * \brief Converts a UTF-8 encoded string to UTF-16, using several threads.
+     * 
+     * Splits the input into chunks at code point boundaries, computes the length of each chunk
+     * converted to UTF-16 to place it in the output, and converts the chunks concurrently. The result,
+     * and the position of an `exception_with_position` thrown on invalid input, are the same as with
+     * the single-threaded overload. Inputs too short to split are converted on the calling thread.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \param policy The number of threads and the minimal chunk size.
+     * \return A UTF-16 encoded string.
+     */
+    std::u16string utf8_to_16(std::u8string_view utf8_string, parallel_policy policy);
+
+    /**
+     * \brief Converts a UTF-8 encoded string to UTF-32.
+     * 
+     * Decodes a UTF-8 string and stores its code points as UTF-32.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-32.
+     * \return A UTF-32 encoded string.
+     */
+    std::u32string utf8_to_32(std::u8string_view utf8_string);
+
+    /**
+     * \brief Converts a UTF-32 encoded string to UTF-8.
+     * 
+     * Validates the code points of a UTF-32 string and encodes them as UTF-8. Throws
+     * `exception_with_position` with the index of the first surrogate or value above U+10FFFF.
+     * 
+     * \param utf32_string A view to a UTF-32 encoded string to convert to UTF-8.
+     * \return A UTF-8 encoded string.
+     */
+    std::u8string  utf32_to_8(std::u32string_view utf32_string);
+
+    /**
+     * \brief Converts a UTF-16 encoded string to UTF-32.
+     * 
+     * Decodes a UTF-16 string and stores its code points as UTF-32.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to UTF-32.
+     * \return A UTF-32 encoded string.
+     */
+    std::u32string utf16_to_32(std::u16string_view utf16_string);
+
+    /**
+     * \brief Converts a UTF-32 encoded string to UTF-16.
+     * 
+     * Validates the code points of a UTF-32 string and encodes them as UTF-16. Throws
+     * `exception_with_position` with the index of the first surrogate or value above U+10FFFF.
+     * 
+     * \param utf32_string A view to a UTF-32 encoded string to convert to UTF-16.
+     * \return A UTF-16 encoded string.
+     */
+    std::u16string utf32_to_16(std::u32string_view utf32_string);
+
+    /**
+     * \brief Encodes a sequence of code points as UTF-8 and appends it to a UTF-8 string.
+     * 
+     * Computes the length of the output once and writes it in bulk, which is much faster than
+     * calling append_to_utf8 for each code point. Throws `exception_with_position` with the index
+     * of the first surrogate or value above U+10FFFF, leaving the UTF-8 string unchanged.
+     * 
+     * \param code_points The code points to encode.
+     * \param utf8_string A UTF-8 encoded string to which the encoded code points are appended.
+     */
+    void encode_utf8(std::span<const char32_t> code_points, std::u8string& utf8_string);
+
+    /**
+     * \brief Encodes a sequence of code points as UTF-16 and appends it to a UTF-16 string.
+     * 
+     * The UTF-16 counterpart of encode_utf8.
+     * 
+     * \param code_points The code points to encode.
+     * \param utf16_string A UTF-16 encoded string to which the encoded code points are appended.
+     */
+    void encode_utf16(std::span<const char32_t> code_points, std::u16string& utf16_string);
+
+    /**
+     * \brief Converts a Latin-1 (ISO-8859-1) encoded string to UTF-8.
+     * 
+     * Each byte of a Latin-1 string is the code point of the same value, U+0000 - U+00FF, so
+     * every Latin-1 string is valid and converts to one or two UTF-8 bytes per byte.
+     * 
+     * \param latin1_string A view to a Latin-1 encoded string to convert to UTF-8.
+     * \return A UTF-8 encoded string.
+     */
+    std::u8string latin1_to_utf8(std::string_view latin1_string);
+
+    /**
+     * \brief Converts a Latin-1 (ISO-8859-1) encoded string to UTF-16.
+     * 
+     * \param latin1_string A view to a Latin-1 encoded string to convert to UTF-16.
+     * \return A UTF-16 encoded string of the same length.
+     */
+    std::u16string latin1_to_utf16(std::string_view latin1_string);
+
+    /**
+     * \brief Converts a UTF-8 encoded string to Latin-1 (ISO-8859-1).
+     * 
+     * Throws `exception_with_position` at the first invalid sequence, or with
+     * `conversion_status::unrepresentable` at the first code point above U+00FF.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to Latin-1.
+     * \return A Latin-1 encoded string.
+     */
+    std::string utf8_to_latin1(std::u8string_view utf8_string);
+
+    /**
+     * \brief Converts a UTF-8 encoded string to Latin-1, handling invalid input as requested.
+     * 
+     * With `error_mode::replace`, each code point above U+00FF and each maximal subpart of an
+     * ill-formed sequence is converted to '?', as Latin-1 has no U+FFFD, and the function does not
+     * throw. With `error_mode::throw_exception`, it behaves like the overload without a mode.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to Latin-1.
+     * \param mode How to handle invalid sequences and code points above U+00FF.
+     * \return A Latin-1 encoded string.
+     */
+    std::string utf8_to_latin1(std::u8string_view utf8_string, error_mode mode);
+
+    /**
+     * \brief Converts a UTF-16 encoded string to Latin-1 (ISO-8859-1).
+     * 
+     * Throws `exception_with_position` at the first unpaired surrogate, or with
+     * `conversion_status::unrepresentable` at the first code point above U+00FF.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to Latin-1.
+     * \return A Latin-1 encoded string.
+     */
+    std::string utf16_to_latin1(std::u16string_view utf16_string);
+
+    /**
+     * \brief Converts a UTF-16 encoded string to Latin-1, handling invalid input as requested.
+     * 
+     * With `error_mode::replace`, each code point above U+00FF and each unpaired surrogate is
+     * converted to '?'. With `error_mode::throw_exception`, it behaves like the overload without a mode.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to Latin-1.
+     * \param mode How to handle unpaired surrogates and code points above U+00FF.
+     * \return A Latin-1 encoded string.
+     */
+    std::string utf16_to_latin1(std::u16string_view utf16_string, error_mode mode);
+
+    /**
+     * \brief Converts a UTF-8 encoded string to UTF-16 and appends it to a UTF-16 string.
+     * 
+     * Decodes a UTF-8 string and appends its content, encoded as UTF-16, to a UTF-16 string,
+     * reusing the capacity the string already has. If the input is invalid, the UTF-16 string
+     * keeps its original content.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \param utf16_string A UTF-16 encoded string to which the converted content is appended.
+     */
+    void utf8_to_16(std::u8string_view utf8_string, std::u16string& utf16_string);
+
+    /**
+     * \brief Converts a UTF-16 encoded string to UTF-8 and appends it to a UTF-8 string.
+     * 
+     * Decodes a UTF-16 string and appends its content, encoded as UTF-8, to a UTF-8 string,
+     * reusing the capacity the string already has. If the input is invalid, the UTF-8 string
+     * keeps its original content.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to UTF-8.
+     * \param utf8_string A UTF-8 encoded string to which the converted content is appended.
+     */
+    void utf16_to_8(std::u16string_view utf16_string, std::u8string& utf8_string);
+
+    /**
+     * \brief Converts a UTF-8 encoded string to UTF-16 without throwing on invalid input.
+     * 
+     * Decodes a UTF-8 string and appends its content, encoded as UTF-16, to a UTF-16 string.
+     * Conversion stops at the first invalid sequence; the code units converted before it are kept.
+     * Reporting an error neither throws nor allocates.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \param utf16_string A UTF-16 encoded string to which the converted content is appended.
+     * \return The status of the conversion, the error position, if any, as reported by `utf8_to_16`
+     * and the number of appended code units.
+     */
+    conversion_result try_utf8_to_16(std::u8string_view utf8_string, std::u16string& utf16_string);
+
+    /**
+     * \brief Converts a UTF-16 encoded string to UTF-8 without throwing on invalid input.
+     * 
+     * Decodes a UTF-16 string and appends its content, encoded as UTF-8, to a UTF-8 string.
+     * Conversion stops at the first invalid sequence; the code units converted before it are kept.
+     * Reporting an error neither throws nor allocates.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to UTF-8.
+     * \param utf8_string A UTF-8 encoded string to which the converted content is appended.
+     * \return The status of the conversion, the error position, if any, as reported by `utf16_to_8`
+     * and the number of appended code units.
+     */
+    conversion_result try_utf16_to_8(std::u16string_view utf16_string, std::u8string& utf8_string);
+
+    /**
+     * \brief Converts a UTF-8 encoded string to UTF-16 into a caller provided buffer.
+     * 
+     * Decodes a UTF-8 string and writes its content, encoded as UTF-16, to the beginning of the
+     * buffer, without allocating. If the buffer is too small, nothing is written and the result
+     * holds the buffer size the conversion needs; otherwise conversion stops at the first invalid
+     * sequence, as with the other `try_utf8_to_16` overload.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \param utf16_buffer The buffer to write the UTF-16 encoded content to.
+     * \return The status of the conversion, the error position, if any, and the number of written
+     * code units, or the needed buffer size with `conversion_status::buffer_too_small`.
+     */
+    conversion_result try_utf8_to_16(std::u8string_view utf8_string, std::span<char16_t> utf16_buffer);
+
+    /**
+     * \brief Converts a UTF-16 encoded string to UTF-8 into a caller provided buffer.
+     * 
+     * Decodes a UTF-16 string and writes its content, encoded as UTF-8, to the beginning of the
+     * buffer, without allocating. If the buffer is too small, nothing is written and the result
+     * holds the buffer size the conversion needs; otherwise conversion stops at the first invalid
+     * sequence, as with the other `try_utf16_to_8` overload.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to UTF-8.
+     * \param utf8_buffer The buffer to write the UTF-8 encoded content to.
+     * \return The status of the conversion, the error position, if any, and the number of written
+     * code units, or the needed buffer size with `conversion_status::buffer_too_small`.
+     */
+    conversion_result try_utf16_to_8(std::u16string_view utf16_string, std::span<char8_t> utf8_buffer);
+
+    /**
+     * \brief Many strings converted to UTF-16, stored back to back.
+     */
+    struct utf16_batch {
+        std::u16string                 values;  ///< The converted strings, one after another.
+        std::vector<size_t>            offsets; ///< String i is values[offsets[i], offsets[i + 1]).
+        std::vector<conversion_result> results; ///< The result for each string; an invalid string converts
+                                                ///< to an empty one and its result tells where and why.
+    };
+
+    /**
+     * \brief Many strings converted to UTF-8, stored back to back.
+     */
+    struct utf8_batch {
+        std::u8string                  values;  ///< The converted strings, one after another.
+        std::vector<size_t>            offsets; ///< String i is values[offsets[i], offsets[i + 1]).
+        std::vector<conversion_result> results; ///< The result for each string, as in `utf16_batch`.
+    };
+
+    /**
+     * \brief Converts many UTF-8 encoded strings to UTF-16 at once.
+     * 
+     * Computes the size of the whole output, allocates it once and converts the strings into it
+     * one after another. Invalid strings do not stop the conversion or throw; they are reported
+     * in the results.
+     * 
+     * \param utf8_strings Views to the UTF-8 encoded strings to convert.
+     * \return The converted strings, their offsets and the results.
+     */
+    utf16_batch utf8_to_16_batch(std::span<const std::u8string_view> utf8_strings);
+
+    /**
+     * \brief Converts many UTF-8 encoded strings, stored back to back, to UTF-16 at once.
+     * 
+     * Takes the strings in the layout of Apache Arrow string columns: string i is
+     * utf8_values[offsets[i], offsets[i + 1]). If all the strings are valid, they are converted
+     * in one pass over the values; otherwise they are converted again one at a time for the
+     * results. Throws `std::invalid_argument` if the offsets decrease or point past the values.
+     * 
+     * \param utf8_values The UTF-8 encoded strings, one after another.
+     * \param offsets The offsets of the strings in utf8_values, one more than the number of strings.
+     * \return The converted strings, their offsets and the results.
+     */
+    utf16_batch utf8_to_16_batch(std::u8string_view utf8_values, std::span<const int32_t> offsets);
+    utf16_batch utf8_to_16_batch(std::u8string_view utf8_values, std::span<const int64_t> offsets);
+
+    /**
+     * \brief Converts many UTF-16 encoded strings to UTF-8 at once, like `utf8_to_16_batch`.
+     * 
+     * \param utf16_strings Views to the UTF-16 encoded strings to convert.
+     * \return The converted strings, their offsets and the results.
+     */
+    utf8_batch utf16_to_8_batch(std::span<const std::u16string_view> utf16_strings);
+
+    /**
+     * \brief Converts many UTF-16 encoded strings, stored back to back, to UTF-8 at once, like `utf8_to_16_batch`.
+     * 
+     * \param utf16_values The UTF-16 encoded strings, one after another.
+     * \param offsets The offsets of the strings in utf16_values, one more than the number of strings.
+     * \return The converted strings, their offsets and the results.
+     */
+    utf8_batch utf16_to_8_batch(std::u16string_view utf16_values, std::span<const int32_t> offsets);
+    utf8_batch utf16_to_8_batch(std::u16string_view utf16_values, std::span<const int64_t> offsets);
+
+    /**
+     * \brief Checks whether a string is valid UTF-8.
+     * 
+     * Validates the whole string without decoding or converting it. A string is considered valid
+     * if and only if `utf8_to_16` would convert it without throwing.
+     * 
+     * \param utf8_string A view to the string to validate.
+     * \return `true` if the string is valid UTF-8, `false` otherwise.
+     */
+    bool is_valid_utf8(std::u8string_view utf8_string);
+
+    /**
+     * \brief Finds the first invalid UTF-8 sequence in a string.
+     * 
+     * Validates the string and, if it is not valid UTF-8, locates the first invalid sequence.
+     * 
+     * \param utf8_string A view to the string to validate.
+     * \return The offset of the first byte of the first invalid sequence, which is the position
+     * `utf8_to_16` would report in its exception, or `std::u8string_view::npos` if the string is valid.
+     */
+    size_t find_invalid_utf8(std::u8string_view utf8_string);
+
+    /**
+     * \brief Replaces invalid sequences in a UTF-8 string.
+     * 
+     * Copies the string, replacing each maximal subpart of an ill-formed sequence with U+FFFD,
+     * like `utf8_to_16` with `error_mode::replace`. The result is valid UTF-8.
+     * 
+     * \param utf8_string A view to a possibly invalid UTF-8 encoded string.
+     * \return A valid UTF-8 encoded string.
+     */
+    std::u8string sanitize_utf8(std::u8string_view utf8_string);
+
+    /**
+     * \brief Computes the length of a UTF-8 encoded string converted to UTF-16.
+     * 
+     * Counts the UTF-16 code units `utf8_to_16` produces, without converting. The input is
+     * assumed to be valid UTF-8 and is not validated.
+     * 
+     * \param utf8_string A view to a valid UTF-8 encoded string.
+     * \return The number of UTF-16 code units the string converts to.
+     */
+    size_t utf16_length_from_utf8(std::u8string_view utf8_string);
+
+    /**
+     * \brief Computes the length of a UTF-16 encoded string converted to UTF-8.
+     * 
+     * Counts the UTF-8 code units `utf16_to_8` produces, without converting. The input is
+     * assumed to be valid UTF-16 and is not validated.
+     * 
+     * \param utf16_string A view to a valid UTF-16 encoded string.
+     * \return The number of UTF-8 code units the string converts to.
+     */
+    size_t utf8_length_from_utf16(std::u16string_view utf16_string);
+
+    /**
+     * \brief Computes the length of a Latin-1 encoded string converted to UTF-8.
+     * 
+     * Counts the UTF-8 code units `latin1_to_utf8` produces, without converting. The UTF-16
+     * conversions of Latin-1 strings have the same length as the strings.
+     * 
+     * \param latin1_string A view to a Latin-1 encoded string.
+     * \return The number of UTF-8 code units the string converts to.
+     */
+    size_t utf8_length_from_latin1(std::string_view latin1_string);
+
+    /**
+     * \brief Computes the length of a UTF-8 encoded string converted to Latin-1.
+     * 
+     * Counts the bytes `utf8_to_latin1` produces, which is the number of code points. The input
+     * is assumed to be valid UTF-8 with no code points above U+00FF and is not validated.
+     * 
+     * \param utf8_string A view to a valid UTF-8 encoded string.
+     * \return The number of Latin-1 bytes the string converts to.
+     */
+    size_t latin1_length_from_utf8(std::u8string_view utf8_string);
+
+    /**
+     * \brief Counts the code points in a UTF-8 encoded string.
+     * 
+     * The input is assumed to be valid UTF-8 and is not validated.
+     * 
+     * \param utf8_string A view to a valid UTF-8 encoded string.
+     * \return The number of code points in the string.
+     */
+    size_t count_code_points(std::u8string_view utf8_string);
+
+    /**
+     * \brief Counts the code points in a UTF-16 encoded string.
+     * 
+     * The input is assumed to be valid UTF-16 and is not validated.
+     * 
+     * \param utf16_string A view to a valid UTF-16 encoded string.
+     * \return The number of code points in the string.
+     */
+    size_t count_code_points(std::u16string_view utf16_string);
+
+    namespace internal {
+        // Throws the exception_with_position the conversions throw for a failed result
+        [[noreturn]] void throw_conversion_error(const conversion_result& result);
+
+        // Convert into a buffer presized with utf16_length_from_utf8 or utf8_length_from_utf16,
+        // which is exact for valid input
+        conversion_result convert_utf8_to_16(std::u8string_view utf8_string, char16_t* out_begin);
+        conversion_result convert_utf16_to_8(std::u16string_view utf16_string, char8_t* out_begin,
+                                             const char8_t* out_end);
+
+        // Appends the output of convert, which writes at most max_size code units through a pointer
+        // and returns a conversion_result, to str. Where the library allows it, the new code units are
+        // not zero-filled before they are overwritten.
+        template <typename String, typename Converter>
+        conversion_result append_converted(String& str, size_t max_size, Converter convert) {
+            const size_t old_size = str.size();
+            conversion_result result{};
+#ifdef __cpp_lib_string_resize_and_overwrite
+            str.resize_and_overwrite(old_size + max_size, [&](auto* data, size_t) noexcept {
+                result = convert(data + old_size, data + old_size + max_size);
+                return old_size + result.written;
+            });
+#else
+            str.resize(old_size + max_size);
+            result = convert(str.data() + old_size, str.data() + old_size + max_size);
+            str.resize(old_size + result.written);
+#endif
+            return result;
+        }
+
+        // Same, but throws on invalid input, leaving str unchanged
+        template <typename String, typename Converter>
+        void append_converted_or_throw(String& str, size_t max_size, Converter convert) {
+            const size_t old_size = str.size();
+            const conversion_result result = append_converted(str, max_size, convert);
+            if (result.status != conversion_status::ok) {
+                str.resize(old_size);
+                throw_conversion_error(result);
+            }
+        }
+    }
+
+    /**
+     * \brief Converts a UTF-8 encoded string to UTF-16 and appends it to a string with any allocator.
+     * 
+     * Like the `std::u16string` overload, with all the memory coming from the string's allocator.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \param utf16_string A UTF-16 encoded string to which the converted content is appended.
+     */
+    template <typename Allocator>
+    void utf8_to_16(std::u8string_view utf8_string,
+                    std::basic_string<char16_t, std::char_traits<char16_t>, Allocator>& utf16_string) {
+        internal::append_converted_or_throw(utf16_string, utf16_length_from_utf8(utf8_string),
+            [utf8_string](char16_t* out, char16_t*) { return internal::convert_utf8_to_16(utf8_string, out); });
+    }
+
+    /**
+     * \brief Converts a UTF-16 encoded string to UTF-8 and appends it to a string with any allocator.
+     * 
+     * Like the `std::u8string` overload, with all the memory coming from the string's allocator.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to UTF-8.
+     * \param utf8_string A UTF-8 encoded string to which the converted content is appended.
+     */
+    template <typename Allocator>
+    void utf16_to_8(std::u16string_view utf16_string,
+                    std::basic_string<char8_t, std::char_traits<char8_t>, Allocator>& utf8_string) {
+        internal::append_converted_or_throw(utf8_string, utf8_length_from_utf16(utf16_string),
+            [utf16_string](char8_t* out, char8_t* out_end) { return internal::convert_utf16_to_8(utf16_string, out, out_end); });
+    }
+
+    /**
+     * \brief Converts a UTF-8 encoded string to a UTF-16 string that uses the given allocator.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \param allocator The allocator of the result, e.g. a `std::pmr::polymorphic_allocator<char16_t>`.
+     * \return A UTF-16 encoded string.
+     */
+    template <typename Allocator>
+        requires std::same_as<typename Allocator::value_type, char16_t>
+    std::basic_string<char16_t, std::char_traits<char16_t>, Allocator>
+    utf8_to_16(std::u8string_view utf8_string, const Allocator& allocator) {
+        std::basic_string<char16_t, std::char_traits<char16_t>, Allocator> utf16_string(allocator);
+        utf8_to_16(utf8_string, utf16_string);
+        return utf16_string;
+    }
+
+    /**
+     * \brief Converts a UTF-16 encoded string to a UTF-8 string that uses the given allocator.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to UTF-8.
+     * \param allocator The allocator of the result, e.g. a `std::pmr::polymorphic_allocator<char8_t>`.
+     * \return A UTF-8 encoded string.
+     */
+    template <typename Allocator>
+        requires std::same_as<typename Allocator::value_type, char8_t>
+    std::basic_string<char8_t, std::char_traits<char8_t>, Allocator>
+    utf16_to_8(std::u16string_view utf16_string, const Allocator& allocator) {
+        std::basic_string<char8_t, std::char_traits<char8_t>, Allocator> utf8_string(allocator);
+        utf16_to_8(utf16_string, utf8_string);
+        return utf8_string;
+    }
+
+    /**
+     * \brief Converts a UTF-8 encoded string to a UTF-16 string allocated from a memory resource.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string to convert to UTF-16.
+     * \param resource The memory resource of the result, e.g. a per-request arena.
+     * \return A UTF-16 encoded string.
+     */
+    std::pmr::u16string utf8_to_16(std::u8string_view utf8_string, std::pmr::memory_resource* resource);
+
+    /**
+     * \brief Converts a UTF-16 encoded string to a UTF-8 string allocated from a memory resource.
+     * 
+     * \param utf16_string A view to a UTF-16 encoded string to convert to UTF-8.
+     * \param resource The memory resource of the result, e.g. a per-request arena.
+     * \return A UTF-8 encoded string.
+     */
+    std::pmr::u8string utf16_to_8(std::u16string_view utf16_string, std::pmr::memory_resource* resource);
+
+    /**
+     * \brief Checks whether a UTF-8 and a UTF-16 string encode the same code points.
+     * 
+     * Decodes both strings as it compares them, without converting or allocating. Invalid
+     * sequences decode to U+FFFD, as with `error_mode::replace`, so the function never throws.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string.
+     * \param utf16_string A view to a UTF-16 encoded string.
+     * \return `true` if the strings encode the same sequence of code points.
+     */
+    bool equal(std::u8string_view utf8_string, std::u16string_view utf16_string);
+    bool equal(std::u8string_view utf8_string, std::u32string_view utf32_string);
+    bool equal(std::u16string_view utf16_string, std::u32string_view utf32_string);
+
+    /**
+     * \brief Compares strings in different encoding forms in code point order.
+     * 
+     * Decodes both strings as it compares them, like `equal`. Code point order is the order of
+     * UTF-8 and UTF-32 code units, but not of UTF-16 ones, which sort supplementary code points
+     * between U+D7FF and U+E000.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string.
+     * \param utf16_string A view to a UTF-16 encoded string.
+     * \return The lexicographical order of the sequences of code points.
+     */
+    std::strong_ordering compare(std::u8string_view utf8_string, std::u16string_view utf16_string);
+    std::strong_ordering compare(std::u8string_view utf8_string, std::u32string_view utf32_string);
+    std::strong_ordering compare(std::u16string_view utf16_string, std::u32string_view utf32_string);
+
+    /**
+     * \brief Hashes the code points of a string.
+     * 
+     * The hash depends only on the sequence of code points, so the same text has the same hash in
+     * every encoding form, and strings that are `equal` have equal hashes. Invalid sequences are
+     * hashed as U+FFFD. The value is the 64-bit FNV-1a hash of the code points, one per step.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string.
+     * \return The hash of the code points.
+     */
+    uint64_t hash_code_points(std::u8string_view utf8_string);
+    uint64_t hash_code_points(std::u16string_view utf16_string);
+    uint64_t hash_code_points(std::u32string_view utf32_string);
+
+    /**
+     * \brief Finds the last code point boundary at or before a byte offset in a UTF-8 string.
+     * 
+     * Looks at no more than the byte at the offset and the three bytes before it, so it takes
+     * constant time. In invalid input, a trail byte that no preceding lead byte reaches counts as
+     * a sequence of its own. Throws `std::out_of_range` if the offset is past the end of the string.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string.
+     * \param offset A byte offset, at most the length of the string.
+     * \return The offset of the start of the sequence that contains the byte at `offset`, or
+     * `offset` if it is a boundary; the length of the string is one.
+     */
+    size_t find_prev_boundary(std::u8string_view utf8_string, size_t offset);
+
+    /**
+     * \brief Finds the first code point boundary at or after a byte offset in a UTF-8 string.
+     * 
+     * Like `find_prev_boundary`, but returns the end of the sequence that contains the byte at
+     * `offset`, or `offset` if it is a boundary.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string.
+     * \param offset A byte offset, at most the length of the string.
+     * \return The offset of the first boundary at or after `offset`.
+     */
+    size_t find_next_boundary(std::u8string_view utf8_string, size_t offset);
+
+    /**
+     * \brief Shortens a UTF-8 string to a byte budget without splitting a sequence.
+     * 
+     * Takes constant time, like `find_prev_boundary`.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string.
+     * \param max_bytes The maximum length of the result.
+     * \return The longest prefix of the string, ending at a code point boundary, that is no
+     * longer than `max_bytes`.
+     */
+    std::u8string_view truncate_utf8(std::u8string_view utf8_string, size_t max_bytes);
+
+    /**
+     * \brief Splits a UTF-8 string into chunks at code point boundaries.
+     * 
+     * Each chunk is as long as possible without exceeding `chunk_size` bytes; only a chunk that
+     * holds a single sequence longer than that, which needs `chunk_size` below four, may exceed it.
+     * Finding each split point takes constant time. Throws `std::invalid_argument` if `chunk_size` is zero.
+     * 
+     * \param utf8_string A view to a UTF-8 encoded string.
+     * \param chunk_size The maximum length of a chunk in bytes.
+     * \return Views of the consecutive chunks, which together make up the string.
+     */
+    std::vector<std::u8string_view> chunk_utf8(std::u8string_view utf8_string, size_t chunk_size);
+
+    /**
+     * \brief Converts UTF-8 to UTF-16 a chunk at a time.
+     * 
+     * The input may be split anywhere, including inside a multi-byte sequence. A sequence that
+     * is incomplete at the end of a chunk is kept, up to three bytes, and completed by the next
+     * chunk, so the output of a stream equals the output of converting the concatenated chunks.
+     * Error positions are offsets from the beginning of the stream. After an error, the stream
+     * needs to be reset before it is used again.
+     */
+    class utf8_to_16_stream {
+    public:
+        /**
+         * \brief Converts a chunk of UTF-8 and appends the result to a UTF-16 string.
+         * 
+         * Throws `exception_with_position` if the chunk contains an invalid sequence; the UTF-16
+         * string then keeps its original content. A sequence that is incomplete at the end
+         * of the chunk is not an error.
+         * 
+         * \param utf8_chunk A view to the next chunk of a UTF-8 encoded stream.
+         * \param utf16_string A UTF-16 encoded string to which the converted content is appended.
+         */
+        void feed(std::u8string_view utf8_chunk, std::u16string& utf16_string);
+        /**
+         * \brief Converts a chunk of UTF-8 without throwing on invalid input.
+         * 
+         * Like `feed`, but keeps the code units converted before an invalid sequence and
+         * reports the error through the result.
+         * 
+         * \param utf8_chunk A view to the next chunk of a UTF-8 encoded stream.
+         * \param utf16_string A UTF-16 encoded string to which the converted content is appended.
+         * \return The status of the conversion, the error position within the stream and the
+         * number of appended code units.
+         */
+        conversion_result try_feed(std::u8string_view utf8_chunk, std::u16string& utf16_string);
+        /**
+         * \brief Ends the stream.
+         * 
+         * Throws `exception_with_position` if the stream ended in the middle of a sequence.
+         * Either way, the stream is reset and can be used for new input.
+         */
+        void finish();
+        /**
+         * \brief Ends the stream without throwing.
+         * 
+         * \return `conversion_status::incomplete_sequence` and the position of the incomplete
+         * sequence if the stream ended in the middle of it; otherwise `conversion_status::ok`
+         * and the length of the stream.
+         */
+        conversion_result try_finish() noexcept;
+        /**
+         * \brief Discards the state and starts a new stream.
+         */
+        void reset() noexcept;
+    private:
+        conversion_result convert(std::u8string_view utf8_chunk, std::u16string& utf16_string);
+
+        size_t   position{0};       // Stream offset of the first byte after the pending ones
+        char8_t  pending[3]{};      // Start of a sequence that continues in the next chunk
+        size_t   pending_size{0};
+    };
+
+    /**
+     * \brief Converts UTF-16 to UTF-8 a chunk at a time.
+     * 
+     * The input may be split anywhere, including between the surrogates of a pair. A lead
+     * surrogate at the end of a chunk is kept and paired with the next chunk, so the output
+     * of a stream equals the output of converting the concatenated chunks. Error positions
+     * are offsets from the beginning of the stream. After an error, the stream needs to be
+     * reset before it is used again.
+     */
+    class utf16_to_8_stream {
+    public:
+        /**
+         * \brief Converts a chunk of UTF-16 and appends the result to a UTF-8 string.
+         * 
+         * Throws `exception_with_position` if the chunk contains an invalid sequence; the UTF-8
+         * string then keeps its original content. A lead surrogate at the end of the chunk is
+         * not an error.
+         * 
+         * \param utf16_chunk A view to the next chunk of a UTF-16 encoded stream.
+         * \param utf8_string A UTF-8 encoded string to which the converted content is appended.
+         */
+        void feed(std::u16string_view utf16_chunk, std::u8string& utf8_string);
+        /**
+         * \brief Converts a chunk of UTF-16 without throwing on invalid input.
+         * 
+         * Like `feed`, but keeps the code units converted before an invalid sequence and
+         * reports the error through the result.
+         * 
+         * \param utf16_chunk A view to the next chunk of a UTF-16 encoded stream.
+         * \param utf8_string A UTF-8 encoded string to which the converted content is appended.
+         * \return The status of the conversion, the error position within the stream and the
+         * number of appended code units.
+         */
+        conversion_result try_feed(std::u16string_view utf16_chunk, std::u8string& utf8_string);
+        /**
+         * \brief Ends the stream.
+         * 
+         * Throws `exception_with_position` if the stream ended with a lead surrogate.
+         * Either way, the stream is reset and can be used for new input.
+         */
+        void finish();
+        /**
+         * \brief Ends the stream without throwing.
+         * 
+         * \return `conversion_status::incomplete_sequence` if the stream ended with a lead
+         * surrogate; otherwise `conversion_status::ok`. The position is the length of the stream.
+         */
+        conversion_result try_finish() noexcept;
+        /**
+         * \brief Discards the state and starts a new stream.
+         */
+        void reset() noexcept;
+    private:
+        conversion_result convert(std::u16string_view utf16_chunk, std::u8string& utf8_string);
+
+        size_t   position{0};       // Stream offset of the first unit after the pending lead
+        char16_t pending_lead{0};   // Lead surrogate that pairs with the next chunk, or zero
+    };
+
+    /**
+     * \brief Encoding of the text in a file.
+     */
+    enum class file_encoding {
+        utf8,       ///< UTF-8.
+        utf16le     ///< UTF-16, little endian.
+    };
+
+    /**
+     * \brief Converts a text file from one encoding to another.
+     * 
+     * Maps the source file into memory and writes the converted text to the destination file a
+     * block at a time, so the memory used does not grow with the size of the file. If the
+     * encodings are the same, the file is validated and copied. Throws `exception_with_position`
+     * with the position, in code units of the source, at which the converters throw; the
+     * destination file is then removed. I/O errors are reported with `std::filesystem::filesystem_error`.
+     * 
+     * \param src_path The file to convert.
+     * \param dst_path The file to write, which is replaced if it exists and must not be the source.
+     * \param from The encoding of the source file.
+     * \param to The encoding of the destination file.
+     */
+    void transcode_file(const std::filesystem::path& src_path, const std::filesystem::path& dst_path,
+                        file_encoding from, file_encoding to);
+
+    /**
+     * \brief Validates a text file.
+     * 
+     * Maps the file into memory and throws `exception_with_position` at the first invalid sequence,
+     * like `transcode_file`.
+     * 
+     * \param path The file to validate.
+     * \param encoding The encoding of the file.
+     */
+    void validate_file(const std::filesystem::path& path, file_encoding encoding);
+
+    /**
+     * \brief Instruction set levels of the conversion and validation kernels, in increasing order.
+     */
+    enum class implementation {
+        scalar,     ///< Portable code, available on every CPU.
+        sse,        ///< SSE2, and SSSE3 where the CPU supports it.
+        avx2,       ///< AVX2.
+        avx512      ///< AVX-512BW.
+    };
+
+    /**
+     * \brief A kernel and the instruction set level of the version in use.
+     */
+    struct kernel_info {
+        const char* name;           ///< The name of the kernel, e.g. "validate_utf8".
+        implementation level;       ///< The level of the version, at or below the active implementation.
+    };
+
+    /**
+     * \brief Returns the implementation level the conversions use.
+     *
+     * On first use, the library detects the CPU features and selects the best level the CPU
+     * supports. The environment variable `UTFCPP_IMPLEMENTATION` may name a lower level
+     * ("scalar", "sse", "avx2" or "avx512") to use instead; unknown or unsupported names are ignored.
+     *
+     * \return The active implementation level.
+     */
+    implementation active_implementation() noexcept;
+
+    /**
+     * \brief Returns the best implementation level the CPU supports.
+     */
+    implementation best_implementation() noexcept;
+
+    /**
+     * \brief Selects the implementation level the conversions use from now on.
+     *
+     * Meant for debugging and benchmarking; conversions running in other threads may finish
+     * with the previous level. Throws `std::invalid_argument` if the CPU does not support the level.
+     *
+     * \param level The level to use, at most `best_implementation()`.
+     */
+    void set_implementation(implementation level);
+
+    /**
+     * \brief Returns the name of an implementation level, as accepted by `UTFCPP_IMPLEMENTATION`.
+     */
+    const char* implementation_name(implementation level) noexcept;
+
+    /**
+     * \brief Lists the kernels of the active implementation.
+     *
+     * A kernel without a version for the active level uses the version of the highest level below it.
+     *
+     * \return The kernels and the levels of their versions in use.
      */
-    std::u8string  utf16_to_8(std::u16string_view utf16_string);
+    std::vector<kernel_info> active_kernels();
 
 /// \file
 
 /**
  * \brief Class for iterating over a UTF-8 encoded string.
  * 
- * The class is an input iterator that holds references to the current position and end of 
- * the UTF-8 encoded sequence.
+ * The class is a bidirectional iterator that holds references to the beginning, current position
+ * and end of the UTF-8 encoded sequence. Each sequence is decoded once per step and the code
+ * point is cached, so dereferencing it again is cheap. Iteration ends at the end of the sequence,
+ * which can be checked against an iterator returned by `end` or against `std::default_sentinel`.
  */
     class u8_iterator {
     public:
         using value_type        = char32_t;
         using pointer           = char32_t*;
-        using reference         = char32_t&;
+        using reference         = char32_t;
         using difference_type   = std::ptrdiff_t;
-        using iterator_category = std::input_iterator_tag;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using iterator_concept  = std::bidirectional_iterator_tag;
     public:
+        /**
+         * \brief Constructs a singular iterator, which can only be assigned to.
+         */
+        u8_iterator() = default;
         /**
          * \brief Returns a `u8_iterator` to the beginning of the given UTF-8 string view.
          * 
          * Given a `std::u8string_view` object, constructs `u8_iterator` to its beginning.
          * 
          * \param str_view A string view referencing a UTF-8 encoded string
+         * \param mode With `error_mode::replace`, invalid sequences decode to U+FFFD instead of throwing
          * \return `u8_iterator` pointing to the beginning of the sequence
          */
-        static u8_iterator begin(std::u8string_view str_view);
+        static u8_iterator begin(std::u8string_view str_view, error_mode mode = error_mode::throw_exception);
         /**
          * \brief Returns a `u8_iterator` to the end of the given UTF-8 string view.
          * 
          * Given a `std::u8string_view` object, constructs `u8_iterator` to its end.
          * 
          * \param str_view A string view referencing a UTF-8 encoded string
+         * \param mode With `error_mode::replace`, invalid sequences decode to U+FFFD instead of throwing
          * \return `u8_iterator` pointing to the end of the sequence
          */
-        static u8_iterator end(std::u8string_view str_view);
+        static u8_iterator end(std::u8string_view str_view, error_mode mode = error_mode::throw_exception);
         /**
          * \brief Decodes the next utf-8 sequence.
          * 
-         * Decodes the sequence the iterator is currently pointing to.
+         * Decodes the sequence the iterator is currently pointing to, unless it is already decoded.
          * 
          * \return The code point of the current UTF-8 sequence.
          */
@@ -153,12 +1087,25 @@ namespace utfcpp {
         /**
          * \brief The three way comparison operator.
          * 
-         * Compares two `u8_iterator` objects.
+         * Compares the positions of two `u8_iterator` objects; the error mode is not compared.
          * 
-         * \param it An iterator to compare with.
+         * \param other An iterator to compare with.
          * \return Zero if the two iterators are equal.
          */
-        auto operator <=>(const u8_iterator&) const = default;
+        auto operator <=>(const u8_iterator& other) const { return it <=> other.it; }
+        /**
+         * \brief The equality operator.
+         * 
+         * \param other An iterator to compare with.
+         * \return True if both iterators point to the same position.
+         */
+        bool operator ==(const u8_iterator& other) const { return it == other.it; }
+        /**
+         * \brief Checks if the iterator is at the end of the sequence.
+         * 
+         * \return True if the iterator points to the end of the sequence.
+         */
+        bool operator ==(std::default_sentinel_t) const { return it == end_it; }
         /**
          * \brief The prefix increment.
          * 
@@ -175,12 +1122,554 @@ namespace utfcpp {
          * \return The original value of the iterator.
          */
         u8_iterator  operator ++(int);
+        /**
+         * \brief The prefix decrement.
+         * 
+         * Decrements the iterator to point to the previous code point, scanning back over
+         * trail bytes. With `error_mode::replace`, invalid input may be split into replaced
+         * sequences differently than when incrementing.
+         * 
+         * \return Reference to the decremented iterator.
+         */
+        u8_iterator& operator --();
+        /**
+         * \brief The postfix decrement.
+         * 
+         * Decrements the iterator to point to the previous code point and returns the current one.
+         * 
+         * \return The original value of the iterator.
+         */
+        u8_iterator  operator --(int);
     private:
         u8_iterator(std::u8string_view::iterator begin,
-                    std::u8string_view::iterator end);
-        std::u8string_view::iterator it;
-        std::u8string_view::iterator end_it;
+                    std::u8string_view::iterator pos,
+                    std::u8string_view::iterator end,
+                    error_mode mode);
+        void decode() const;
+
+        std::u8string_view::iterator         begin_it{};
+        std::u8string_view::iterator         it{};
+        // The end of the decoded sequence, or `it` if the current sequence is not decoded yet
+        mutable std::u8string_view::iterator next_it{};
+        std::u8string_view::iterator         end_it{};
+        mutable char32_t                     code_point{0};
+        error_mode                           mode{error_mode::throw_exception};
+    };
+
+/**
+ * \brief A view of the code points of a UTF-8 encoded string.
+ * 
+ * A lightweight range over `u8_iterator`, ending with `std::default_sentinel`, for use with range-based
+ * for loops and `std::ranges` algorithms. The view does not own the string.
+ */
+    class u8_view : public std::ranges::view_interface<u8_view> {
+    public:
+        /**
+         * \brief Constructs an empty view.
+         */
+        u8_view() = default;
+        /**
+         * \brief Constructs a view of the code points of a UTF-8 encoded string.
+         * 
+         * \param str_view A string view referencing a UTF-8 encoded string
+         * \param mode With `error_mode::replace`, invalid sequences decode to U+FFFD instead of throwing
+         */
+        explicit u8_view(std::u8string_view str_view, error_mode mode = error_mode::throw_exception) :
+            str_view{str_view}, mode{mode}
+        {}
+        /**
+         * \return `u8_iterator` pointing to the first code point.
+         */
+        u8_iterator begin() const { return u8_iterator::begin(str_view, mode); }
+        /**
+         * \return The sentinel that marks the end of the string.
+         */
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+    private:
+        std::u8string_view str_view;
+        error_mode         mode{error_mode::throw_exception};
+    };
+
+/**
+ * \brief Class for iterating over a UTF-16 encoded string.
+ * 
+ * The class is a bidirectional iterator that holds references to the beginning, current position
+ * and end of the UTF-16 encoded sequence. Each code point is decoded once per step and cached.
+ * Iteration ends at the end of the sequence, which can be checked against an iterator returned
+ * by `end` or against `std::default_sentinel`.
+ */
+    class u16_iterator {
+    public:
+        using value_type        = char32_t;
+        using pointer           = char32_t*;
+        using reference         = char32_t;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::bidirectional_iterator_tag;
+        using iterator_concept  = std::bidirectional_iterator_tag;
+    public:
+        /**
+         * \brief Constructs a singular iterator, which can only be assigned to.
+         */
+        u16_iterator() = default;
+        /**
+         * \brief Returns a `u16_iterator` to the beginning of the given UTF-16 string view.
+         * 
+         * \param str_view A string view referencing a UTF-16 encoded string
+         * \param mode With `error_mode::replace`, unpaired surrogates decode to U+FFFD instead of throwing
+         * \return `u16_iterator` pointing to the beginning of the sequence
+         */
+        static u16_iterator begin(std::u16string_view str_view, error_mode mode = error_mode::throw_exception);
+        /**
+         * \brief Returns a `u16_iterator` to the end of the given UTF-16 string view.
+         * 
+         * \param str_view A string view referencing a UTF-16 encoded string
+         * \param mode With `error_mode::replace`, unpaired surrogates decode to U+FFFD instead of throwing
+         * \return `u16_iterator` pointing to the end of the sequence
+         */
+        static u16_iterator end(std::u16string_view str_view, error_mode mode = error_mode::throw_exception);
+        /**
+         * \brief Decodes the current code point.
+         * 
+         * Decodes the code unit or surrogate pair the iterator is currently pointing to, unless it
+         * is already decoded.
+         * 
+         * \return The current code point.
+         */
+        char32_t operator *() const;
+        /**
+         * \brief The three way comparison operator.
+         * 
+         * Compares the positions of two `u16_iterator` objects; the error mode is not compared.
+         * 
+         * \param other An iterator to compare with.
+         * \return Zero if the two iterators are equal.
+         */
+        auto operator <=>(const u16_iterator& other) const { return it <=> other.it; }
+        /**
+         * \brief The equality operator.
+         * 
+         * \param other An iterator to compare with.
+         * \return True if both iterators point to the same position.
+         */
+        bool operator ==(const u16_iterator& other) const { return it == other.it; }
+        /**
+         * \brief Checks if the iterator is at the end of the sequence.
+         * 
+         * \return True if the iterator points to the end of the sequence.
+         */
+        bool operator ==(std::default_sentinel_t) const { return it == end_it; }
+        /**
+         * \brief The prefix increment.
+         * 
+         * \return Reference to the incremented iterator.
+         */
+        u16_iterator& operator ++();
+        /**
+         * \brief The postfix increment.
+         * 
+         * \return The original value of the iterator.
+         */
+        u16_iterator  operator ++(int);
+        /**
+         * \brief The prefix decrement.
+         * 
+         * Decrements the iterator to point to the previous code point, which starts one or,
+         * for a surrogate pair, two code units back.
+         * 
+         * \return Reference to the decremented iterator.
+         */
+        u16_iterator& operator --();
+        /**
+         * \brief The postfix decrement.
+         * 
+         * \return The original value of the iterator.
+         */
+        u16_iterator  operator --(int);
+    private:
+        u16_iterator(std::u16string_view::iterator begin,
+                     std::u16string_view::iterator pos,
+                     std::u16string_view::iterator end,
+                     error_mode mode);
+        void decode() const;
+
+        std::u16string_view::iterator         begin_it{};
+        std::u16string_view::iterator         it{};
+        // The end of the decoded code point, or `it` if it is not decoded yet
+        mutable std::u16string_view::iterator next_it{};
+        std::u16string_view::iterator         end_it{};
+        mutable char32_t                      code_point{0};
+        error_mode                            mode{error_mode::throw_exception};
+    };
+
+/**
+ * \brief A view of the code points of a UTF-16 encoded string.
+ * 
+ * A lightweight range over `u16_iterator`, ending with `std::default_sentinel`, for use with range-based
+ * for loops and `std::ranges` algorithms. The view does not own the string.
+ */
+    class u16_view : public std::ranges::view_interface<u16_view> {
+    public:
+        /**
+         * \brief Constructs an empty view.
+         */
+        u16_view() = default;
+        /**
+         * \brief Constructs a view of the code points of a UTF-16 encoded string.
+         * 
+         * \param str_view A string view referencing a UTF-16 encoded string
+         * \param mode With `error_mode::replace`, unpaired surrogates decode to U+FFFD instead of throwing
+         */
+        explicit u16_view(std::u16string_view str_view, error_mode mode = error_mode::throw_exception) :
+            str_view{str_view}, mode{mode}
+        {}
+        /**
+         * \return `u16_iterator` pointing to the first code point.
+         */
+        u16_iterator begin() const { return u16_iterator::begin(str_view, mode); }
+        /**
+         * \return The sentinel that marks the end of the string.
+         */
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+    private:
+        std::u16string_view str_view;
+        error_mode          mode{error_mode::throw_exception};
+    };
+
+/**
+ * \brief Forward iterator over the UTF-16 code units of a UTF-8 encoded string, converted on demand.
+ * 
+ * Converts the string a block of up to 64 code units at a time into a buffer inside the iterator,
+ * bulk-converting ASCII runs like `utf8_to_16`, so only the input that is iterated over gets converted.
+ * In `error_mode::throw_exception`, the code units before an invalid sequence are all visited
+ * before the increment that reaches it throws `exception_with_position`.
+ */
+    class utf8_to_16_iterator {
+    public:
+        using value_type        = char16_t;
+        using pointer           = char16_t*;
+        using reference         = char16_t;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+        using iterator_concept  = std::forward_iterator_tag;
+
+        static constexpr size_t block_size {64};
+    public:
+        /**
+         * \brief Constructs a singular iterator, which can only be assigned to.
+         */
+        utf8_to_16_iterator() = default;
+        /**
+         * \brief Returns an iterator to the first UTF-16 code unit of a UTF-8 string.
+         * 
+         * Converts the first block, so it throws like the increment operator.
+         * 
+         * \param str_view A string view referencing a UTF-8 encoded string
+         * \param mode With `error_mode::replace`, invalid sequences convert to U+FFFD instead of throwing
+         */
+        static utf8_to_16_iterator begin(std::u8string_view str_view, error_mode mode = error_mode::throw_exception);
+        /**
+         * \return The current UTF-16 code unit.
+         */
+        char16_t operator *() const { return buffer[pos]; }
+        /**
+         * \brief The equality operator.
+         * 
+         * \param other An iterator over the same string to compare with.
+         * \return True if both iterators point to the same code unit.
+         */
+        bool operator ==(const utf8_to_16_iterator& other) const {
+            return block_start == other.block_start && pos == other.pos;
+        }
+        /**
+         * \brief Checks if the iterator is past the last code unit.
+         */
+        bool operator ==(std::default_sentinel_t) const { return pos == size; }
+        /**
+         * \brief The prefix increment, which converts the next block at the end of the current one.
+         */
+        utf8_to_16_iterator& operator ++();
+        /**
+         * \brief The postfix increment.
+         */
+        utf8_to_16_iterator  operator ++(int);
+    private:
+        utf8_to_16_iterator(std::u8string_view str_view, error_mode mode);
+        void convert_block();
+
+        std::u8string_view                  str_view;
+        size_t                              offset{0};      // Of the first byte that is not converted yet
+        size_t                              block_start{0}; // Of the first byte of the current block
+        std::array<char16_t, block_size>    buffer{};
+        size_t                              pos{0};
+        size_t                              size{0};
+        error_mode                          mode{error_mode::throw_exception};
+    };
+
+/**
+ * \brief Forward iterator over the UTF-8 code units of a UTF-16 encoded string, converted on demand.
+ * 
+ * The counterpart of `utf8_to_16_iterator`, bulk-converting runs outside the surrogate range
+ * like `utf16_to_8`.
+ */
+    class utf16_to_8_iterator {
+    public:
+        using value_type        = char8_t;
+        using pointer           = char8_t*;
+        using reference         = char8_t;
+        using difference_type   = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+        using iterator_concept  = std::forward_iterator_tag;
+
+        static constexpr size_t block_size {64};
+    public:
+        /**
+         * \brief Constructs a singular iterator, which can only be assigned to.
+         */
+        utf16_to_8_iterator() = default;
+        /**
+         * \brief Returns an iterator to the first UTF-8 code unit of a UTF-16 string.
+         * 
+         * \param str_view A string view referencing a UTF-16 encoded string
+         * \param mode With `error_mode::replace`, unpaired surrogates convert to U+FFFD instead of throwing
+         */
+        static utf16_to_8_iterator begin(std::u16string_view str_view, error_mode mode = error_mode::throw_exception);
+        /**
+         * \return The current UTF-8 code unit.
+         */
+        char8_t operator *() const { return buffer[pos]; }
+        /**
+         * \brief The equality operator.
+         * 
+         * \param other An iterator over the same string to compare with.
+         * \return True if both iterators point to the same code unit.
+         */
+        bool operator ==(const utf16_to_8_iterator& other) const {
+            return block_start == other.block_start && pos == other.pos;
+        }
+        /**
+         * \brief Checks if the iterator is past the last code unit.
+         */
+        bool operator ==(std::default_sentinel_t) const { return pos == size; }
+        /**
+         * \brief The prefix increment, which converts the next block at the end of the current one.
+         */
+        utf16_to_8_iterator& operator ++();
+        /**
+         * \brief The postfix increment.
+         */
+        utf16_to_8_iterator  operator ++(int);
+    private:
+        utf16_to_8_iterator(std::u16string_view str_view, error_mode mode);
+        void convert_block();
+
+        std::u16string_view                 str_view;
+        size_t                              offset{0};      // Of the first code unit that is not converted yet
+        size_t                              block_start{0}; // Of the first code unit of the current block
+        std::array<char8_t, block_size>     buffer{};
+        size_t                              pos{0};
+        size_t                              size{0};
+        error_mode                          mode{error_mode::throw_exception};
+    };
+
+/**
+ * \brief A view of a UTF-8 encoded string converted to UTF-16 on demand.
+ * 
+ * A range over `utf8_to_16_iterator`, ending with `std::default_sentinel`. Algorithms that stop
+ * early, like `std::views::take`, convert only the input they consume, without allocating.
+ * The view does not own the string.
+ */
+    class utf8_to_16_view : public std::ranges::view_interface<utf8_to_16_view> {
+    public:
+        /**
+         * \brief Constructs an empty view.
+         */
+        utf8_to_16_view() = default;
+        /**
+         * \brief Constructs a view of a UTF-8 encoded string converted to UTF-16.
+         * 
+         * \param str_view A string view referencing a UTF-8 encoded string
+         * \param mode With `error_mode::replace`, invalid sequences convert to U+FFFD instead of throwing
+         */
+        explicit utf8_to_16_view(std::u8string_view str_view, error_mode mode = error_mode::throw_exception) :
+            str_view{str_view}, mode{mode}
+        {}
+        /**
+         * \return `utf8_to_16_iterator` pointing to the first code unit.
+         */
+        utf8_to_16_iterator begin() const { return utf8_to_16_iterator::begin(str_view, mode); }
+        /**
+         * \return The sentinel that marks the end of the converted string.
+         */
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+    private:
+        std::u8string_view str_view;
+        error_mode         mode{error_mode::throw_exception};
+    };
+
+/**
+ * \brief A view of a UTF-16 encoded string converted to UTF-8 on demand.
+ * 
+ * The counterpart of `utf8_to_16_view`, over `utf16_to_8_iterator`.
+ */
+    class utf16_to_8_view : public std::ranges::view_interface<utf16_to_8_view> {
+    public:
+        /**
+         * \brief Constructs an empty view.
+         */
+        utf16_to_8_view() = default;
+        /**
+         * \brief Constructs a view of a UTF-16 encoded string converted to UTF-8.
+         * 
+         * \param str_view A string view referencing a UTF-16 encoded string
+         * \param mode With `error_mode::replace`, unpaired surrogates convert to U+FFFD instead of throwing
+         */
+        explicit utf16_to_8_view(std::u16string_view str_view, error_mode mode = error_mode::throw_exception) :
+            str_view{str_view}, mode{mode}
+        {}
+        /**
+         * \return `utf16_to_8_iterator` pointing to the first code unit.
+         */
+        utf16_to_8_iterator begin() const { return utf16_to_8_iterator::begin(str_view, mode); }
+        /**
+         * \return The sentinel that marks the end of the converted string.
+         */
+        std::default_sentinel_t end() const { return std::default_sentinel; }
+    private:
+        std::u16string_view str_view;
+        error_mode          mode{error_mode::throw_exception};
+    };
+
+/**
+ * \brief Range adaptors that convert strings lazily.
+ * 
+ * `str | views::to_utf16` is `utf8_to_16_view(str)` and `str | views::to_utf16(error_mode::replace)`
+ * converts with replacement; `views::to_utf8` does the same for UTF-16 strings. The result can be
+ * piped on to the standard adaptors, e.g. `str | utfcpp::views::to_utf16 | std::views::take(256)`.
+ * Temporary strings are rejected, since the views would outlive them.
+ */
+namespace views {
+    struct to_utf16_adaptor {
+        error_mode mode{error_mode::throw_exception};
+
+        utf8_to_16_view operator ()(std::u8string_view utf8_string) const { return utf8_to_16_view(utf8_string, mode); }
+        to_utf16_adaptor operator ()(error_mode new_mode) const { return {new_mode}; }
+
+        friend utf8_to_16_view operator |(std::u8string_view utf8_string, const to_utf16_adaptor& adaptor) {
+            return adaptor(utf8_string);
+        }
+        friend void operator |(std::u8string&& utf8_string, const to_utf16_adaptor& adaptor) = delete;
+    };
+
+    struct to_utf8_adaptor {
+        error_mode mode{error_mode::throw_exception};
+
+        utf16_to_8_view operator ()(std::u16string_view utf16_string) const { return utf16_to_8_view(utf16_string, mode); }
+        to_utf8_adaptor operator ()(error_mode new_mode) const { return {new_mode}; }
+
+        friend utf16_to_8_view operator |(std::u16string_view utf16_string, const to_utf8_adaptor& adaptor) {
+            return adaptor(utf16_string);
+        }
+        friend void operator |(std::u16string&& utf16_string, const to_utf8_adaptor& adaptor) = delete;
+    };
+
+    inline constexpr to_utf16_adaptor to_utf16 {};
+    inline constexpr to_utf8_adaptor  to_utf8 {};
+} // namespace views
+
+/**
+ * \brief Index of the code point positions in a UTF-8 encoded string.
+ * 
+ * Stores the byte offset and the UTF-16 offset of every 64th code point, found in one vectorized
+ * pass over the string, and maps between code point indices, byte offsets and UTF-16 offsets
+ * (as used, for instance, by the Language Server Protocol) by looking up the nearest checkpoint
+ * and scanning fewer than 64 code points from there. The index does not own the string, which
+ * must be valid UTF-8.
+ */
+    class utf8_index {
+    public:
+        /**
+         * \brief Constructs an index of the empty string.
+         */
+        utf8_index() = default;
+        /**
+         * \brief Indexes a UTF-8 encoded string.
+         * 
+         * Throws `exception_with_position` if the string is not valid UTF-8.
+         * 
+         * \param utf8_string A view to the string to index, which must outlive the index.
+         */
+        explicit utf8_index(std::u8string_view utf8_string);
+        /**
+         * \brief Indexes text appended to the indexed string.
+         * 
+         * Indexes only the appended text. The view must start with the indexed string; only its length
+         * is checked. Throws `std::invalid_argument` if the view is shorter than the indexed string, and
+         * `exception_with_position`, with the position in the whole string, if the appended text is not
+         * valid UTF-8 on its own. Either way the index is kept unchanged.
+         * 
+         * \param utf8_string A view to the indexed string with text appended, which may have moved.
+         */
+        void append(std::u8string_view utf8_string);
+        /**
+         * \return The number of code points in the string.
+         */
+        size_t code_point_count() const noexcept { return code_points; }
+        /**
+         * \return The length of the string converted to UTF-16.
+         */
+        size_t utf16_length() const noexcept { return utf16_units; }
+        /**
+         * \brief Returns the byte offset of a code point; the code point count maps to the length of the string.
+         * 
+         * Throws `std::out_of_range` if the index is greater than the code point count.
+         */
+        size_t byte_offset(size_t code_point_index) const;
+        /**
+         * \brief Returns the UTF-16 offset of a code point; the code point count maps to the UTF-16 length.
+         * 
+         * Throws `std::out_of_range` if the index is greater than the code point count.
+         */
+        size_t utf16_offset(size_t code_point_index) const;
+        /**
+         * \brief Returns the index of the code point that contains a byte; the length of the string maps to the code point count.
+         * 
+         * Throws `std::out_of_range` if the offset is greater than the length of the string.
+         */
+        size_t code_point_at_byte(size_t byte_offset) const;
+        /**
+         * \brief Returns the index of the code point that contains a UTF-16 code unit; the UTF-16 length maps to the code point count.
+         * 
+         * Throws `std::out_of_range` if the offset is greater than the UTF-16 length.
+         */
+        size_t code_point_at_utf16(size_t utf16_offset) const;
+    private:
+        struct checkpoint {
+            size_t byte_offset;
+            size_t utf16_offset;
+        };
+        void index_from(size_t byte_offset);
+
+        std::u8string_view      str_view;
+        std::vector<checkpoint> checkpoints{{0, 0}};    // Of code points 0, 64, 128, ...
+        size_t                  code_points{0};
+        size_t                  utf16_units{0};
     };
 } // namespace utfcpp20
 
+// The iterators of the views refer to the viewed string, not to the view
+template<>
+inline constexpr bool std::ranges::enable_borrowed_range<utfcpp::u8_view> = true;
+template<>
+inline constexpr bool std::ranges::enable_borrowed_range<utfcpp::u16_view> = true;
+template<>
+inline constexpr bool std::ranges::enable_borrowed_range<utfcpp::utf8_to_16_view> = true;
+template<>
+inline constexpr bool std::ranges::enable_borrowed_range<utfcpp::utf16_to_8_view> = true;
+
+// The header-only configuration (the utfcpp20::header_only target) defines the per code point
+// functions inline, in the headers under utfcpp20/detail
+#ifdef UTFCPP_HEADER_ONLY
+#include "utfcpp20/detail/unicode.hpp"
+#endif
+
 #endif // uftcpp20_H_de558932_1371_4b17_a2e1_ceaad0fcb1cd
@@ -0,0 +1,405 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+// Definitions of the decoding and encoding primitives declared in unicode.hpp. They are compiled
+// into core.cpp, or, with UTFCPP_HEADER_ONLY, included by unicode.hpp as inline functions.
+
+#ifndef codec_inl_H_3c9e27d4_81f5_4a0b_b6d2_5e4f0a7c91e8
+#define codec_inl_H_3c9e27d4_81f5_4a0b_b6d2_5e4f0a7c91e8
+
+#include "unicode.hpp"
+
+#include <array>
+#include <bit>
+#include <cstdint>
+
+namespace utfcpp::internal
+{
+    using u8_diff_type = std::u8string_view::difference_type;
+
+    class internal_decoding_8_error : public utfcpp::exception {
+    public:
+        internal_decoding_8_error(const char* msg) :
+            message(msg)
+        {}
+        const char * what() const noexcept override
+        { return message; }
+    private:
+        const char* message;    // A string literal, so that throwing does not allocate
+    };
+
+    class internal_decoding_16_error : public utfcpp::exception {
+    public:
+        internal_decoding_16_error(const char* msg) :
+            message(msg)
+        {}
+        const char * what() const noexcept override
+        { return message; }
+    private:
+        const char* message;    // A string literal, so that throwing does not allocate
+    };
+
+    class internal_encoding_8_error : public utfcpp::exception {
+    public:
+        internal_encoding_8_error(const char* msg) :
+            message(msg)
+        {}
+        const char * what() const noexcept override
+        { return message; }
+    private:
+        const char* message;    // A string literal, so that throwing does not allocate
+    };
+
+    class internal_encoding_16_error : public utfcpp::exception {
+    public:
+        internal_encoding_16_error(const char* msg) :
+            message(msg)
+        {}
+        const char * what() const noexcept override
+        { return message; }
+    private:
+        const char* message;    // A string literal, so that throwing does not allocate
+    };
+
+    constexpr bool
+    is_in_bmp(char32_t cp) {
+        return cp < U'\U00010000';
+    }
+
+
+    constexpr bool
+    is_overlong_sequence(const char32_t cp, const u8_diff_type length) {
+        if (cp < 0x80) {
+            if (length != 1) 
+                return true;
+        } else if (cp < 0x800) {
+            if (length != 2) 
+                return true;
+        } else if (cp < 0x10000) {
+            if (length != 3) 
+                return true;
+        }
+        return false;
+    }
+
+    constexpr size_t
+    utf8_cp_length(char16_t utf16_lead) {
+        if (utf16_lead < 0x80)                          return 1;
+        else if (utf16_lead < 0x800)                    return 2;
+        else if (!is_utf16_surrogate(utf16_lead))       return 3;
+        else if (is_utf16_lead_surrogate(utf16_lead))   return 4;
+        else                                            return 0; // invalid lead
+    }
+
+    UTFCPP_INLINE const char* describe(conversion_status status) noexcept {
+        switch (status) {
+        case conversion_status::ok:                  return "Success";
+        case conversion_status::incomplete_sequence: return "Incomplete sequence";
+        case conversion_status::invalid_lead:        return "Invalid lead";
+        case conversion_status::overlong_sequence:   return "Overlong sequence";
+        case conversion_status::invalid_code_point:  return "Invalid code point";
+        case conversion_status::buffer_too_small:    return "Buffer too small";
+        case conversion_status::unrepresentable:     return "Code point not representable";
+        }
+        return "Unknown error";
+    }
+
+    UTFCPP_INLINE char32_t decode_next_utf8_branching(std::u8string_view::iterator& it, std::u8string_view::iterator end_it,
+                                        conversion_status& status) noexcept {
+        const u8_diff_type max_length = end_it - it;
+        if (max_length < 1) {
+            status = conversion_status::incomplete_sequence;
+            return 0;
+        }
+
+        // Actual decoding. On error, the iterator is left at the start of the sequence
+        char32_t code_point{0};
+        const u8_diff_type length{utf8_cp_length(*it)};
+        if (length > max_length) {
+            status = conversion_status::incomplete_sequence;
+            return 0;
+        }
+        for (u8_diff_type i = 1; i < length; ++i) {
+            if (!is_utf8_trail(it[i])) {
+                status = conversion_status::incomplete_sequence;
+                return 0;
+            }
+        }
+        switch (length) {
+        case 1:
+            // Shortcut - no need for security checks here
+            return static_cast<char32_t>(*it++);
+            break;
+        case 2:
+            code_point = ((it[0] << 6) & 0x7ff);
+            code_point += (it[1] & 0x3f);
+            break;
+        case 3:
+            code_point = ((it[0] << 12) & 0xffff);
+            code_point += ((it[1] << 6) & 0xfff);
+            code_point += (it[2] & 0x3f);
+            break;
+        case 4:
+            code_point = ((it[0] << 18) & 0x1fffff);
+            code_point += ((it[1] << 12) & 0x3ffff);
+            code_point += ((it[2] << 6) & 0xfff);
+            code_point += (it[3] & 0x3f);
+            break;
+        default:
+            status = conversion_status::invalid_lead;
+            return 0;
+        }
+
+        // Decoding succeeded. Now, security checks...
+        if (!is_code_point_valid(code_point)) {
+            status = conversion_status::invalid_code_point;
+            return 0;
+        }
+        if (is_overlong_sequence(code_point, length)) {
+            status = conversion_status::overlong_sequence;
+            return 0;
+        }
+
+        // Success!
+        it += length;
+        return code_point;
+    }
+
+    // Tables of the UTF-8 DFA (after Bjoern Hoehrmann). Bytes are grouped into the classes that
+    // matter for well-formedness (Unicode Table 3-7). The states, premultiplied by the number of
+    // classes, are: start, reject, one trail left, two trails left, the states after the leads
+    // E0, ED, F0, F1 - F3 and F4, which restrict the next byte, and accept.
+    inline constexpr uint8_t UTF8_START  {0};
+    inline constexpr uint8_t UTF8_REJECT {12};
+    inline constexpr uint8_t UTF8_ACCEPT {108};
+
+    inline constexpr std::array<uint8_t, 256> UTF8_BYTE_CLASSES = []() {
+        std::array<uint8_t, 256> classes{};
+        for (size_t byte = 0; byte < 256; ++byte) {
+            if      (byte < 0x80)  classes[byte] = 0;
+            else if (byte < 0x90)  classes[byte] = 1;
+            else if (byte < 0xa0)  classes[byte] = 9;
+            else if (byte < 0xc0)  classes[byte] = 7;
+            else if (byte < 0xc2)  classes[byte] = 8;
+            else if (byte < 0xe0)  classes[byte] = 2;
+            else if (byte == 0xe0) classes[byte] = 10;
+            else if (byte == 0xed) classes[byte] = 4;
+            else if (byte < 0xf0)  classes[byte] = 3;
+            else if (byte == 0xf0) classes[byte] = 11;
+            else if (byte < 0xf4)  classes[byte] = 6;
+            else if (byte == 0xf4) classes[byte] = 5;
+            else                   classes[byte] = 8;
+        }
+        return classes;
+    }();
+
+    inline constexpr uint8_t UTF8_TRANSITIONS[] = {
+    //   00   80   C2   E1   ED   F4   F1   A0   C0   90   E0   F0    <- first byte of each class
+        108,  12,  24,  36,  60,  96,  84,  12,  12,  12,  48,  72,   // start
+         12,  12,  12,  12,  12,  12,  12,  12,  12,  12,  12,  12,   // reject
+         12, 108,  12,  12,  12,  12,  12, 108,  12, 108,  12,  12,   // one trail left
+         12,  24,  12,  12,  12,  12,  12,  24,  12,  24,  12,  12,   // two trails left
+         12,  12,  12,  12,  12,  12,  12,  24,  12,  12,  12,  12,   // after E0: A0 - BF
+         12,  24,  12,  12,  12,  12,  12,  12,  12,  24,  12,  12,   // after ED: 80 - 9F
+         12,  12,  12,  12,  12,  12,  12,  36,  12,  36,  12,  12,   // after F0: 90 - BF
+         12,  36,  12,  12,  12,  12,  12,  36,  12,  36,  12,  12,   // after F1 - F3: 80 - BF
+         12,  36,  12,  12,  12,  12,  12,  12,  12,  12,  12,  12,   // after F4: 80 - 8F
+        108, 108, 108, 108, 108, 108, 108, 108, 108, 108, 108, 108,   // accept
+    };
+
+    UTFCPP_INLINE char32_t decode_next_utf8_dfa(std::u8string_view::iterator& it, std::u8string_view::iterator end_it,
+                                  conversion_status& status) noexcept {
+        if (it == end_it) {
+            status = conversion_status::incomplete_sequence;
+            return 0;
+        }
+        const char8_t lead = *it;
+        if (lead < 0x80)
+            return static_cast<char32_t>(*it++);
+
+        uint32_t state = UTF8_TRANSITIONS[UTF8_START + UTF8_BYTE_CLASSES[lead]];
+        char32_t code_point = (0xffu >> UTF8_BYTE_CLASSES[lead]) & lead;
+        auto next_it{it + 1};
+        for (; state != UTF8_ACCEPT && state != UTF8_REJECT && next_it != end_it; ++next_it) {
+            code_point = (code_point << 6) | (*next_it & 0x3fu);
+            state = UTF8_TRANSITIONS[state + UTF8_BYTE_CLASSES[*next_it]];
+        }
+        if (state == UTF8_ACCEPT) {
+            it = next_it;
+            return code_point;
+        }
+
+        // Errors are rare; let the branching decoder tell which one it is
+        auto error_it{it};
+        decode_next_utf8_branching(error_it, end_it, status);
+        return 0;
+    }
+
+    UTFCPP_INLINE char32_t decode_next_utf8(std::u8string_view::iterator& it, std::u8string_view::iterator end_it,
+                              conversion_status& status) noexcept {
+#ifdef UTFCPP_DFA_DECODER
+        return decode_next_utf8_dfa(it, end_it, status);
+#else
+        return decode_next_utf8_branching(it, end_it, status);
+#endif
+    }
+
+    UTFCPP_INLINE char32_t decode_next_utf8(std::u8string_view::iterator& it, std::u8string_view::iterator end_it) {
+        conversion_status status{conversion_status::ok};
+        const char32_t code_point = decode_next_utf8(it, end_it, status);
+        if (status != conversion_status::ok)
+            throw internal_decoding_8_error(describe(status));
+        return code_point;
+    }
+
+    UTFCPP_INLINE size_t utf8_maximal_subpart_length(std::u8string_view::iterator it, std::u8string_view::iterator end_it) noexcept {
+        const char8_t lead = *it;
+        if (lead < 0xc2 || lead > 0xf4)
+            return 1;
+
+        // The second byte has a narrower range after some leads, which rules out overlong
+        // sequences, surrogates and code points above U+10FFFF (Unicode Table 3-7)
+        char8_t second_min{0x80}, second_max{0xbf};
+        switch (lead) {
+        case 0xe0: second_min = 0xa0; break;
+        case 0xed: second_max = 0x9f; break;
+        case 0xf0: second_min = 0x90; break;
+        case 0xf4: second_max = 0x8f; break;
+        default: break;
+        }
+        const u8_diff_type max_length = std::min(utf8_cp_length(lead), end_it - it);
+        u8_diff_type length{1};
+        if (length < max_length && it[1] >= second_min && it[1] <= second_max)
+            for (++length; length < max_length && is_utf8_trail(it[length]); ++length);
+        return static_cast<size_t>(length);
+    }
+
+    UTFCPP_INLINE char32_t decode_next_utf8_or_replace(std::u8string_view::iterator& it, std::u8string_view::iterator end_it) noexcept {
+        conversion_status status{conversion_status::ok};
+        const char32_t code_point = decode_next_utf8(it, end_it, status);
+        if (status == conversion_status::ok)
+            return code_point;
+        it += static_cast<u8_diff_type>(utf8_maximal_subpart_length(it, end_it));
+        return REPLACEMENT_CHARACTER;
+    }
+
+    UTFCPP_INLINE void encode_next_utf8(const char32_t code_point, std::u8string& utf8str) {
+        if (!is_code_point_valid(code_point))
+            throw internal_encoding_8_error("Invalid code point");
+
+        if (code_point < 0x80) {
+            utf8str.push_back(static_cast<char8_t>(code_point));
+        } else {
+            // Encode into a local buffer and append it at once, rather than a byte at a time
+            char8_t bytes[4];
+            utf8str.append(bytes, static_cast<size_t>(encode_next_utf8(code_point, bytes) - bytes));
+        }
+    }
+
+    UTFCPP_INLINE char8_t* encode_next_utf8(const char32_t code_point, char8_t* utf8out) noexcept {
+        if (code_point < 0x80) {                     // 1 byte
+            *utf8out++ = static_cast<char8_t>(code_point);
+        } else if (code_point < 0x800) {             // 2 bytes
+            *utf8out++ = static_cast<char8_t>((code_point >> 6)          | 0xc0);
+            *utf8out++ = static_cast<char8_t>((code_point & 0x3f)        | 0x80);
+        } else if (code_point < 0x10000) {           // 3 bytes
+            *utf8out++ = static_cast<char8_t>((code_point >> 12)         | 0xe0);
+            *utf8out++ = static_cast<char8_t>(((code_point >> 6) & 0x3f) | 0x80);
+            *utf8out++ = static_cast<char8_t>((code_point & 0x3f)        | 0x80);
+        } else {                                     // 4 bytes
+            *utf8out++ = static_cast<char8_t>((code_point >> 18)         | 0xf0);
+            *utf8out++ = static_cast<char8_t>(((code_point >> 12) & 0x3f)| 0x80);
+            *utf8out++ = static_cast<char8_t>(((code_point >> 6) & 0x3f) | 0x80);
+            *utf8out++ = static_cast<char8_t>((code_point & 0x3f)        | 0x80);
+        }
+        return utf8out;
+    }
+
+    UTFCPP_INLINE char32_t decode_next_utf16(std::u16string_view::iterator& it, std::u16string_view::iterator end_it,
+                               conversion_status& status) noexcept {
+        if (it >= end_it) {
+            status = conversion_status::incomplete_sequence;
+            return 0;
+        }
+        const char16_t first_word = static_cast<char16_t>(*it);
+        if (!is_utf16_surrogate(first_word)) {
+            ++it;
+            return first_word;
+        } else {
+            if (!is_utf16_lead_surrogate(first_word)) {
+                status = conversion_status::invalid_lead;
+                return 0;
+            }
+            ++it;
+            if (it >= end_it) {
+                status = conversion_status::incomplete_sequence;
+                return 0;
+            }
+            const char16_t second_word = static_cast<char16_t>(*it);
+            if (!is_utf16_trail_surrogate(second_word)) {
+                status = conversion_status::incomplete_sequence;
+                return 0;
+            }
+            ++it;
+            const char32_t code_point = (static_cast<char32_t>(first_word - LEAD_SURROGATE_MIN) << 10)
+                                      + (static_cast<char32_t>(second_word - TRAIL_SURROGATE_MIN))
+                                      + 0x10000;
+            return code_point;
+        }
+    }
+
+    UTFCPP_INLINE char32_t decode_next_utf16(std::u16string_view::iterator& it, std::u16string_view::iterator end_it) {
+        conversion_status status{conversion_status::ok};
+        const char32_t code_point = decode_next_utf16(it, end_it, status);
+        if (status != conversion_status::ok)
+            throw internal_decoding_16_error(describe(status));
+        return code_point;
+    }
+
+    UTFCPP_INLINE char32_t decode_next_utf16_or_replace(std::u16string_view::iterator& it, std::u16string_view::iterator end_it) noexcept {
+        const auto start{it};
+        conversion_status status{conversion_status::ok};
+        const char32_t code_point = decode_next_utf16(it, end_it, status);
+        if (status == conversion_status::ok)
+            return code_point;
+        // An unpaired surrogate; the unit after it, if any, starts the next sequence
+        it = start + 1;
+        return REPLACEMENT_CHARACTER;
+    }
+
+    UTFCPP_INLINE void encode_next_utf16(const char32_t code_point, std::u16string& utf16str) {
+        if (!is_code_point_valid(code_point))
+            throw internal_encoding_16_error("Invalid code point");
+
+        if (is_in_bmp(code_point)) {
+            utf16str.push_back(static_cast<char16_t>(code_point));
+        } else {
+            char16_t units[2];
+            utf16str.append(units, static_cast<size_t>(encode_next_utf16(code_point, units) - units));
+        }
+    }
+
+    UTFCPP_INLINE char16_t* encode_next_utf16(const char32_t code_point, char16_t* utf16out) noexcept {
+        if (is_in_bmp(code_point))
+            *utf16out++ = static_cast<char16_t>(code_point);
+        else {
+            *utf16out++ = static_cast<char16_t>(LEAD_OFFSET + (code_point >> 10));
+            *utf16out++ = static_cast<char16_t>(TRAIL_SURROGATE_MIN + (code_point & 0x3FF));
+        }
+        return utf16out;
+    }
+
+} // namespace utfcpp::internal
+
+#endif // codec_inl_H_3c9e27d4_81f5_4a0b_b6d2_5e4f0a7c91e8
@@ -0,0 +1,193 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+// Definitions of the per code point public functions: appending a code point and the u8_iterator
+// and u16_iterator members. They are compiled into utfcpp20.cpp, or, with UTFCPP_HEADER_ONLY,
+// included by unicode.hpp as inline functions.
+
+#ifndef iterator_inl_H_8d41f0b6_2a7c_4e93_9b15_c06e3f7a2d58
+#define iterator_inl_H_8d41f0b6_2a7c_4e93_9b15_c06e3f7a2d58
+
+#include "../../utfcpp20.hpp"
+#include "unicode.hpp"
+
+namespace utfcpp::internal
+{
+    // Decode one code point, throwing or replacing on an ill-formed sequence as the mode says
+    UTFCPP_INLINE char32_t decode_next_utf8(std::u8string_view::iterator& it, std::u8string_view::iterator end_it,
+                                            error_mode mode) {
+        return (mode == error_mode::replace) ? decode_next_utf8_or_replace(it, end_it)
+                                             : decode_next_utf8(it, end_it);
+    }
+
+    UTFCPP_INLINE char32_t decode_next_utf16(std::u16string_view::iterator& it, std::u16string_view::iterator end_it,
+                                             error_mode mode) {
+        return (mode == error_mode::replace) ? decode_next_utf16_or_replace(it, end_it)
+                                             : decode_next_utf16(it, end_it);
+    }
+} // namespace utfcpp::internal
+
+namespace utfcpp {
+    UTFCPP_INLINE void append_to_utf8(std::u8string& utf8string, char32_t code_point) {
+        internal::encode_next_utf8(code_point, utf8string);
+    }
+
+    UTFCPP_INLINE void append_to_utf16(std::u16string& utf16string, char32_t code_point) {
+        internal::encode_next_utf16(code_point, utf16string);
+    }
+
+    // Class u8_iterator
+
+    /* static */ UTFCPP_INLINE u8_iterator u8_iterator::begin(std::u8string_view str_view, error_mode mode) {
+      return u8_iterator(str_view.begin(), str_view.begin(), str_view.end(), mode);
+    }
+
+    /* static */ UTFCPP_INLINE u8_iterator u8_iterator::end(std::u8string_view str_view, error_mode mode) {
+      return u8_iterator(str_view.begin(), str_view.end(), str_view.end(), mode);
+    }
+
+    UTFCPP_INLINE u8_iterator::u8_iterator(std::u8string_view::iterator begin, std::u8string_view::iterator pos,
+        std::u8string_view::iterator end, error_mode mode): 
+        begin_it{begin}, it{pos}, next_it{pos}, end_it{end}, mode{mode}
+    {}
+
+    UTFCPP_INLINE void u8_iterator::decode() const {
+        if (*it < 0x80) {
+            code_point = *it;
+            next_it = it + 1;
+            return;
+        }
+        std::u8string_view::iterator temp_it{ it };
+        code_point = internal::decode_next_utf8(temp_it, end_it, mode);
+        next_it = temp_it;
+    }
+
+    UTFCPP_INLINE char32_t u8_iterator::operator * () const {
+        if (next_it == it)
+            decode();
+        return code_point;
+    }
+
+    UTFCPP_INLINE u8_iterator& u8_iterator::operator ++() {
+        if (next_it == it)
+            decode();
+        it = next_it;
+        return *this;
+    }
+
+    UTFCPP_INLINE u8_iterator u8_iterator::operator ++(int) {
+        u8_iterator temp {*this};
+        ++(*this);
+        return temp;
+    }
+
+    UTFCPP_INLINE u8_iterator& u8_iterator::operator --() {
+        // Scan back over up to three trail bytes to the lead byte
+        std::u8string_view::iterator lead_it{ it - 1 };
+        for (int i = 0; i < 3 && lead_it != begin_it && internal::is_utf8_trail(*lead_it); ++i)
+            --lead_it;
+        std::u8string_view::iterator temp_it{ lead_it };
+        char32_t decoded = internal::decode_next_utf8(temp_it, end_it, mode);
+        if (temp_it != it) {
+            // The input before the iterator is ill-formed, and its last byte is replaced on its own
+            lead_it = it - 1;
+            temp_it = lead_it;
+            internal::decode_next_utf8(temp_it, end_it, mode); // Throws, unless replacing
+            decoded = internal::REPLACEMENT_CHARACTER;
+        }
+        code_point = decoded;
+        next_it = it;
+        it = lead_it;
+        return *this;
+    }
+
+    UTFCPP_INLINE u8_iterator u8_iterator::operator --(int) {
+        u8_iterator temp {*this};
+        --(*this);
+        return temp;
+    }
+
+    // Class u16_iterator
+
+    /* static */ UTFCPP_INLINE u16_iterator u16_iterator::begin(std::u16string_view str_view, error_mode mode) {
+      return u16_iterator(str_view.begin(), str_view.begin(), str_view.end(), mode);
+    }
+
+    /* static */ UTFCPP_INLINE u16_iterator u16_iterator::end(std::u16string_view str_view, error_mode mode) {
+      return u16_iterator(str_view.begin(), str_view.end(), str_view.end(), mode);
+    }
+
+    UTFCPP_INLINE u16_iterator::u16_iterator(std::u16string_view::iterator begin, std::u16string_view::iterator pos,
+        std::u16string_view::iterator end, error_mode mode): 
+        begin_it{begin}, it{pos}, next_it{pos}, end_it{end}, mode{mode}
+    {}
+
+    UTFCPP_INLINE void u16_iterator::decode() const {
+        if (!internal::is_utf16_surrogate(*it)) {
+            code_point = *it;
+            next_it = it + 1;
+            return;
+        }
+        std::u16string_view::iterator temp_it{ it };
+        code_point = internal::decode_next_utf16(temp_it, end_it, mode);
+        next_it = temp_it;
+    }
+
+    UTFCPP_INLINE char32_t u16_iterator::operator * () const {
+        if (next_it == it)
+            decode();
+        return code_point;
+    }
+
+    UTFCPP_INLINE u16_iterator& u16_iterator::operator ++() {
+        if (next_it == it)
+            decode();
+        it = next_it;
+        return *this;
+    }
+
+    UTFCPP_INLINE u16_iterator u16_iterator::operator ++(int) {
+        u16_iterator temp {*this};
+        ++(*this);
+        return temp;
+    }
+
+    UTFCPP_INLINE u16_iterator& u16_iterator::operator --() {
+        // A trail surrogate preceded by a lead surrogate ends a pair
+        std::u16string_view::iterator lead_it{ it - 1 };
+        if (lead_it != begin_it && internal::is_utf16_trail_surrogate(*lead_it) &&
+            internal::is_utf16_lead_surrogate(*(lead_it - 1)))
+            --lead_it;
+        std::u16string_view::iterator temp_it{ lead_it };
+        char32_t decoded = internal::decode_next_utf16(temp_it, end_it, mode);
+        if (temp_it != it) {
+            // A lead surrogate right before the iterator is unpaired
+            temp_it = lead_it;
+            internal::decode_next_utf16(temp_it, it, mode); // Throws, unless replacing
+            decoded = internal::REPLACEMENT_CHARACTER;
+        }
+        code_point = decoded;
+        next_it = it;
+        it = lead_it;
+        return *this;
+    }
+
+    UTFCPP_INLINE u16_iterator u16_iterator::operator --(int) {
+        u16_iterator temp {*this};
+        --(*this);
+        return temp;
+    }
+} // namespace utfcpp
+
+#endif // iterator_inl_H_8d41f0b6_2a7c_4e93_9b15_c06e3f7a2d58
@@ -0,0 +1,140 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+// Unicode constants and the per code point decoding and encoding primitives. The definitions are
+// in codec_inl.hpp: compiled into the library, or, with UTFCPP_HEADER_ONLY, included at the end
+// of this header as inline functions, so that every caller can inline them.
+
+#ifndef unicode_H_5b7e2c19_d04a_4f6e_a3c8_9172e64b0d3f
+#define unicode_H_5b7e2c19_d04a_4f6e_a3c8_9172e64b0d3f
+
+#include <string_view>
+#include <string>
+#include <bit>
+#include <cstddef> // std::size_t
+#include <cstdint>
+
+#include "../../utfcpp20.hpp"
+
+#ifdef UTFCPP_HEADER_ONLY
+#define UTFCPP_INLINE inline
+#else
+#define UTFCPP_INLINE
+#endif
+
+namespace utfcpp::internal
+{
+    // Unicode constants
+
+    // Leading (high) surrogates: d800 - dbff
+    // Trailing (low) surrogates: dc00 - dfff
+    constexpr char16_t LEAD_SURROGATE_MIN  {u'\xd800'};
+    constexpr char16_t LEAD_SURROGATE_MAX  {u'\xdbff'};
+    constexpr char16_t TRAIL_SURROGATE_MIN {u'\xdc00'};
+    constexpr char16_t TRAIL_SURROGATE_MAX {u'\xdfff'};
+    constexpr char32_t LEAD_OFFSET         {U'\xd7c0'};       // LEAD_SURROGATE_MIN - (0x10000 >> 10)
+    constexpr char32_t SURROGATE_OFFSET    {U'\xfca02400'};   // 0x10000u - (LEAD_SURROGATE_MIN << 10) - TRAIL_SURROGATE_MIN
+
+    // Maximum valid value for a Unicode code point
+    constexpr char32_t CODE_POINT_MAX      {U'\U0010ffff'};
+
+    // Replacement character
+    constexpr char32_t REPLACEMENT_CHARACTER {U'\ufffd'};
+
+    // Is the byte a utf-8 trail?
+    constexpr bool
+    is_utf8_trail(char8_t ch) {
+        return ((ch >> 6) == 0x2);
+    }
+
+    // Length of the sequence starting with the lead byte, or zero for an invalid lead
+    constexpr std::u8string_view::difference_type
+    utf8_cp_length(char8_t lead_byte) {
+        switch (std::countl_one(uint8_t(lead_byte))) {
+            case 0: return 1;
+            case 2: return 2;
+            case 3: return 3;
+            case 4: return 4;
+            default: return 0; // invalid lead
+        }        
+    }
+
+    constexpr bool
+    is_utf16_surrogate(char32_t cp) {
+        return (cp >= LEAD_SURROGATE_MIN && cp <= TRAIL_SURROGATE_MAX);
+    }
+
+    constexpr bool
+    is_code_point_valid(char32_t cp) {
+        return (cp <= CODE_POINT_MAX && !is_utf16_surrogate(cp));
+    }
+
+    constexpr bool 
+    is_utf16_lead_surrogate(char16_t cp) {
+        return (cp >= LEAD_SURROGATE_MIN && cp <= LEAD_SURROGATE_MAX);
+    }
+
+    constexpr bool
+    is_utf16_trail_surrogate(char16_t cp) {
+        return (cp >= TRAIL_SURROGATE_MIN && cp <= TRAIL_SURROGATE_MAX);
+    }
+
+    // Error description used as the exception message
+    const char* describe(conversion_status status) noexcept;
+
+    // Decoding functions. On error, the non-throwing variants set the status and leave the
+    // iterator where the throwing ones would; on success the status is left unchanged.
+    char32_t decode_next_utf8(std::u8string_view::iterator& it, std::u8string_view::iterator end_it);
+    char32_t decode_next_utf8(std::u8string_view::iterator& it, std::u8string_view::iterator end_it,
+                              conversion_status& status) noexcept;
+
+    // The two UTF-8 decoding engines behind the non-throwing decode_next_utf8, which uses the
+    // table-driven DFA if UTFCPP_DFA_DECODER is defined and the branching decoder otherwise.
+    // Both report the same statuses and positions.
+    char32_t decode_next_utf8_branching(std::u8string_view::iterator& it, std::u8string_view::iterator end_it,
+                                        conversion_status& status) noexcept;
+    char32_t decode_next_utf8_dfa(std::u8string_view::iterator& it, std::u8string_view::iterator end_it,
+                                  conversion_status& status) noexcept;
+
+    char32_t decode_next_utf16(std::u16string_view::iterator& it, std::u16string_view::iterator end_it);
+    char32_t decode_next_utf16(std::u16string_view::iterator& it, std::u16string_view::iterator end_it,
+                               conversion_status& status) noexcept;
+
+    // Length of the maximal subpart of the ill-formed sequence at it: the longest prefix of a
+    // well-formed sequence, or one byte if there is none. This is what a lossy conversion
+    // replaces with a single U+FFFD, following the Unicode best practice (Table 3-8).
+    size_t utf8_maximal_subpart_length(std::u8string_view::iterator it, std::u8string_view::iterator end_it) noexcept;
+
+    // Decoding functions that never fail: an ill-formed sequence decodes to U+FFFD and the
+    // iterator moves past its maximal subpart, or past an unpaired surrogate. Both need it != end_it.
+    char32_t decode_next_utf8_or_replace(std::u8string_view::iterator& it, std::u8string_view::iterator end_it) noexcept;
+    char32_t decode_next_utf16_or_replace(std::u16string_view::iterator& it, std::u16string_view::iterator end_it) noexcept;
+
+    // Encoding functions
+    void encode_next_utf8(const char32_t code_point, std::u8string& utf8str);
+    void encode_next_utf16(const char32_t code_point, std::u16string& utf16str);
+
+    // Write a valid code point through a pointer into a presized buffer and return the position
+    // past the written units. Validation is up to the caller, typically a decoding function.
+    char8_t* encode_next_utf8(const char32_t code_point, char8_t* utf8out) noexcept;
+    char16_t* encode_next_utf16(const char32_t code_point, char16_t* utf16out) noexcept;
+
+}  // namespace utfcpp::internal
+
+#ifdef UTFCPP_HEADER_ONLY
+#include "codec_inl.hpp"
+#include "iterator_inl.hpp"
+#endif
+
+#endif // unicode_H_5b7e2c19_d04a_4f6e_a3c8_9172e64b0d3f
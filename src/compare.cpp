@@ -0,0 +1,173 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+#include "utfcpp20.hpp"
+#include "core.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <compare>
+#include <type_traits>
+
+namespace utfcpp {
+    // Code points decoded at a time
+    constexpr size_t READER_BLOCK_SIZE {64};
+
+    // FNV-1a parameters, applied to code points rather than to bytes
+    constexpr uint64_t FNV_OFFSET_BASIS {0xcbf29ce484222325u};
+    constexpr uint64_t FNV_PRIME        {0x100000001b3u};
+
+    // Decodes a string a block of code points at a time into a buffer on the stack. The runs the
+    // vector kernels handle, ASCII in UTF-8 and units outside the surrogate range in UTF-16, are
+    // widened in bulk; other sequences are decoded one at a time, invalid ones to U+FFFD.
+    template <typename CharT>
+    class code_point_reader {
+    public:
+        explicit code_point_reader(std::basic_string_view<CharT> str_view) : str_view{str_view} {}
+
+        // The decoded code points that are not consumed yet; empty at the end of the string
+        std::u32string_view available() noexcept {
+            if (pos == size)
+                refill();
+            return {buffer.data() + pos, size - pos};
+        }
+
+        void consume(size_t count) noexcept { pos += count; }
+
+    private:
+        void refill() noexcept {
+            pos = 0;
+            size = 0;
+            while (size < READER_BLOCK_SIZE && offset < str_view.size()) {
+                const size_t remaining = std::min(READER_BLOCK_SIZE - size, str_view.size() - offset);
+                const size_t widened = widen(str_view.data() + offset, remaining, buffer.data() + size);
+                size += widened;
+                offset += widened;
+                if (widened < remaining)
+                    buffer[size++] = decode_next();
+            }
+        }
+
+        static size_t widen(const CharT* src, size_t length, char32_t* dst) noexcept {
+            if constexpr (std::is_same_v<CharT, char8_t>) {
+                return internal::widen_ascii_to_utf32(src, length, dst);
+            } else if constexpr (std::is_same_v<CharT, char16_t>) {
+                return internal::widen_bmp_to_utf32(src, length, dst);
+            } else {
+                size_t i{0};
+                for (; i < length && internal::is_code_point_valid(src[i]); ++i)
+                    dst[i] = src[i];
+                return i;
+            }
+        }
+
+        char32_t decode_next() noexcept {
+            if constexpr (std::is_same_v<CharT, char32_t>) {
+                ++offset;
+                return internal::REPLACEMENT_CHARACTER;
+            } else {
+                auto it{str_view.begin() + static_cast<std::ptrdiff_t>(offset)};
+                char32_t code_point;
+                if constexpr (std::is_same_v<CharT, char8_t>)
+                    code_point = internal::decode_next_utf8_or_replace(it, str_view.end());
+                else
+                    code_point = internal::decode_next_utf16_or_replace(it, str_view.end());
+                offset = static_cast<size_t>(std::distance(str_view.begin(), it));
+                return code_point;
+            }
+        }
+
+        std::basic_string_view<CharT> str_view;
+        size_t offset{0};   // Of the first code unit that is not decoded yet
+        std::array<char32_t, READER_BLOCK_SIZE> buffer;
+        size_t pos{0};
+        size_t size{0};
+    };
+
+    template <typename CharA, typename CharB>
+    static std::strong_ordering compare_code_points(std::basic_string_view<CharA> a, std::basic_string_view<CharB> b) {
+        code_point_reader<CharA> reader_a{a};
+        code_point_reader<CharB> reader_b{b};
+        for (;;) {
+            const std::u32string_view block_a = reader_a.available();
+            const std::u32string_view block_b = reader_b.available();
+            if (block_a.empty() || block_b.empty())
+                return !block_a.empty() <=> !block_b.empty();
+            const size_t count = std::min(block_a.size(), block_b.size());
+            const auto [diff_a, diff_b] = std::mismatch(block_a.begin(), block_a.begin() + static_cast<std::ptrdiff_t>(count),
+                                                        block_b.begin());
+            if (diff_a != block_a.begin() + static_cast<std::ptrdiff_t>(count))
+                return *diff_a <=> *diff_b;
+            reader_a.consume(count);
+            reader_b.consume(count);
+        }
+    }
+
+    template <typename CharT>
+    static uint64_t hash_decoded(std::basic_string_view<CharT> str_view) {
+        code_point_reader<CharT> reader{str_view};
+        uint64_t hash{FNV_OFFSET_BASIS};
+        for (std::u32string_view block = reader.available(); !block.empty(); block = reader.available()) {
+            for (char32_t code_point : block)
+                hash = (hash ^ code_point) * FNV_PRIME;
+            reader.consume(block.size());
+        }
+        return hash;
+    }
+
+    bool equal(std::u8string_view utf8_string, std::u16string_view utf16_string) {
+        // Equal strings have one to three bytes per UTF-16 code unit, one to four per code point
+        // and one or two UTF-16 code units per code point, counting U+FFFD for invalid sequences
+        if (utf8_string.size() < utf16_string.size() || utf8_string.size() > 3 * utf16_string.size())
+            return false;
+        return compare_code_points(utf8_string, utf16_string) == 0;
+    }
+
+    bool equal(std::u8string_view utf8_string, std::u32string_view utf32_string) {
+        if (utf8_string.size() < utf32_string.size() || utf8_string.size() > 4 * utf32_string.size())
+            return false;
+        return compare_code_points(utf8_string, utf32_string) == 0;
+    }
+
+    bool equal(std::u16string_view utf16_string, std::u32string_view utf32_string) {
+        if (utf16_string.size() < utf32_string.size() || utf16_string.size() > 2 * utf32_string.size())
+            return false;
+        return compare_code_points(utf16_string, utf32_string) == 0;
+    }
+
+    std::strong_ordering compare(std::u8string_view utf8_string, std::u16string_view utf16_string) {
+        return compare_code_points(utf8_string, utf16_string);
+    }
+
+    std::strong_ordering compare(std::u8string_view utf8_string, std::u32string_view utf32_string) {
+        return compare_code_points(utf8_string, utf32_string);
+    }
+
+    std::strong_ordering compare(std::u16string_view utf16_string, std::u32string_view utf32_string) {
+        return compare_code_points(utf16_string, utf32_string);
+    }
+
+    uint64_t hash_code_points(std::u8string_view utf8_string) {
+        return hash_decoded(utf8_string);
+    }
+
+    uint64_t hash_code_points(std::u16string_view utf16_string) {
+        return hash_decoded(utf16_string);
+    }
+
+    uint64_t hash_code_points(std::u32string_view utf32_string) {
+        return hash_decoded(utf32_string);
+    }
+} // namespace utfcpp
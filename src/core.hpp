@@ -16,39 +16,27 @@
 #define core_H_de558932_1371_4b17_a2e1_ceaad0fcb1cd
 
 #include <string_view>
-#include <string>
 #include <cstddef> // std::size_t
 
+#include "utfcpp20.hpp"
+#include "utfcpp20/detail/unicode.hpp"
+
 namespace utfcpp::internal
 {
-    // Unicode constants
-
-    // Leading (high) surrogates: d800 - dbff
-    // Trailing (low) surrogates: dc00 - dfff
-    constexpr char16_t LEAD_SURROGATE_MIN  {u'\xd800'};
-    constexpr char16_t LEAD_SURROGATE_MAX  {u'\xdbff'};
-    constexpr char16_t TRAIL_SURROGATE_MIN {u'\xdc00'};
-    constexpr char16_t TRAIL_SURROGATE_MAX {u'\xdfff'};
-    constexpr char32_t LEAD_OFFSET         {U'\xd7c0'};       // LEAD_SURROGATE_MIN - (0x10000 >> 10)
-    constexpr char32_t SURROGATE_OFFSET    {U'\xfca02400'};   // 0x10000u - (LEAD_SURROGATE_MIN << 10) - TRAIL_SURROGATE_MIN
-
-    // Maximum valid value for a Unicode code point
-    constexpr char32_t CODE_POINT_MAX      {U'\U0010ffff'};
-
-    // Replacement character
-    constexpr char32_t REPLACEMENT_CHARACTER {U'\ufffd'};
-
     // Helpers for resizing strings before converting between encoding forms
     size_t estimate8(std::u16string_view utf16str);
     size_t estimate16(std::u8string_view utf8str);
+    size_t estimate8(std::u32string_view utf32str);
+    size_t estimate16(std::u32string_view utf32str);
 
-    // Decoding functions
-    char32_t decode_next_utf8(std::u8string_view::iterator& it, std::u8string_view::iterator end_it);
-    char32_t decode_next_utf16(std::u16string_view::iterator& it, std::u16string_view::iterator end_it);
+    // Position of the first invalid sequence of utf8_string, given a block offset reported by
+    // the vector validation: the sequence starts no earlier than three bytes before it.
+    // Returns std::u8string_view::npos if the string is valid after all.
+    size_t locate_invalid_utf8(std::u8string_view utf8_string, size_t block);
 
-    // Encoding functions
-    void encode_next_utf8(const char32_t code_point, std::u8string& utf8str);
-    void encode_next_utf16(const char32_t code_point, std::u16string& utf16str);
+    // Throws exception_with_position for the invalid sequence at position, typically the result
+    // of find_invalid_utf8 on utf8_string, with the status of decoding it
+    [[noreturn]] void throw_invalid_utf8(std::u8string_view utf8_string, size_t position);
 
 }  // namespace utfcpp::internal
 
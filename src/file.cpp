@@ -0,0 +1,274 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+#include "utfcpp20.hpp"
+#include "core.hpp"
+
+#include <bit>
+#include <fstream>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace utfcpp {
+    namespace {
+        // Read-only mapping of a whole file into memory
+        class mapped_file {
+        public:
+            explicit mapped_file(const std::filesystem::path& path);
+            ~mapped_file();
+            mapped_file(const mapped_file&) = delete;
+            mapped_file& operator=(const mapped_file&) = delete;
+
+            const char* data() const noexcept { return data_; }
+            size_t size() const noexcept { return size_; }
+
+        private:
+            const char* data_ {nullptr};
+            size_t size_ {0};
+#ifdef _WIN32
+            HANDLE mapping_ {nullptr};
+#endif
+        };
+
+#ifdef _WIN32
+        mapped_file::mapped_file(const std::filesystem::path& path) {
+            // The error is read before any cleanup, which may overwrite it
+            auto fail = [&path](DWORD error) {
+                throw std::filesystem::filesystem_error("utfcpp: cannot map file", path,
+                    std::error_code(static_cast<int>(error), std::system_category()));
+            };
+            const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                fail(GetLastError());
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file, &file_size)) {
+                const DWORD error = GetLastError();
+                CloseHandle(file);
+                fail(error);
+            }
+            size_ = static_cast<size_t>(file_size.QuadPart);
+            if (size_ == 0) {
+                // Empty files cannot be mapped
+                CloseHandle(file);
+                return;
+            }
+            mapping_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            const DWORD mapping_error = GetLastError();
+            CloseHandle(file);
+            if (mapping_ == nullptr)
+                fail(mapping_error);
+            data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+            if (data_ == nullptr) {
+                const DWORD error = GetLastError();
+                CloseHandle(mapping_);
+                fail(error);
+            }
+        }
+
+        mapped_file::~mapped_file() {
+            if (data_ != nullptr)
+                UnmapViewOfFile(data_);
+            if (mapping_ != nullptr)
+                CloseHandle(mapping_);
+        }
+#else
+        mapped_file::mapped_file(const std::filesystem::path& path) {
+            // The error is read before any cleanup, which may overwrite errno
+            auto fail = [&path](int error) {
+                throw std::filesystem::filesystem_error("utfcpp: cannot map file", path,
+                                                        std::error_code(error, std::generic_category()));
+            };
+            const int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1)
+                fail(errno);
+            struct stat file_status;
+            if (fstat(fd, &file_status) == -1) {
+                const int error = errno;
+                close(fd);
+                fail(error);
+            }
+            size_ = static_cast<size_t>(file_status.st_size);
+            if (size_ == 0) {
+                // Empty files cannot be mapped
+                close(fd);
+                return;
+            }
+            void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            const int mmap_error = errno;
+            close(fd);
+            if (data == MAP_FAILED)
+                fail(mmap_error);
+            madvise(data, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<const char*>(data);
+        }
+
+        mapped_file::~mapped_file() {
+            if (data_ != nullptr)
+                munmap(const_cast<char*>(data_), size_);
+        }
+#endif
+
+        // Code units of input converted per block of output
+        constexpr size_t BLOCK_SIZE {size_t{1} << 20};
+
+        template <typename Char>
+        void write_block(std::ofstream& dst, const Char* data, size_t size) {
+            dst.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size * sizeof(Char)));
+        }
+
+        // UTF-16LE code units in the byte order of the host
+        char16_t to_little_endian(char16_t unit) {
+            if constexpr (std::endian::native == std::endian::big)
+                return static_cast<char16_t>((unit >> 8) | (unit << 8));
+            return unit;
+        }
+
+        void validate_utf8(const mapped_file& src) {
+            const std::u8string_view utf8_string(reinterpret_cast<const char8_t*>(src.data()), src.size());
+            const size_t position = find_invalid_utf8(utf8_string);
+            if (position != std::u8string_view::npos)
+                internal::throw_invalid_utf8(utf8_string, position);
+        }
+
+        // Converts UTF-8 input a block at a time and passes each converted block to sink
+        template <typename Sink>
+        void convert_utf8_to_16le(const mapped_file& src, Sink sink) {
+            const std::u8string_view utf8_string(reinterpret_cast<const char8_t*>(src.data()), src.size());
+            utf8_to_16_stream stream;
+            std::u16string block;
+            for (size_t offset = 0; offset < utf8_string.size(); offset += BLOCK_SIZE) {
+                block.clear();
+                stream.feed(utf8_string.substr(offset, BLOCK_SIZE), block);
+                if constexpr (std::endian::native == std::endian::big) {
+                    for (char16_t& unit : block)
+                        unit = to_little_endian(unit);
+                }
+                sink(block);
+            }
+            stream.finish();
+        }
+
+        // Converts UTF-16LE input a block at a time and passes each converted block to sink.
+        // A byte left over at the end is an incomplete code unit.
+        template <typename Sink>
+        void convert_utf16le_to_8(const mapped_file& src, Sink sink) {
+            // The mapping is page aligned
+            const std::u16string_view utf16_string(reinterpret_cast<const char16_t*>(src.data()), src.size() / 2);
+            utf16_to_8_stream stream;
+            std::u16string swapped;
+            std::u8string block;
+            for (size_t offset = 0; offset < utf16_string.size(); offset += BLOCK_SIZE) {
+                std::u16string_view units{utf16_string.substr(offset, BLOCK_SIZE)};
+                if constexpr (std::endian::native == std::endian::big) {
+                    swapped.assign(units);
+                    for (char16_t& unit : swapped)
+                        unit = to_little_endian(unit);
+                    units = swapped;
+                }
+                block.clear();
+                stream.feed(units, block);
+                sink(block);
+            }
+            stream.finish();
+            if (src.size() % 2 != 0)
+                throw exception_with_position(utf16_string.size(),
+                                              internal::describe(conversion_status::incomplete_sequence));
+        }
+
+        // Scans UTF-16LE input for unpaired surrogates without converting it, and reports the
+        // positions and statuses convert_utf16le_to_8 does
+        void validate_utf16le(const mapped_file& src) {
+            const std::u16string_view utf16_string(reinterpret_cast<const char16_t*>(src.data()), src.size() / 2);
+            for (size_t i = 0; i < utf16_string.size(); ++i) {
+                const char16_t unit = to_little_endian(utf16_string[i]);
+                if (!internal::is_utf16_surrogate(unit))
+                    continue;
+                if (!internal::is_utf16_lead_surrogate(unit))
+                    throw exception_with_position(i, internal::describe(conversion_status::invalid_lead));
+                // An unpaired lead surrogate is reported at the unit after it
+                if (++i == utf16_string.size() || !internal::is_utf16_trail_surrogate(to_little_endian(utf16_string[i])))
+                    throw exception_with_position(i, internal::describe(conversion_status::incomplete_sequence));
+            }
+            if (src.size() % 2 != 0)
+                throw exception_with_position(utf16_string.size(),
+                                              internal::describe(conversion_status::incomplete_sequence));
+        }
+
+        void validate(const mapped_file& src, file_encoding encoding) {
+            if (encoding == file_encoding::utf8)
+                validate_utf8(src);
+            else
+                validate_utf16le(src);
+        }
+    }  // namespace
+
+    void transcode_file(const std::filesystem::path& src_path, const std::filesystem::path& dst_path,
+                        file_encoding from, file_encoding to) {
+        // Truncating the mapped source would pull the input from under the conversion
+        std::error_code error;
+        if (std::filesystem::equivalent(src_path, dst_path, error))
+            throw std::filesystem::filesystem_error("utfcpp: the source and destination are the same file",
+                                                    src_path, dst_path, std::make_error_code(std::errc::invalid_argument));
+
+        const mapped_file src(src_path);
+        std::ofstream dst(dst_path, std::ios::binary | std::ios::trunc);
+        if (!dst)
+            throw std::filesystem::filesystem_error("utfcpp: cannot open file for writing", dst_path,
+                                                    std::make_error_code(std::errc::io_error));
+        try {
+            if (from == file_encoding::utf8 && to == file_encoding::utf16le) {
+                convert_utf8_to_16le(src, [&dst](const std::u16string& block) {
+                    write_block(dst, block.data(), block.size());
+                });
+            } else if (from == file_encoding::utf16le && to == file_encoding::utf8) {
+                convert_utf16le_to_8(src, [&dst](const std::u8string& block) {
+                    write_block(dst, block.data(), block.size());
+                });
+            } else {
+                validate(src, from);
+                write_block(dst, src.data(), src.size());
+            }
+            dst.close();
+            if (!dst)
+                throw std::filesystem::filesystem_error("utfcpp: cannot write file", dst_path,
+                                                        std::make_error_code(std::errc::io_error));
+        } catch (...) {
+            dst.close();
+            std::filesystem::remove(dst_path, error);
+            throw;
+        }
+    }
+
+    void validate_file(const std::filesystem::path& path, file_encoding encoding) {
+        const mapped_file src(path);
+        validate(src, encoding);
+    }
+
+}  // namespace utfcpp
@@ -0,0 +1,175 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+#include "utfcpp20.hpp"
+#include "core.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace utfcpp {
+    // Code points between checkpoints
+    constexpr size_t CHECKPOINT_INTERVAL {64};
+
+    utf8_index::utf8_index(std::u8string_view utf8_string) : str_view{utf8_string} {
+        index_from(0);
+    }
+
+    void utf8_index::append(std::u8string_view utf8_string) {
+        if (utf8_string.size() < str_view.size())
+            throw std::invalid_argument("utfcpp: appended view is shorter than the indexed string");
+        const std::u8string_view old_view = str_view;
+        str_view = utf8_string;
+        try {
+            index_from(old_view.size());
+        } catch (const exception_with_position&) {
+            str_view = old_view;
+            throw;
+        }
+    }
+
+    void utf8_index::index_from(size_t byte_offset) {
+        // Classify and validate 64-byte blocks a batch at a time, in one pass. The text from
+        // byte_offset on is validated on its own, as if zeros preceded it. A checkpoint falls in a
+        // block if the block starts the code point after which a checkpoint is due; it is at the
+        // lead of that code point.
+        constexpr size_t BATCH_SIZE {64};
+        static constexpr char8_t NO_PREV_BLOCK[64] {};
+        uint64_t lead_masks[BATCH_SIZE], four_byte_masks[BATCH_SIZE];
+        const size_t text_start = byte_offset;
+        const size_t old_checkpoint_count = checkpoints.size();
+        const size_t old_code_points = code_points;
+        const size_t old_utf16_units = utf16_units;
+        const char8_t* prev_block = NO_PREV_BLOCK;
+        char8_t tail[64];
+        size_t next_checkpoint = checkpoints.size() * CHECKPOINT_INTERVAL;
+        for (bool last_batch = false; !last_batch;) {
+            size_t block_count = std::min((str_view.size() - byte_offset) / 64, BATCH_SIZE);
+            const char8_t* blocks = str_view.data() + byte_offset;
+            if (block_count == 0) {
+                // Pad the last, possibly empty, block with zeros, which also end a sequence cut off
+                // by the end of the string
+                std::fill(std::begin(tail), std::end(tail), char8_t{0});
+                std::copy(str_view.begin() + static_cast<std::ptrdiff_t>(byte_offset), str_view.end(), tail);
+                blocks = tail;
+                block_count = 1;
+                last_batch = true;
+            }
+
+            const size_t invalid = internal::utf8_lead_masks(blocks, prev_block, block_count, lead_masks, four_byte_masks);
+            if (invalid < block_count) {
+                // Keep the index unchanged
+                checkpoints.resize(old_checkpoint_count);
+                code_points = old_code_points;
+                utf16_units = old_utf16_units;
+                const std::u8string_view text{str_view.substr(text_start)};
+                const size_t position = internal::locate_invalid_utf8(text, byte_offset + invalid * 64 - text_start);
+                internal::throw_invalid_utf8(str_view, text_start + position);
+            }
+            if (last_batch) {
+                // The padding starts no code point
+                const uint64_t text_bytes = (uint64_t{1} << (str_view.size() - byte_offset)) - 1;
+                lead_masks[0] &= text_bytes;
+                four_byte_masks[0] &= text_bytes;
+            }
+            prev_block = blocks + (block_count - 1) * 64;
+
+            for (size_t k = 0; k < block_count; ++k, byte_offset += 64) {
+                const uint64_t leads = lead_masks[k];
+                const auto lead_count = static_cast<size_t>(std::popcount(leads));
+                while (code_points + lead_count > next_checkpoint) {
+                    // Clear the leads before the checkpoint
+                    uint64_t from_checkpoint = leads;
+                    for (size_t n = next_checkpoint - code_points; n > 0; --n)
+                        from_checkpoint &= from_checkpoint - 1;
+                    const auto position = static_cast<unsigned>(std::countr_zero(from_checkpoint));
+                    const uint64_t before = (uint64_t{1} << position) - 1;
+                    checkpoints.push_back({byte_offset + position,
+                                           utf16_units + static_cast<size_t>(std::popcount(leads & before)) +
+                                           static_cast<size_t>(std::popcount(four_byte_masks[k] & before))});
+                    next_checkpoint += CHECKPOINT_INTERVAL;
+                }
+                code_points += lead_count;
+                utf16_units += lead_count + static_cast<size_t>(std::popcount(four_byte_masks[k]));
+            }
+        }
+    }
+
+    size_t utf8_index::byte_offset(size_t code_point_index) const {
+        if (code_point_index > code_points)
+            throw std::out_of_range("utfcpp: code point index out of range");
+        if (code_point_index == code_points)
+            return str_view.size();
+        size_t offset = checkpoints[code_point_index / CHECKPOINT_INTERVAL].byte_offset;
+        for (size_t n = code_point_index % CHECKPOINT_INTERVAL; n > 0; --n)
+            offset += static_cast<size_t>(internal::utf8_cp_length(str_view[offset]));
+        return offset;
+    }
+
+    size_t utf8_index::utf16_offset(size_t code_point_index) const {
+        if (code_point_index > code_points)
+            throw std::out_of_range("utfcpp: code point index out of range");
+        if (code_point_index == code_points)
+            return utf16_units;
+        const checkpoint& nearest = checkpoints[code_point_index / CHECKPOINT_INTERVAL];
+        size_t offset = nearest.byte_offset;
+        size_t utf16 = nearest.utf16_offset;
+        for (size_t n = code_point_index % CHECKPOINT_INTERVAL; n > 0; --n) {
+            const auto length = internal::utf8_cp_length(str_view[offset]);
+            offset += static_cast<size_t>(length);
+            utf16 += (length == 4) ? 2 : 1;
+        }
+        return utf16;
+    }
+
+    size_t utf8_index::code_point_at_byte(size_t byte_offset) const {
+        if (byte_offset > str_view.size())
+            throw std::out_of_range("utfcpp: byte offset out of range");
+        if (byte_offset == str_view.size())
+            return code_points;
+        const auto nearest = std::upper_bound(checkpoints.begin(), checkpoints.end(), byte_offset,
+            [](size_t offset, const checkpoint& c) { return offset < c.byte_offset; }) - 1;
+        size_t code_point_index = static_cast<size_t>(nearest - checkpoints.begin()) * CHECKPOINT_INTERVAL;
+        size_t offset = nearest->byte_offset;
+        for (;;) {
+            offset += static_cast<size_t>(internal::utf8_cp_length(str_view[offset]));
+            if (offset > byte_offset)
+                return code_point_index;
+            ++code_point_index;
+        }
+    }
+
+    size_t utf8_index::code_point_at_utf16(size_t utf16_offset) const {
+        if (utf16_offset > utf16_units)
+            throw std::out_of_range("utfcpp: UTF-16 offset out of range");
+        if (utf16_offset == utf16_units)
+            return code_points;
+        const auto nearest = std::upper_bound(checkpoints.begin(), checkpoints.end(), utf16_offset,
+            [](size_t offset, const checkpoint& c) { return offset < c.utf16_offset; }) - 1;
+        size_t code_point_index = static_cast<size_t>(nearest - checkpoints.begin()) * CHECKPOINT_INTERVAL;
+        size_t offset = nearest->byte_offset;
+        size_t utf16 = nearest->utf16_offset;
+        for (;;) {
+            const auto length = internal::utf8_cp_length(str_view[offset]);
+            offset += static_cast<size_t>(length);
+            utf16 += (length == 4) ? 2 : 1;
+            if (utf16 > utf16_offset)
+                return code_point_index;
+            ++code_point_index;
+        }
+    }
+
+}  // namespace utfcpp
@@ -0,0 +1,1904 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+#include "simd.hpp"
+#include "core.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define UTFCPP_X86_64
+    // GCC 12 warns about the deliberately undefined registers inside its AVX-512 headers
+    #if defined(__GNUC__) && !defined(__clang__)
+        #pragma GCC diagnostic push
+        #pragma GCC diagnostic ignored "-Wuninitialized"
+        #pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+        #include <immintrin.h>
+        #pragma GCC diagnostic pop
+    #else
+        #include <immintrin.h>
+    #endif
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+    // GCC and Clang require the instruction set to be enabled per function;
+    // MSVC makes all the intrinsics available unconditionally.
+    #if defined(__GNUC__) || defined(__clang__)
+        #define UTFCPP_TARGET(features) __attribute__((target(features)))
+    #else
+        #define UTFCPP_TARGET(features)
+    #endif
+#endif
+
+namespace utfcpp::internal
+{
+    constexpr uint64_t ASCII_MASK_64 {0x8080808080808080u};
+
+    size_t widen_ascii_to_utf16_scalar(const char8_t* src, size_t length, char16_t* dst) {
+        size_t i{0};
+        // Check eight bytes at a time for the high bits
+        for (; i + 8 <= length; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, src + i, sizeof(word));
+            if (word & ASCII_MASK_64)
+                break;
+            for (size_t j = 0; j < 8; ++j)
+                dst[i + j] = src[i + j];
+        }
+        for (; i < length && src[i] < 0x80; ++i)
+            dst[i] = src[i];
+        return i;
+    }
+
+    size_t validate_utf8_scalar(const char8_t* src, size_t length) {
+        const std::u8string_view utf8str(src, length);
+        auto it{utf8str.begin()}, end_it{utf8str.end()};
+        conversion_status status{conversion_status::ok};
+        while (it != end_it) {
+            // Skip ASCII eight bytes at a time
+            const size_t offset = static_cast<size_t>(it - utf8str.begin());
+            if (length - offset >= 8) {
+                uint64_t word;
+                std::memcpy(&word, src + offset, sizeof(word));
+                if ((word & ASCII_MASK_64) == 0) {
+                    it += 8;
+                    continue;
+                }
+            }
+            decode_next_utf8(it, end_it, status);
+            if (status != conversion_status::ok)
+                return offset;
+        }
+        return std::u8string_view::npos;
+    }
+
+    size_t transcode_bmp_to_utf8_scalar(const char16_t* src, size_t length, char8_t*& dst, const char8_t*) {
+        size_t i{0};
+        for (; i < length; ++i) {
+            const char16_t unit = src[i];
+            if (unit < 0x80) {
+                *dst++ = static_cast<char8_t>(unit);
+            } else if (unit < 0x800) {
+                *dst++ = static_cast<char8_t>((unit >> 6)          | 0xc0);
+                *dst++ = static_cast<char8_t>((unit & 0x3f)        | 0x80);
+            } else if (!is_utf16_surrogate(unit)) {
+                *dst++ = static_cast<char8_t>((unit >> 12)         | 0xe0);
+                *dst++ = static_cast<char8_t>(((unit >> 6) & 0x3f) | 0x80);
+                *dst++ = static_cast<char8_t>((unit & 0x3f)        | 0x80);
+            } else {
+                break;
+            }
+        }
+        return i;
+    }
+
+    size_t count_utf8_code_points_scalar(const char8_t* src, size_t length) {
+        size_t code_points{0};
+        for (size_t i = 0; i < length; ++i)
+            code_points += !is_utf8_trail(src[i]);
+        return code_points;
+    }
+
+    size_t count_utf16_code_points_scalar(const char16_t* src, size_t length) {
+        size_t code_points{0};
+        for (size_t i = 0; i < length; ++i)
+            code_points += (src[i] & 0xfc00) != TRAIL_SURROGATE_MIN;
+        return code_points;
+    }
+
+    size_t widen_ascii_to_utf32_scalar(const char8_t* src, size_t length, char32_t* dst) {
+        size_t i{0};
+        for (; i < length && src[i] < 0x80; ++i)
+            dst[i] = src[i];
+        return i;
+    }
+
+    size_t widen_bmp_to_utf32_scalar(const char16_t* src, size_t length, char32_t* dst) {
+        size_t i{0};
+        for (; i < length && !is_utf16_surrogate(src[i]); ++i)
+            dst[i] = src[i];
+        return i;
+    }
+
+    size_t narrow_ascii_from_utf32_scalar(const char32_t* src, size_t length, char8_t* dst) {
+        size_t i{0};
+        for (; i < length && src[i] < 0x80; ++i)
+            dst[i] = static_cast<char8_t>(src[i]);
+        return i;
+    }
+
+    size_t narrow_bmp_from_utf32_scalar(const char32_t* src, size_t length, char16_t* dst) {
+        size_t i{0};
+        for (; i < length && src[i] < 0x10000 && !is_utf16_surrogate(src[i]); ++i)
+            dst[i] = static_cast<char16_t>(src[i]);
+        return i;
+    }
+
+    void widen_latin1_to_utf16_scalar(const char* src, size_t length, char16_t* dst) {
+        for (size_t i = 0; i < length; ++i)
+            dst[i] = static_cast<unsigned char>(src[i]);
+    }
+
+    size_t narrow_latin1_from_utf16_scalar(const char16_t* src, size_t length, char* dst) {
+        size_t i{0};
+        for (; i < length && src[i] < 0x100; ++i)
+            dst[i] = static_cast<char>(src[i]);
+        return i;
+    }
+
+    void transcode_latin1_to_utf8_scalar(const char* src, size_t length, char8_t*& dst, const char8_t*) {
+        for (size_t i = 0; i < length; ++i) {
+            const auto byte = static_cast<unsigned char>(src[i]);
+            if (byte < 0x80) {
+                *dst++ = byte;
+            } else {
+                *dst++ = static_cast<char8_t>((byte >> 6)   | 0xc0);
+                *dst++ = static_cast<char8_t>((byte & 0x3f) | 0x80);
+            }
+        }
+    }
+
+    size_t transcode_utf8_to_latin1_scalar(const char8_t* src, size_t length, char*& dst, const char*) {
+        size_t i{0};
+        while (i < length) {
+            if (src[i] < 0x80) {
+                *dst++ = static_cast<char>(src[i]);
+                i += 1;
+            } else if ((src[i] & 0xfe) == 0xc2 && i + 1 < length && is_utf8_trail(src[i + 1])) {
+                *dst++ = static_cast<char>(((src[i] & 0x1f) << 6) | (src[i + 1] & 0x3f));
+                i += 2;
+            } else {
+                break;
+            }
+        }
+        return i;
+    }
+
+    size_t utf8_length_from_latin1_scalar(const char* src, size_t length) {
+        size_t utf8_length{length};
+        for (size_t i = 0; i < length; ++i)
+            utf8_length += static_cast<unsigned char>(src[i]) >> 7;
+        return utf8_length;
+    }
+
+    // Lookup tables for the vectorized UTF-8 validation, after Keiser and Lemire,
+    // "Validating UTF-8 In Less Than One Instruction Per Byte". Each pair of adjacent
+    // bytes is classified by three nibbles: the high and low nibble of the first byte
+    // and the high nibble of the second one. The pair is invalid if the three table
+    // entries share a bit. Sequences lacking their third or fourth byte are found
+    // separately, by comparing the bytes two and three positions back against the
+    // three and four byte leads.
+    constexpr uint8_t TOO_SHORT      {1 << 0}; // 11______ 0_______, 11______ 11______
+    constexpr uint8_t TOO_LONG       {1 << 1}; // 0_______ 10______
+    constexpr uint8_t OVERLONG_3     {1 << 2}; // 11100000 100_____
+    constexpr uint8_t TOO_LARGE      {1 << 3}; // 11110100 1001____ and above
+    constexpr uint8_t SURROGATE      {1 << 4}; // 11101101 101_____
+    constexpr uint8_t OVERLONG_2     {1 << 5}; // 1100000_ 10______
+    constexpr uint8_t TOO_LARGE_1000 {1 << 6}; // 11110101 1000____ and above
+    constexpr uint8_t OVERLONG_4     {1 << 6}; // 11110000 1000____
+    constexpr uint8_t TWO_CONTS      {1 << 7}; // 10______ 10______
+    constexpr uint8_t CARRY          {TOO_SHORT | TOO_LONG | TWO_CONTS};
+
+    // Indexed by the high nibble of the first byte
+    alignas(16) constexpr uint8_t UTF8_BYTE_1_HIGH[16] {
+        // 0_______ ASCII
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        // 10______ continuation
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        // 1100____ two byte lead, possibly overlong
+        TOO_SHORT | OVERLONG_2,
+        // 1101____ two byte lead
+        TOO_SHORT,
+        // 1110____ three byte lead
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        // 1111____ four byte lead or invalid
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+    };
+
+    // Indexed by the low nibble of the first byte
+    alignas(16) constexpr uint8_t UTF8_BYTE_1_LOW[16] {
+        // ____0000
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        // ____0001
+        CARRY | OVERLONG_2,
+        // ____001_
+        CARRY,
+        CARRY,
+        // ____0100
+        CARRY | TOO_LARGE,
+        // ____0101 and above
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        // ____1101
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000
+    };
+
+    // Indexed by the high nibble of the second byte
+    alignas(16) constexpr uint8_t UTF8_BYTE_2_HIGH[16] {
+        // 0_______ ASCII
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        // 1000____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        // 1001____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        // 101_____
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE  | TOO_LARGE,
+        // 11______ lead
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+    };
+
+    // A block whose last three bytes exceed these values ends in an incomplete sequence
+    alignas(64) constexpr uint8_t UTF8_INCOMPLETE_MAX[64] {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+    };
+
+    // The table lookups of the vector kernels for one byte and the three bytes before it
+    static bool is_utf8_byte_error(uint8_t byte, uint8_t prev1, uint8_t prev2, uint8_t prev3) {
+        const uint8_t special_cases = UTF8_BYTE_1_HIGH[prev1 >> 4] & UTF8_BYTE_1_LOW[prev1 & 0x0f] &
+                                      UTF8_BYTE_2_HIGH[byte >> 4];
+        const uint8_t must_be_2_3_continuation = (prev2 >= 0xe0 || prev3 >= 0xf0) ? 0x80 : 0;
+        return special_cases != must_be_2_3_continuation;
+    }
+
+    size_t utf8_lead_masks_scalar(const char8_t* src, const char8_t* prev_block, size_t block_count,
+                                  uint64_t* lead_masks, uint64_t* four_byte_masks) {
+        size_t invalid{block_count};
+        uint8_t prev1{prev_block[63]}, prev2{prev_block[62]}, prev3{prev_block[61]};
+        for (size_t k = 0; k < block_count; ++k) {
+            uint64_t leads{0}, four_byte_leads{0};
+            bool error{false};
+            for (size_t j = 0; j < 64; ++j) {
+                const char8_t byte = src[k * 64 + j];
+                leads |= uint64_t{!is_utf8_trail(byte)} << j;
+                four_byte_leads |= uint64_t{byte >= 0xf0} << j;
+                error |= is_utf8_byte_error(byte, prev1, prev2, prev3);
+                prev3 = prev2;
+                prev2 = prev1;
+                prev1 = byte;
+            }
+            lead_masks[k] = leads;
+            four_byte_masks[k] = four_byte_leads;
+            if (error && invalid == block_count)
+                invalid = k;
+        }
+        return invalid;
+    }
+
+#ifdef UTFCPP_X86_64
+
+    static void cpuid(int leaf, int subleaf, int regs[4]) {
+#if defined(_MSC_VER)
+        __cpuidex(regs, leaf, subleaf);
+#else
+        unsigned int a, b, c, d;
+        __cpuid_count(static_cast<unsigned int>(leaf), static_cast<unsigned int>(subleaf), a, b, c, d);
+        regs[0] = static_cast<int>(a);
+        regs[1] = static_cast<int>(b);
+        regs[2] = static_cast<int>(c);
+        regs[3] = static_cast<int>(d);
+#endif
+    }
+
+    // Register state enabled by the OS (XCR0)
+    static uint64_t xgetbv() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t eax, edx;
+        __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+    }
+
+    static cpu_features query_cpu_features() {
+        cpu_features features;
+        int regs[4];
+        cpuid(0, 0, regs);
+        const int max_leaf = regs[0];
+        if (max_leaf < 7)
+            return features;
+
+        cpuid(1, 0, regs);
+        features.ssse3 = (regs[2] & (1 << 9)) != 0;
+        const bool osxsave = (regs[2] & (1 << 27)) != 0;
+        if (!osxsave)
+            return features;
+        const uint64_t xcr0 = xgetbv();
+        const bool os_avx    = (xcr0 & 0x06) == 0x06;  // XMM and YMM state
+        const bool os_avx512 = (xcr0 & 0xe6) == 0xe6;  // ... plus opmask and ZMM state
+
+        cpuid(7, 0, regs);
+        features.avx2     = os_avx && (regs[1] & (1 << 5)) != 0;
+        features.avx512bw = os_avx512 && (regs[1] & (1 << 16)) != 0  // AVX512F
+                                      && (regs[1] & (1 << 30)) != 0; // AVX512BW
+        return features;
+    }
+
+    // SSE2 is part of the x86-64 baseline, so this kernel is always available
+    static size_t widen_ascii_to_utf16_sse2(const char8_t* src, size_t length, char16_t* dst) {
+        size_t i{0};
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= length; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            if (_mm_movemask_epi8(bytes) != 0)
+                break;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),     _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(bytes, zero));
+        }
+        return i + widen_ascii_to_utf16_scalar(src + i, length - i, dst + i);
+    }
+
+    // The wider kernels finish their tails without calling into the SSE2 or scalar code:
+    // mixing VEX and legacy SSE encoded instructions stalls on the register state transition.
+    UTFCPP_TARGET("avx2")
+    static size_t widen_ascii_to_utf16_avx2(const char8_t* src, size_t length, char16_t* dst) {
+        size_t i{0};
+        for (; i + 32 <= length; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            if (_mm256_movemask_epi8(bytes) != 0)
+                break;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 16),
+                                _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1)));
+        }
+        for (; i < length && src[i] < 0x80; ++i)
+            dst[i] = src[i];
+        return i;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static size_t widen_ascii_to_utf16_avx512(const char8_t* src, size_t length, char16_t* dst) {
+        size_t i{0};
+        for (; i + 64 <= length; i += 64) {
+            const __m512i bytes = _mm512_loadu_si512(src + i);
+            if (_mm512_movepi8_mask(bytes) != 0)
+                break;
+            _mm512_storeu_si512(dst + i,      _mm512_cvtepu8_epi16(_mm512_castsi512_si256(bytes)));
+            _mm512_storeu_si512(dst + i + 32, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(bytes, 1)));
+        }
+        // Widen the ASCII prefix of the last, possibly partial, block with masked stores
+        const size_t remaining = length - i < 64 ? length - i : 64;
+        const __mmask64 load_mask = remaining == 64 ? ~__mmask64{0} : (__mmask64{1} << remaining) - 1;
+        const __m512i bytes = _mm512_maskz_loadu_epi8(load_mask, src + i);
+        const __mmask64 stop = _mm512_movepi8_mask(bytes) | ~load_mask;
+        const size_t ascii_length = static_cast<size_t>(std::countr_zero(static_cast<uint64_t>(stop)));
+        const __mmask64 store_mask = ascii_length == 64 ? ~__mmask64{0} : (__mmask64{1} << ascii_length) - 1;
+        _mm512_mask_storeu_epi16(dst + i,      static_cast<__mmask32>(store_mask),
+                                 _mm512_cvtepu8_epi16(_mm512_castsi512_si256(bytes)));
+        _mm512_mask_storeu_epi16(dst + i + 32, static_cast<__mmask32>(store_mask >> 32),
+                                 _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(bytes, 1)));
+        return i + ascii_length;
+    }
+
+    UTFCPP_TARGET("ssse3")
+    static __m128i check_utf8_block_ssse3(__m128i input, __m128i prev_input) {
+        const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+        const __m128i prev1 = _mm_alignr_epi8(input, prev_input, 16 - 1);
+        const __m128i byte_1_high = _mm_shuffle_epi8(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_1_HIGH)),
+            _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble_mask));
+        const __m128i byte_1_low = _mm_shuffle_epi8(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_1_LOW)),
+            _mm_and_si128(prev1, nibble_mask));
+        const __m128i byte_2_high = _mm_shuffle_epi8(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_2_HIGH)),
+            _mm_and_si128(_mm_srli_epi16(input, 4), nibble_mask));
+        const __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+        // Only 111_____ and 1111____ leads survive as >= 0x80 two and three bytes back
+        const __m128i prev2 = _mm_alignr_epi8(input, prev_input, 16 - 2);
+        const __m128i prev3 = _mm_alignr_epi8(input, prev_input, 16 - 3);
+        const __m128i must_be_2_3_continuation = _mm_or_si128(
+            _mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xe0 - 0x80))),
+            _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xf0 - 0x80))));
+        return _mm_xor_si128(_mm_and_si128(must_be_2_3_continuation, _mm_set1_epi8(static_cast<char>(0x80))),
+                             special_cases);
+    }
+
+    UTFCPP_TARGET("ssse3")
+    static size_t validate_utf8_ssse3(const char8_t* src, size_t length) {
+        const __m128i incomplete_max = _mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_INCOMPLETE_MAX + 48));
+        const __m128i zero = _mm_setzero_si128();
+        __m128i prev_input = zero;
+        __m128i prev_incomplete = zero;
+        alignas(16) char8_t tail[16] {};
+        // The last, zero padded, block also catches a sequence cut off by the end of input
+        for (size_t i{0}; i <= length; i += 16) {
+            __m128i input;
+            if (i + 16 <= length)
+                input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            else {
+                std::copy_n(src + i, length - i, tail);
+                input = _mm_load_si128(reinterpret_cast<const __m128i*>(tail));
+            }
+            __m128i error;
+            if (_mm_movemask_epi8(input) == 0)
+                error = prev_incomplete;
+            else {
+                error = check_utf8_block_ssse3(input, prev_input);
+                prev_incomplete = _mm_subs_epu8(input, incomplete_max);
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xffff)
+                return i;
+            prev_input = input;
+        }
+        return std::u8string_view::npos;
+    }
+
+    UTFCPP_TARGET("avx2")
+    static __m256i check_utf8_block_avx2(__m256i input, __m256i prev_input) {
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0f);
+        // The previous bytes straddle the 128-bit lanes, so bring the neighbouring lane in first
+        const __m256i prev_lanes = _mm256_permute2x128_si256(prev_input, input, 0x21);
+        const __m256i prev1 = _mm256_alignr_epi8(input, prev_lanes, 16 - 1);
+        const __m256i byte_1_high = _mm256_shuffle_epi8(
+            _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_1_HIGH))),
+            _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble_mask));
+        const __m256i byte_1_low = _mm256_shuffle_epi8(
+            _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_1_LOW))),
+            _mm256_and_si256(prev1, nibble_mask));
+        const __m256i byte_2_high = _mm256_shuffle_epi8(
+            _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_2_HIGH))),
+            _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble_mask));
+        const __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+        const __m256i prev2 = _mm256_alignr_epi8(input, prev_lanes, 16 - 2);
+        const __m256i prev3 = _mm256_alignr_epi8(input, prev_lanes, 16 - 3);
+        const __m256i must_be_2_3_continuation = _mm256_or_si256(
+            _mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80))),
+            _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80))));
+        return _mm256_xor_si256(_mm256_and_si256(must_be_2_3_continuation, _mm256_set1_epi8(static_cast<char>(0x80))),
+                                special_cases);
+    }
+
+    UTFCPP_TARGET("avx2")
+    static size_t validate_utf8_avx2(const char8_t* src, size_t length) {
+        const __m256i incomplete_max = _mm256_load_si256(reinterpret_cast<const __m256i*>(UTF8_INCOMPLETE_MAX + 32));
+        __m256i prev_input = _mm256_setzero_si256();
+        __m256i prev_incomplete = _mm256_setzero_si256();
+        alignas(32) char8_t tail[32] {};
+        for (size_t i{0}; i <= length; i += 32) {
+            __m256i input;
+            if (i + 32 <= length)
+                input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            else {
+                std::copy_n(src + i, length - i, tail);
+                input = _mm256_load_si256(reinterpret_cast<const __m256i*>(tail));
+            }
+            __m256i error;
+            if (_mm256_movemask_epi8(input) == 0)
+                error = prev_incomplete;
+            else {
+                error = check_utf8_block_avx2(input, prev_input);
+                prev_incomplete = _mm256_subs_epu8(input, incomplete_max);
+            }
+            if (!_mm256_testz_si256(error, error))
+                return i;
+            prev_input = input;
+        }
+        return std::u8string_view::npos;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static __m512i check_utf8_block_avx512(__m512i input, __m512i prev_input) {
+        const __m512i nibble_mask = _mm512_set1_epi8(0x0f);
+        // Lane i of prev_lanes is lane i - 1 of the input, lane 0 the last lane of prev_input
+        const __m512i prev_lanes = _mm512_permutex2var_epi64(
+            prev_input, _mm512_setr_epi64(6, 7, 8, 9, 10, 11, 12, 13), input);
+        const __m512i prev1 = _mm512_alignr_epi8(input, prev_lanes, 16 - 1);
+        const __m512i byte_1_high = _mm512_shuffle_epi8(
+            _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_1_HIGH))),
+            _mm512_and_si512(_mm512_srli_epi16(prev1, 4), nibble_mask));
+        const __m512i byte_1_low = _mm512_shuffle_epi8(
+            _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_1_LOW))),
+            _mm512_and_si512(prev1, nibble_mask));
+        const __m512i byte_2_high = _mm512_shuffle_epi8(
+            _mm512_broadcast_i32x4(_mm_load_si128(reinterpret_cast<const __m128i*>(UTF8_BYTE_2_HIGH))),
+            _mm512_and_si512(_mm512_srli_epi16(input, 4), nibble_mask));
+        const __m512i special_cases = _mm512_and_si512(_mm512_and_si512(byte_1_high, byte_1_low), byte_2_high);
+
+        const __m512i prev2 = _mm512_alignr_epi8(input, prev_lanes, 16 - 2);
+        const __m512i prev3 = _mm512_alignr_epi8(input, prev_lanes, 16 - 3);
+        const __m512i must_be_2_3_continuation = _mm512_or_si512(
+            _mm512_subs_epu8(prev2, _mm512_set1_epi8(static_cast<char>(0xe0 - 0x80))),
+            _mm512_subs_epu8(prev3, _mm512_set1_epi8(static_cast<char>(0xf0 - 0x80))));
+        return _mm512_xor_si512(_mm512_and_si512(must_be_2_3_continuation, _mm512_set1_epi8(static_cast<char>(0x80))),
+                                special_cases);
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static size_t validate_utf8_avx512(const char8_t* src, size_t length) {
+        const __m512i incomplete_max = _mm512_load_si512(UTF8_INCOMPLETE_MAX);
+        __m512i prev_input = _mm512_setzero_si512();
+        __m512i prev_incomplete = _mm512_setzero_si512();
+        for (size_t i{0}; i <= length; i += 64) {
+            // Masked loads zero the bytes past the end of input
+            const __mmask64 load_mask = (i + 64 <= length) ? ~__mmask64{0}
+                                                           : (__mmask64{1} << (length - i)) - 1;
+            const __m512i input = _mm512_maskz_loadu_epi8(load_mask, src + i);
+            __m512i error;
+            if (_mm512_movepi8_mask(input) == 0)
+                error = prev_incomplete;
+            else {
+                error = check_utf8_block_avx512(input, prev_input);
+                prev_incomplete = _mm512_subs_epu8(input, incomplete_max);
+            }
+            if (_mm512_test_epi8_mask(error, error) != 0)
+                return i;
+            prev_input = input;
+        }
+        return std::u8string_view::npos;
+    }
+
+    // Shuffle tables for the vectorized UTF-16 to UTF-8 conversion. The code units of a block
+    // are first expanded into fixed size lanes holding their UTF-8 bytes in order; a table
+    // entry, selected by the sequence lengths in the block, then packs the used bytes together.
+    struct utf8_pack_entry {
+        uint8_t shuffle[16];
+        uint8_t length;
+    };
+
+    // Eight code units in 16-bit lanes, each encoding to one or two bytes.
+    // Bit i of the index is set if unit i is ASCII.
+    constexpr std::array<utf8_pack_entry, 256> make_utf8_pack_1_2() {
+        std::array<utf8_pack_entry, 256> table{};
+        for (size_t index = 0; index < table.size(); ++index) {
+            uint8_t length{0};
+            for (uint8_t unit = 0; unit < 8; ++unit) {
+                table[index].shuffle[length++] = static_cast<uint8_t>(2 * unit);
+                if ((index & (size_t{1} << unit)) == 0)
+                    table[index].shuffle[length++] = static_cast<uint8_t>(2 * unit + 1);
+            }
+            for (size_t i = length; i < 16; ++i)
+                table[index].shuffle[i] = 0x80;
+            table[index].length = length;
+        }
+        return table;
+    }
+
+    // Four code units in 32-bit lanes, each encoding to one, two or three bytes. Bit i of
+    // the index is set if unit i needs two or more bytes, bit i + 4 if it needs three.
+    constexpr std::array<utf8_pack_entry, 256> make_utf8_pack_1_2_3() {
+        std::array<utf8_pack_entry, 256> table{};
+        for (size_t index = 0; index < table.size(); ++index) {
+            uint8_t length{0};
+            for (uint8_t unit = 0; unit < 4; ++unit) {
+                const size_t unit_length = 1 + ((index >> unit) & 1) + ((index >> (unit + 4)) & 1);
+                for (size_t byte = 0; byte < unit_length; ++byte)
+                    table[index].shuffle[length++] = static_cast<uint8_t>(4 * unit + byte);
+            }
+            for (size_t i = length; i < 16; ++i)
+                table[index].shuffle[i] = 0x80;
+            table[index].length = length;
+        }
+        return table;
+    }
+
+    constexpr std::array<utf8_pack_entry, 256> UTF8_PACK_1_2   {make_utf8_pack_1_2()};
+    constexpr std::array<utf8_pack_entry, 256> UTF8_PACK_1_2_3 {make_utf8_pack_1_2_3()};
+
+    // Expands eight code units below U+0800 to their one or two UTF-8 bytes in 16-bit lanes
+    // and packs them to dst, which must have room for 16 bytes
+    UTFCPP_TARGET("ssse3")
+    static char8_t* pack_utf8_1_2_ssse3(__m128i units, char8_t* dst) {
+        const __m128i lead  = _mm_or_si128(_mm_srli_epi16(units, 6), _mm_set1_epi16(0xc0));
+        const __m128i trail = _mm_or_si128(_mm_and_si128(units, _mm_set1_epi16(0x3f)), _mm_set1_epi16(0x80));
+        const __m128i two_bytes = _mm_or_si128(lead, _mm_slli_epi16(trail, 8));
+        const __m128i is_ascii = _mm_cmplt_epi16(units, _mm_set1_epi16(0x80));
+        const __m128i lanes = _mm_or_si128(_mm_and_si128(is_ascii, units), _mm_andnot_si128(is_ascii, two_bytes));
+        const int index = _mm_movemask_epi8(_mm_packs_epi16(is_ascii, _mm_setzero_si128())) & 0xff;
+        const utf8_pack_entry& entry = UTF8_PACK_1_2[static_cast<size_t>(index)];
+        const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry.shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(lanes, shuffle));
+        return dst + entry.length;
+    }
+
+    // Expands four code units outside the surrogate range, in 32-bit lanes, to their UTF-8
+    // bytes and packs them to dst, which must have room for 16 bytes
+    UTFCPP_TARGET("ssse3")
+    static char8_t* pack_utf8_1_2_3_ssse3(__m128i units, char8_t* dst) {
+        const __m128i six_bits = _mm_set1_epi32(0x3f);
+        const __m128i trail_1 = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(units, 6), six_bits), _mm_set1_epi32(0x80));
+        const __m128i trail_2 = _mm_or_si128(_mm_and_si128(units, six_bits), _mm_set1_epi32(0x80));
+        const __m128i three_bytes = _mm_or_si128(
+            _mm_or_si128(_mm_srli_epi32(units, 12), _mm_set1_epi32(0xe0)),
+            _mm_or_si128(_mm_slli_epi32(trail_1, 8), _mm_slli_epi32(trail_2, 16)));
+        const __m128i two_bytes = _mm_or_si128(
+            _mm_or_si128(_mm_srli_epi32(units, 6), _mm_set1_epi32(0xc0)), _mm_slli_epi32(trail_2, 8));
+        const __m128i needs_two = _mm_cmpgt_epi32(units, _mm_set1_epi32(0x7f));
+        const __m128i needs_three = _mm_cmpgt_epi32(units, _mm_set1_epi32(0x7ff));
+        __m128i lanes = _mm_or_si128(_mm_and_si128(needs_two, two_bytes), _mm_andnot_si128(needs_two, units));
+        lanes = _mm_or_si128(_mm_and_si128(needs_three, three_bytes), _mm_andnot_si128(needs_three, lanes));
+        const int index = _mm_movemask_ps(_mm_castsi128_ps(needs_two))
+                        | (_mm_movemask_ps(_mm_castsi128_ps(needs_three)) << 4);
+        const utf8_pack_entry& entry = UTF8_PACK_1_2_3[static_cast<size_t>(index)];
+        const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry.shuffle));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(lanes, shuffle));
+        return dst + entry.length;
+    }
+
+    UTFCPP_TARGET("ssse3")
+    static size_t transcode_bmp_to_utf8_ssse3(const char16_t* src, size_t length, char8_t*& dst, const char8_t* dst_end) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i{0};
+        // Eight units produce at most 24 bytes, written with stores of up to 16 bytes
+        for (; i + 8 <= length && dst_end - dst >= 32; i += 8) {
+            const __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i non_ascii_bits = _mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xff80)));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(non_ascii_bits, zero)) == 0xffff) {
+                // All ASCII
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(units, units));
+                dst += 8;
+                continue;
+            }
+            const __m128i surrogates = _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xf800))),
+                                                       _mm_set1_epi16(static_cast<short>(0xd800)));
+            if (_mm_movemask_epi8(surrogates) != 0)
+                break;
+            const __m128i below_800 = _mm_cmpeq_epi16(_mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xf800))), zero);
+            if (_mm_movemask_epi8(below_800) == 0xffff) {
+                dst = pack_utf8_1_2_ssse3(units, dst);
+            } else {
+                dst = pack_utf8_1_2_3_ssse3(_mm_unpacklo_epi16(units, zero), dst);
+                dst = pack_utf8_1_2_3_ssse3(_mm_unpackhi_epi16(units, zero), dst);
+            }
+        }
+        return i + transcode_bmp_to_utf8_scalar(src + i, length - i, dst, dst_end);
+    }
+
+    // Expands sixteen code units below U+0800 to their one or two UTF-8 bytes in 16-bit lanes
+    // and packs each 128-bit lane to dst, which must have room for 32 bytes
+    UTFCPP_TARGET("avx2")
+    static char8_t* pack_utf8_1_2_avx2(__m256i units, char8_t* dst) {
+        const __m256i lead  = _mm256_or_si256(_mm256_srli_epi16(units, 6), _mm256_set1_epi16(0xc0));
+        const __m256i trail = _mm256_or_si256(_mm256_and_si256(units, _mm256_set1_epi16(0x3f)),
+                                              _mm256_set1_epi16(0x80));
+        const __m256i two_bytes = _mm256_or_si256(lead, _mm256_slli_epi16(trail, 8));
+        const __m256i is_ascii = _mm256_cmpgt_epi16(_mm256_set1_epi16(0x80), units);
+        const __m256i lanes = _mm256_blendv_epi8(two_bytes, units, is_ascii);
+        const uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_packs_epi16(is_ascii, _mm256_setzero_si256())));
+        const utf8_pack_entry& entry_low = UTF8_PACK_1_2[mask & 0xff];
+        const utf8_pack_entry& entry_high = UTF8_PACK_1_2[(mask >> 16) & 0xff];
+        const __m256i shuffle = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(entry_low.shuffle))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry_high.shuffle)), 1);
+        const __m256i packed = _mm256_shuffle_epi8(lanes, shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(packed));
+        dst += entry_low.length;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_extracti128_si256(packed, 1));
+        return dst + entry_high.length;
+    }
+
+    // Expands eight code units outside the surrogate range to their UTF-8 bytes in 32-bit
+    // lanes and packs each 128-bit lane to dst, which must have room for 28 bytes
+    UTFCPP_TARGET("avx2")
+    static char8_t* pack_utf8_1_2_3_avx2(__m128i units, char8_t* dst) {
+        const __m256i wide = _mm256_cvtepu16_epi32(units);
+        const __m256i six_bits = _mm256_set1_epi32(0x3f);
+        const __m256i trail_1 = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(wide, 6), six_bits),
+                                                _mm256_set1_epi32(0x80));
+        const __m256i trail_2 = _mm256_or_si256(_mm256_and_si256(wide, six_bits), _mm256_set1_epi32(0x80));
+        const __m256i three_bytes = _mm256_or_si256(
+            _mm256_or_si256(_mm256_srli_epi32(wide, 12), _mm256_set1_epi32(0xe0)),
+            _mm256_or_si256(_mm256_slli_epi32(trail_1, 8), _mm256_slli_epi32(trail_2, 16)));
+        const __m256i two_bytes = _mm256_or_si256(
+            _mm256_or_si256(_mm256_srli_epi32(wide, 6), _mm256_set1_epi32(0xc0)), _mm256_slli_epi32(trail_2, 8));
+        const __m256i needs_two = _mm256_cmpgt_epi32(wide, _mm256_set1_epi32(0x7f));
+        const __m256i needs_three = _mm256_cmpgt_epi32(wide, _mm256_set1_epi32(0x7ff));
+        const __m256i lanes = _mm256_blendv_epi8(_mm256_blendv_epi8(wide, two_bytes, needs_two),
+                                                 three_bytes, needs_three);
+        const unsigned two = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(needs_two)));
+        const unsigned three = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(needs_three)));
+        const utf8_pack_entry& entry_low = UTF8_PACK_1_2_3[(two & 0xf) | ((three & 0xf) << 4)];
+        const utf8_pack_entry& entry_high = UTF8_PACK_1_2_3[(two >> 4) | ((three >> 4) << 4)];
+        const __m256i shuffle = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(entry_low.shuffle))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry_high.shuffle)), 1);
+        const __m256i packed = _mm256_shuffle_epi8(lanes, shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(packed));
+        dst += entry_low.length;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_extracti128_si256(packed, 1));
+        return dst + entry_high.length;
+    }
+
+    UTFCPP_TARGET("avx2")
+    static size_t transcode_bmp_to_utf8_avx2(const char16_t* src, size_t length, char8_t*& dst, const char8_t* dst_end) {
+        size_t i{0};
+        // Sixteen units produce at most 48 bytes, written with stores of up to 16 bytes
+        for (; i + 16 <= length && dst_end - dst >= 64; i += 16) {
+            const __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m128i low = _mm256_castsi256_si128(units);
+            const __m128i high = _mm256_extracti128_si256(units, 1);
+            if (_mm256_testz_si256(units, _mm256_set1_epi16(static_cast<short>(0xff80)))) {
+                // All ASCII
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(low, high));
+                dst += 16;
+                continue;
+            }
+            const __m256i top_bits = _mm256_and_si256(units, _mm256_set1_epi16(static_cast<short>(0xf800)));
+            const __m256i surrogates = _mm256_cmpeq_epi16(top_bits, _mm256_set1_epi16(static_cast<short>(0xd800)));
+            if (!_mm256_testz_si256(surrogates, surrogates))
+                break;
+            if (_mm256_testz_si256(top_bits, top_bits)) {
+                // All below U+0800: one or two bytes per unit
+                dst = pack_utf8_1_2_avx2(units, dst);
+                continue;
+            }
+            // Up to three bytes per unit: widen to 32-bit lanes, pack four units at a time
+            dst = pack_utf8_1_2_3_avx2(low, dst);
+            dst = pack_utf8_1_2_3_avx2(high, dst);
+        }
+        // Finish without calling into code compiled for SSE only, see widen_ascii_to_utf16_avx2
+        for (; i < length; ++i) {
+            const char16_t unit = src[i];
+            if (unit < 0x80) {
+                *dst++ = static_cast<char8_t>(unit);
+            } else if (unit < 0x800) {
+                *dst++ = static_cast<char8_t>((unit >> 6)          | 0xc0);
+                *dst++ = static_cast<char8_t>((unit & 0x3f)        | 0x80);
+            } else if (!is_utf16_surrogate(unit)) {
+                *dst++ = static_cast<char8_t>((unit >> 12)         | 0xe0);
+                *dst++ = static_cast<char8_t>(((unit >> 6) & 0x3f) | 0x80);
+                *dst++ = static_cast<char8_t>((unit & 0x3f)        | 0x80);
+            } else {
+                break;
+            }
+        }
+        return i;
+    }
+
+    // Counting kernels. Each block is classified with compares whose masks are popcounted:
+    // UTF-8 trail bytes are 0x80 - 0xbf, i.e. the signed bytes below -64, and four byte leads
+    // add a second UTF-16 unit. A UTF-16 unit needs three UTF-8 bytes, one less if it is
+    // below U+0800, below U+0080 or a surrogate (two surrogates make four bytes).
+    UTFCPP_TARGET("avx2,popcnt")
+    static size_t count_utf8_code_points_avx2(const char8_t* src, size_t length) {
+        const __m256i trail_limit = _mm256_set1_epi8(-64);
+        size_t trails{0};
+        size_t i{0};
+        for (; i + 32 <= length; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            trails += static_cast<size_t>(std::popcount(static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpgt_epi8(trail_limit, bytes)))));
+        }
+        for (; i < length; ++i)
+            trails += is_utf8_trail(src[i]);
+        return length - trails;
+    }
+
+    UTFCPP_TARGET("avx2,popcnt")
+    static size_t utf16_length_from_utf8_avx2(const char8_t* src, size_t length) {
+        const __m256i trail_limit = _mm256_set1_epi8(-64);
+        const __m256i four_byte_lead = _mm256_set1_epi8(static_cast<char>(0xf0));
+        size_t trails{0}, four_byte_leads{0};
+        size_t i{0};
+        for (; i + 32 <= length; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            trails += static_cast<size_t>(std::popcount(static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpgt_epi8(trail_limit, bytes)))));
+            four_byte_leads += static_cast<size_t>(std::popcount(static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(bytes, four_byte_lead), bytes)))));
+        }
+        for (; i < length; ++i) {
+            trails += is_utf8_trail(src[i]);
+            four_byte_leads += src[i] >= 0xf0;
+        }
+        return length - trails + four_byte_leads;
+    }
+
+    UTFCPP_TARGET("avx2,popcnt")
+    static size_t count_utf16_code_points_avx2(const char16_t* src, size_t length) {
+        size_t trails{0};
+        size_t i{0};
+        for (; i + 16 <= length; i += 16) {
+            const __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i trail_surrogates = _mm256_cmpeq_epi16(
+                _mm256_and_si256(units, _mm256_set1_epi16(static_cast<short>(0xfc00))),
+                _mm256_set1_epi16(static_cast<short>(TRAIL_SURROGATE_MIN)));
+            // The movemask has two bits per code unit
+            trails += static_cast<size_t>(std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(trail_surrogates)))) / 2;
+        }
+        for (; i < length; ++i)
+            trails += (src[i] & 0xfc00) == TRAIL_SURROGATE_MIN;
+        return length - trails;
+    }
+
+    UTFCPP_TARGET("avx2,popcnt")
+    static size_t utf8_length_from_utf16_avx2(const char16_t* src, size_t length) {
+        const __m256i zero = _mm256_setzero_si256();
+        size_t shorter{0};
+        size_t i{0};
+        for (; i + 16 <= length; i += 16) {
+            const __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i top_bits = _mm256_and_si256(units, _mm256_set1_epi16(static_cast<short>(0xf800)));
+            const __m256i below_80 = _mm256_cmpeq_epi16(
+                _mm256_and_si256(units, _mm256_set1_epi16(static_cast<short>(0xff80))), zero);
+            const __m256i below_800 = _mm256_cmpeq_epi16(top_bits, zero);
+            const __m256i surrogates = _mm256_cmpeq_epi16(top_bits, _mm256_set1_epi16(static_cast<short>(0xd800)));
+            shorter += static_cast<size_t>(std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(below_80)))
+                                         + std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(below_800)))
+                                         + std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(surrogates)))) / 2;
+        }
+        for (; i < length; ++i)
+            shorter += (src[i] < 0x80) + (src[i] < 0x800) + is_utf16_surrogate(src[i]);
+        return 3 * length - shorter;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw,popcnt")
+    static size_t count_utf8_code_points_avx512(const char8_t* src, size_t length) {
+        const __m512i trail_limit = _mm512_set1_epi8(-64);
+        size_t trails{0};
+        for (size_t i{0}; i < length; i += 64) {
+            const __mmask64 load_mask = (i + 64 <= length) ? ~__mmask64{0} : (__mmask64{1} << (length - i)) - 1;
+            const __m512i bytes = _mm512_maskz_loadu_epi8(load_mask, src + i);
+            trails += static_cast<size_t>(std::popcount(static_cast<uint64_t>(
+                _mm512_cmplt_epi8_mask(bytes, trail_limit))));
+        }
+        return length - trails;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw,popcnt")
+    static size_t utf16_length_from_utf8_avx512(const char8_t* src, size_t length) {
+        const __m512i trail_limit = _mm512_set1_epi8(-64);
+        const __m512i four_byte_lead = _mm512_set1_epi8(static_cast<char>(0xf0));
+        size_t trails{0}, four_byte_leads{0};
+        for (size_t i{0}; i < length; i += 64) {
+            // Masked loads zero the bytes past the end of input, which count as neither
+            const __mmask64 load_mask = (i + 64 <= length) ? ~__mmask64{0} : (__mmask64{1} << (length - i)) - 1;
+            const __m512i bytes = _mm512_maskz_loadu_epi8(load_mask, src + i);
+            trails += static_cast<size_t>(std::popcount(static_cast<uint64_t>(
+                _mm512_cmplt_epi8_mask(bytes, trail_limit))));
+            four_byte_leads += static_cast<size_t>(std::popcount(static_cast<uint64_t>(
+                _mm512_cmpge_epu8_mask(bytes, four_byte_lead))));
+        }
+        return length - trails + four_byte_leads;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw,popcnt")
+    static size_t count_utf16_code_points_avx512(const char16_t* src, size_t length) {
+        size_t trails{0};
+        for (size_t i{0}; i < length; i += 32) {
+            const __mmask32 load_mask = (i + 32 <= length) ? ~__mmask32{0} : (__mmask32{1} << (length - i)) - 1;
+            const __m512i units = _mm512_maskz_loadu_epi16(load_mask, src + i);
+            trails += static_cast<size_t>(std::popcount(static_cast<uint32_t>(_mm512_cmpeq_epi16_mask(
+                _mm512_and_si512(units, _mm512_set1_epi16(static_cast<short>(0xfc00))),
+                _mm512_set1_epi16(static_cast<short>(TRAIL_SURROGATE_MIN))))));
+        }
+        return length - trails;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw,popcnt")
+    static size_t utf8_length_from_utf16_avx512(const char16_t* src, size_t length) {
+        size_t shorter{0};
+        for (size_t i{0}; i < length; i += 32) {
+            const __mmask32 load_mask = (i + 32 <= length) ? ~__mmask32{0} : (__mmask32{1} << (length - i)) - 1;
+            const __m512i units = _mm512_maskz_loadu_epi16(load_mask, src + i);
+            const __m512i top_bits = _mm512_and_si512(units, _mm512_set1_epi16(static_cast<short>(0xf800)));
+            const __mmask32 below_80 = _mm512_mask_cmplt_epu16_mask(load_mask, units, _mm512_set1_epi16(0x80));
+            const __mmask32 below_800 = _mm512_mask_cmplt_epu16_mask(load_mask, units, _mm512_set1_epi16(0x800));
+            const __mmask32 surrogates = _mm512_cmpeq_epi16_mask(top_bits, _mm512_set1_epi16(static_cast<short>(0xd800)));
+            shorter += static_cast<size_t>(std::popcount(static_cast<uint32_t>(below_80))
+                                         + std::popcount(static_cast<uint32_t>(below_800))
+                                         + std::popcount(static_cast<uint32_t>(surrogates)));
+        }
+        return 3 * length - shorter;
+    }
+
+    // UTF-32 kernels. A block is converted only if all of it belongs to the run; the AVX2 kernels
+    // finish the last block one element at a time and the AVX-512 ones with masked stores.
+    UTFCPP_TARGET("avx2")
+    static size_t widen_ascii_to_utf32_avx2(const char8_t* src, size_t length, char32_t* dst) {
+        size_t i{0};
+        for (; i + 16 <= length; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            if (_mm_movemask_epi8(bytes) != 0)
+                break;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepu8_epi32(bytes));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8),
+                                _mm256_cvtepu8_epi32(_mm_srli_si128(bytes, 8)));
+        }
+        for (; i < length && src[i] < 0x80; ++i)
+            dst[i] = src[i];
+        return i;
+    }
+
+    UTFCPP_TARGET("avx2")
+    static size_t widen_bmp_to_utf32_avx2(const char16_t* src, size_t length, char32_t* dst) {
+        const __m256i surrogate_bits = _mm256_set1_epi16(static_cast<short>(0xf800));
+        const __m256i surrogate_min = _mm256_set1_epi16(static_cast<short>(0xd800));
+        size_t i{0};
+        for (; i + 16 <= length; i += 16) {
+            const __m256i units = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(units, surrogate_bits), surrogate_min)) != 0)
+                break;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtepu16_epi32(_mm256_castsi256_si128(units)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 8),
+                                _mm256_cvtepu16_epi32(_mm256_extracti128_si256(units, 1)));
+        }
+        for (; i < length && !is_utf16_surrogate(src[i]); ++i)
+            dst[i] = src[i];
+        return i;
+    }
+
+    UTFCPP_TARGET("avx2")
+    static size_t narrow_ascii_from_utf32_avx2(const char32_t* src, size_t length, char8_t* dst) {
+        const __m256i non_ascii_bits = _mm256_set1_epi32(static_cast<int>(0xffffff80));
+        size_t i{0};
+        for (; i + 16 <= length; i += 16) {
+            const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+            if (!_mm256_testz_si256(_mm256_or_si256(low, high), non_ascii_bits))
+                break;
+            // Packing works within 128-bit lanes, so restore the order of the 64-bit quarters
+            const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xd8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                             _mm_packus_epi16(_mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1)));
+        }
+        for (; i < length && src[i] < 0x80; ++i)
+            dst[i] = static_cast<char8_t>(src[i]);
+        return i;
+    }
+
+    UTFCPP_TARGET("avx2")
+    static size_t narrow_bmp_from_utf32_avx2(const char32_t* src, size_t length, char16_t* dst) {
+        const __m256i non_bmp_bits = _mm256_set1_epi32(static_cast<int>(0xffff0000));
+        const __m256i surrogate_bits = _mm256_set1_epi32(0xf800);
+        const __m256i surrogate_min = _mm256_set1_epi32(0xd800);
+        size_t i{0};
+        for (; i + 16 <= length; i += 16) {
+            const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 8));
+            const __m256i surrogates = _mm256_or_si256(
+                _mm256_cmpeq_epi32(_mm256_and_si256(low, surrogate_bits), surrogate_min),
+                _mm256_cmpeq_epi32(_mm256_and_si256(high, surrogate_bits), surrogate_min));
+            if (!_mm256_testz_si256(_mm256_or_si256(low, high), non_bmp_bits) || _mm256_movemask_epi8(surrogates) != 0)
+                break;
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                _mm256_permute4x64_epi64(_mm256_packus_epi32(low, high), 0xd8));
+        }
+        for (; i < length && src[i] < 0x10000 && !is_utf16_surrogate(src[i]); ++i)
+            dst[i] = static_cast<char16_t>(src[i]);
+        return i;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static size_t widen_ascii_to_utf32_avx512(const char8_t* src, size_t length, char32_t* dst) {
+        for (size_t i{0}; i < length; i += 16) {
+            const size_t remaining = length - i < 16 ? length - i : 16;
+            const uint32_t load_mask = (uint32_t{1} << remaining) - 1;
+            const __m512i bytes = _mm512_maskz_loadu_epi8(load_mask, src + i);
+            const uint32_t stop = static_cast<uint32_t>(_mm512_movepi8_mask(bytes)) | ~load_mask;
+            const size_t ascii_length = static_cast<size_t>(std::countr_zero(stop));
+            _mm512_mask_storeu_epi32(dst + i, static_cast<__mmask16>((uint32_t{1} << ascii_length) - 1),
+                                     _mm512_cvtepu8_epi32(_mm512_castsi512_si128(bytes)));
+            if (ascii_length < 16)
+                return i + ascii_length;
+        }
+        return length;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static size_t widen_bmp_to_utf32_avx512(const char16_t* src, size_t length, char32_t* dst) {
+        const __m512i surrogate_bits = _mm512_set1_epi16(static_cast<short>(0xf800));
+        const __m512i surrogate_min = _mm512_set1_epi16(static_cast<short>(0xd800));
+        for (size_t i{0}; i < length; i += 32) {
+            const size_t remaining = length - i < 32 ? length - i : 32;
+            const __mmask32 load_mask = remaining == 32 ? ~__mmask32{0} : (__mmask32{1} << remaining) - 1;
+            const __m512i units = _mm512_maskz_loadu_epi16(load_mask, src + i);
+            const __mmask32 stop = _mm512_cmpeq_epi16_mask(_mm512_and_si512(units, surrogate_bits), surrogate_min)
+                                 | ~load_mask;
+            const size_t bmp_length = static_cast<size_t>(std::countr_zero(static_cast<uint64_t>(stop) | (uint64_t{1} << 32)));
+            const uint32_t store_mask = bmp_length == 32 ? ~uint32_t{0} : (uint32_t{1} << bmp_length) - 1;
+            _mm512_mask_storeu_epi32(dst + i,      static_cast<__mmask16>(store_mask),
+                                     _mm512_cvtepu16_epi32(_mm512_castsi512_si256(units)));
+            _mm512_mask_storeu_epi32(dst + i + 16, static_cast<__mmask16>(store_mask >> 16),
+                                     _mm512_cvtepu16_epi32(_mm512_extracti64x4_epi64(units, 1)));
+            if (bmp_length < 32)
+                return i + bmp_length;
+        }
+        return length;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static size_t narrow_ascii_from_utf32_avx512(const char32_t* src, size_t length, char8_t* dst) {
+        const __m512i non_ascii_bits = _mm512_set1_epi32(static_cast<int>(0xffffff80));
+        for (size_t i{0}; i < length; i += 16) {
+            const size_t remaining = length - i < 16 ? length - i : 16;
+            const __mmask16 load_mask = static_cast<__mmask16>((uint32_t{1} << remaining) - 1);
+            const __m512i code_points = _mm512_maskz_loadu_epi32(load_mask, src + i);
+            const uint32_t stop = static_cast<uint32_t>(_mm512_test_epi32_mask(code_points, non_ascii_bits))
+                                | ~uint32_t{load_mask};
+            const size_t ascii_length = static_cast<size_t>(std::countr_zero(stop));
+            _mm512_mask_cvtepi32_storeu_epi8(dst + i, static_cast<__mmask16>((uint32_t{1} << ascii_length) - 1),
+                                             code_points);
+            if (ascii_length < 16)
+                return i + ascii_length;
+        }
+        return length;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static size_t narrow_bmp_from_utf32_avx512(const char32_t* src, size_t length, char16_t* dst) {
+        const __m512i non_bmp_bits = _mm512_set1_epi32(static_cast<int>(0xffff0000));
+        const __m512i surrogate_bits = _mm512_set1_epi32(0xf800);
+        const __m512i surrogate_min = _mm512_set1_epi32(0xd800);
+        for (size_t i{0}; i < length; i += 16) {
+            const size_t remaining = length - i < 16 ? length - i : 16;
+            const __mmask16 load_mask = static_cast<__mmask16>((uint32_t{1} << remaining) - 1);
+            const __m512i code_points = _mm512_maskz_loadu_epi32(load_mask, src + i);
+            const uint32_t stop = static_cast<uint32_t>(_mm512_test_epi32_mask(code_points, non_bmp_bits)
+                                | _mm512_cmpeq_epi32_mask(_mm512_and_si512(code_points, surrogate_bits), surrogate_min))
+                                | ~uint32_t{load_mask};
+            const size_t bmp_length = static_cast<size_t>(std::countr_zero(stop));
+            _mm512_mask_cvtepi32_storeu_epi16(dst + i, static_cast<__mmask16>((uint32_t{1} << bmp_length) - 1),
+                                              code_points);
+            if (bmp_length < 16)
+                return i + bmp_length;
+        }
+        return length;
+    }
+
+    // The lead mask kernels validate the blocks they classify with the checks of the validation
+    // kernels, carrying the previous bytes from block to block
+    UTFCPP_TARGET("ssse3")
+    static size_t utf8_lead_masks_ssse3(const char8_t* src, const char8_t* prev_block, size_t block_count,
+                                        uint64_t* lead_masks, uint64_t* four_byte_masks) {
+        const __m128i trail_limit = _mm_set1_epi8(-64);
+        const __m128i four_byte_lead = _mm_set1_epi8(static_cast<char>(0xf0));
+        const __m128i zero = _mm_setzero_si128();
+        size_t invalid{block_count};
+        __m128i prev_input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev_block + 48));
+        for (size_t k = 0; k < block_count; ++k) {
+            uint64_t leads{0}, four_byte_leads{0};
+            __m128i error = zero;
+            for (unsigned part = 0; part < 4; ++part) {
+                const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + k * 64 + part * 16));
+                error = _mm_or_si128(error, check_utf8_block_ssse3(input, prev_input));
+                prev_input = input;
+                const uint64_t trails = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(trail_limit, input)));
+                leads |= (~trails & 0xffff) << (part * 16);
+                const uint64_t four = static_cast<uint16_t>(
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(input, four_byte_lead), input)));
+                four_byte_leads |= four << (part * 16);
+            }
+            lead_masks[k] = leads;
+            four_byte_masks[k] = four_byte_leads;
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) != 0xffff && invalid == block_count)
+                invalid = k;
+        }
+        return invalid;
+    }
+
+    UTFCPP_TARGET("avx2,popcnt")
+    static size_t utf8_lead_masks_avx2(const char8_t* src, const char8_t* prev_block, size_t block_count,
+                                       uint64_t* lead_masks, uint64_t* four_byte_masks) {
+        const __m256i trail_limit = _mm256_set1_epi8(-64);
+        const __m256i four_byte_lead = _mm256_set1_epi8(static_cast<char>(0xf0));
+        size_t invalid{block_count};
+        __m256i prev_input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prev_block + 32));
+        for (size_t k = 0; k < block_count; ++k) {
+            const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k * 64));
+            const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k * 64 + 32));
+            const __m256i error = _mm256_or_si256(check_utf8_block_avx2(low, prev_input),
+                                                  check_utf8_block_avx2(high, low));
+            prev_input = high;
+            const uint64_t low_trails = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(trail_limit, low)));
+            const uint64_t high_trails = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(trail_limit, high)));
+            lead_masks[k] = ~(low_trails | (high_trails << 32));
+            const uint64_t low_four = static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(low, four_byte_lead), low)));
+            const uint64_t high_four = static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(high, four_byte_lead), high)));
+            four_byte_masks[k] = low_four | (high_four << 32);
+            if (!_mm256_testz_si256(error, error) && invalid == block_count)
+                invalid = k;
+        }
+        return invalid;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw,popcnt")
+    static size_t utf8_lead_masks_avx512(const char8_t* src, const char8_t* prev_block, size_t block_count,
+                                         uint64_t* lead_masks, uint64_t* four_byte_masks) {
+        const __m512i trail_limit = _mm512_set1_epi8(-64);
+        const __m512i four_byte_lead = _mm512_set1_epi8(static_cast<char>(0xf0));
+        size_t invalid{block_count};
+        __m512i prev_input = _mm512_loadu_si512(prev_block);
+        for (size_t k = 0; k < block_count; ++k) {
+            const __m512i bytes = _mm512_loadu_si512(src + k * 64);
+            const __m512i error = check_utf8_block_avx512(bytes, prev_input);
+            prev_input = bytes;
+            lead_masks[k] = _mm512_cmpge_epi8_mask(bytes, trail_limit);
+            four_byte_masks[k] = _mm512_cmpge_epu8_mask(bytes, four_byte_lead);
+            if (_mm512_test_epi8_mask(error, error) != 0 && invalid == block_count)
+                invalid = k;
+        }
+        return invalid;
+    }
+
+    // Latin-1 kernels. Widening and narrowing between bytes and 16-bit units is a zero
+    // extension and a saturating pack; the pack needs all the units below 0x100.
+    static void widen_latin1_to_utf16_sse2(const char* src, size_t length, char16_t* dst) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i{0};
+        for (; i + 16 <= length; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),     _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 8), _mm_unpackhi_epi8(bytes, zero));
+        }
+        widen_latin1_to_utf16_scalar(src + i, length - i, dst + i);
+    }
+
+    UTFCPP_TARGET("avx2")
+    static void widen_latin1_to_utf16_avx2(const char* src, size_t length, char16_t* dst) {
+        size_t i{0};
+        for (; i + 32 <= length; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                _mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes)));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 16),
+                                _mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1)));
+        }
+        for (; i < length; ++i)
+            dst[i] = static_cast<unsigned char>(src[i]);
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static void widen_latin1_to_utf16_avx512(const char* src, size_t length, char16_t* dst) {
+        size_t i{0};
+        for (; i + 64 <= length; i += 64) {
+            const __m512i bytes = _mm512_loadu_si512(src + i);
+            _mm512_storeu_si512(dst + i,      _mm512_cvtepu8_epi16(_mm512_castsi512_si256(bytes)));
+            _mm512_storeu_si512(dst + i + 32, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(bytes, 1)));
+        }
+        const __mmask64 mask = (__mmask64{1} << (length - i)) - 1;
+        const __m512i bytes = _mm512_maskz_loadu_epi8(mask, src + i);
+        _mm512_mask_storeu_epi16(dst + i,      static_cast<__mmask32>(mask),
+                                 _mm512_cvtepu8_epi16(_mm512_castsi512_si256(bytes)));
+        _mm512_mask_storeu_epi16(dst + i + 32, static_cast<__mmask32>(mask >> 32),
+                                 _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(bytes, 1)));
+    }
+
+    static size_t narrow_latin1_from_utf16_sse2(const char16_t* src, size_t length, char* dst) {
+        const __m128i high_bits = _mm_set1_epi16(static_cast<short>(0xff00));
+        const __m128i zero = _mm_setzero_si128();
+        size_t i{0};
+        for (; i + 16 <= length; i += 16) {
+            const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 8));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(_mm_or_si128(low, high), high_bits), zero)) != 0xffff)
+                break;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(low, high));
+        }
+        return i + narrow_latin1_from_utf16_scalar(src + i, length - i, dst + i);
+    }
+
+    UTFCPP_TARGET("avx2")
+    static size_t narrow_latin1_from_utf16_avx2(const char16_t* src, size_t length, char* dst) {
+        const __m256i high_bits = _mm256_set1_epi16(static_cast<short>(0xff00));
+        size_t i{0};
+        for (; i + 32 <= length; i += 32) {
+            const __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 16));
+            if (!_mm256_testz_si256(_mm256_or_si256(low, high), high_bits))
+                break;
+            // Packing works within 128-bit lanes, so restore the order of the 64-bit quarters
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                                _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xd8));
+        }
+        for (; i < length && src[i] < 0x100; ++i)
+            dst[i] = static_cast<char>(src[i]);
+        return i;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw")
+    static size_t narrow_latin1_from_utf16_avx512(const char16_t* src, size_t length, char* dst) {
+        const __m512i high_bits = _mm512_set1_epi16(static_cast<short>(0xff00));
+        for (size_t i{0}; i < length; i += 32) {
+            const size_t remaining = length - i < 32 ? length - i : 32;
+            const __mmask32 load_mask = remaining == 32 ? ~__mmask32{0} : (__mmask32{1} << remaining) - 1;
+            const __m512i units = _mm512_maskz_loadu_epi16(load_mask, src + i);
+            const __mmask32 stop = _mm512_test_epi16_mask(units, high_bits) | ~load_mask;
+            const size_t latin1_length = static_cast<size_t>(std::countr_zero(static_cast<uint64_t>(stop) | (uint64_t{1} << 32)));
+            const uint32_t store_mask = latin1_length == 32 ? ~uint32_t{0} : (uint32_t{1} << latin1_length) - 1;
+            _mm512_mask_cvtepi16_storeu_epi8(dst + i, store_mask, units);
+            if (latin1_length < 32)
+                return i + latin1_length;
+        }
+        return length;
+    }
+
+    // Latin-1 to UTF-8: the bytes are widened to 16-bit units and packed like UTF-16 below U+0800
+    UTFCPP_TARGET("ssse3")
+    static void transcode_latin1_to_utf8_ssse3(const char* src, size_t length, char8_t*& dst, const char8_t* dst_end) {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i{0};
+        // Sixteen bytes produce at most 32 bytes, written with stores of 16 bytes
+        for (; i + 16 <= length && dst_end - dst >= 32; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            if (_mm_movemask_epi8(bytes) == 0) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), bytes);
+                dst += 16;
+                continue;
+            }
+            dst = pack_utf8_1_2_ssse3(_mm_unpacklo_epi8(bytes, zero), dst);
+            dst = pack_utf8_1_2_ssse3(_mm_unpackhi_epi8(bytes, zero), dst);
+        }
+        transcode_latin1_to_utf8_scalar(src + i, length - i, dst, dst_end);
+    }
+
+    UTFCPP_TARGET("avx2")
+    static void transcode_latin1_to_utf8_avx2(const char* src, size_t length, char8_t*& dst, const char8_t* dst_end) {
+        size_t i{0};
+        // Thirty-two bytes produce at most 64 bytes, written with stores of up to 32 bytes
+        for (; i + 32 <= length && dst_end - dst >= 64; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            if (_mm256_movemask_epi8(bytes) == 0) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), bytes);
+                dst += 32;
+                continue;
+            }
+            dst = pack_utf8_1_2_avx2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(bytes)), dst);
+            dst = pack_utf8_1_2_avx2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(bytes, 1)), dst);
+        }
+        for (; i < length; ++i) {
+            const auto byte = static_cast<unsigned char>(src[i]);
+            if (byte < 0x80) {
+                *dst++ = byte;
+            } else {
+                *dst++ = static_cast<char8_t>((byte >> 6)   | 0xc0);
+                *dst++ = static_cast<char8_t>((byte & 0x3f) | 0x80);
+            }
+        }
+    }
+
+    // Packs the bytes of eight 8-byte groups selected by a mask
+    constexpr std::array<utf8_pack_entry, 256> make_latin1_pack() {
+        std::array<utf8_pack_entry, 256> table{};
+        for (size_t index = 0; index < table.size(); ++index) {
+            uint8_t length{0};
+            for (uint8_t byte = 0; byte < 8; ++byte) {
+                if ((index >> byte) & 1)
+                    table[index].shuffle[length++] = byte;
+            }
+            for (size_t i = length; i < 16; ++i)
+                table[index].shuffle[i] = 0x80;
+            table[index].length = length;
+        }
+        return table;
+    }
+
+    constexpr std::array<utf8_pack_entry, 256> LATIN1_PACK {make_latin1_pack()};
+
+    // UTF-8 to Latin-1. A block converts if its non-ASCII bytes are 0xc2 and 0xc3 leads, each
+    // followed by a trail; a lead in the last byte is left for the next block. The code point
+    // replaces the lead and the trails are packed out, eight bytes at a time.
+    UTFCPP_TARGET("ssse3")
+    static char* pack_latin1_ssse3(__m128i values, uint32_t keep, char* dst) {
+        const utf8_pack_entry& entry_low = LATIN1_PACK[keep & 0xff];
+        const utf8_pack_entry& entry_high = LATIN1_PACK[(keep >> 8) & 0xff];
+        const __m128i shuffle_high = _mm_add_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(entry_high.shuffle)),
+                                                  _mm_set1_epi8(8));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst),
+                         _mm_shuffle_epi8(values, _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry_low.shuffle))));
+        dst += entry_low.length;
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(values, shuffle_high));
+        return dst + entry_high.length;
+    }
+
+    UTFCPP_TARGET("ssse3")
+    static size_t transcode_utf8_to_latin1_ssse3(const char8_t* src, size_t length, char*& dst, const char* dst_end) {
+        const __m128i lead_bits = _mm_set1_epi8(static_cast<char>(0xfe));
+        const __m128i lead_min = _mm_set1_epi8(static_cast<char>(0xc2));
+        const __m128i trail_limit = _mm_set1_epi8(-64);
+        size_t i{0};
+        // Sixteen bytes produce at most 16 bytes, written with stores of 8 bytes
+        while (i + 16 <= length && dst_end - dst >= 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const auto non_ascii = static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+            if (non_ascii == 0) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), bytes);
+                dst += 16;
+                i += 16;
+                continue;
+            }
+            const __m128i is_lead = _mm_cmpeq_epi8(_mm_and_si128(bytes, lead_bits), lead_min);
+            const auto leads = static_cast<uint32_t>(_mm_movemask_epi8(is_lead));
+            const auto trails = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(trail_limit, bytes)));
+            if ((non_ascii & ~(leads | trails)) != 0 || trails != ((leads << 1) & 0xffff))
+                break;
+            // 110000ab 10cdefgh -> abcdefgh; bit b is the low bit of the lead and a is always set
+            const __m128i code_points = _mm_or_si128(
+                _mm_or_si128(_mm_and_si128(_mm_srli_si128(bytes, 1), _mm_set1_epi8(0x3f)), _mm_set1_epi8(static_cast<char>(0x80))),
+                _mm_slli_epi16(_mm_and_si128(bytes, _mm_set1_epi8(1)), 6));
+            const __m128i values = _mm_or_si128(_mm_and_si128(is_lead, code_points), _mm_andnot_si128(is_lead, bytes));
+            const size_t block_length = (leads & 0x8000) ? 15 : 16;
+            dst = pack_latin1_ssse3(values, ~trails & ((1u << block_length) - 1), dst);
+            i += block_length;
+        }
+        return i + transcode_utf8_to_latin1_scalar(src + i, length - i, dst, dst_end);
+    }
+
+    UTFCPP_TARGET("avx2")
+    static size_t transcode_utf8_to_latin1_avx2(const char8_t* src, size_t length, char*& dst, const char* dst_end) {
+        const __m256i lead_bits = _mm256_set1_epi8(static_cast<char>(0xfe));
+        const __m256i lead_min = _mm256_set1_epi8(static_cast<char>(0xc2));
+        const __m256i trail_limit = _mm256_set1_epi8(-64);
+        size_t i{0};
+        // The byte after each block is loaded with the block shifted by one
+        while (i + 33 <= length && dst_end - dst >= 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            const auto non_ascii = static_cast<uint32_t>(_mm256_movemask_epi8(bytes));
+            if (non_ascii == 0) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), bytes);
+                dst += 32;
+                i += 32;
+                continue;
+            }
+            const __m256i is_lead = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, lead_bits), lead_min);
+            const auto leads = static_cast<uint32_t>(_mm256_movemask_epi8(is_lead));
+            const auto trails = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(trail_limit, bytes)));
+            if ((non_ascii & ~(leads | trails)) != 0 || trails != (leads << 1))
+                break;
+            const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 1));
+            const __m256i code_points = _mm256_or_si256(
+                _mm256_or_si256(_mm256_and_si256(next, _mm256_set1_epi8(0x3f)), _mm256_set1_epi8(static_cast<char>(0x80))),
+                _mm256_slli_epi16(_mm256_and_si256(bytes, _mm256_set1_epi8(1)), 6));
+            const __m256i values = _mm256_blendv_epi8(bytes, code_points, is_lead);
+            const size_t block_length = (leads & 0x80000000u) ? 31 : 32;
+            const uint32_t keep = ~trails & (block_length == 32 ? ~0u : 0x7fffffffu);
+            const __m128i low = _mm256_castsi256_si128(values);
+            const __m128i high = _mm256_extracti128_si256(values, 1);
+            const __m128i eight = _mm_set1_epi8(8);
+            for (unsigned group = 0; group < 4; ++group) {
+                const utf8_pack_entry& entry = LATIN1_PACK[(keep >> (8 * group)) & 0xff];
+                __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry.shuffle));
+                if (group % 2 != 0)
+                    shuffle = _mm_add_epi8(shuffle, eight);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(group < 2 ? low : high, shuffle));
+                dst += entry.length;
+            }
+            i += block_length;
+        }
+        for (; i < length; ) {
+            if (src[i] < 0x80) {
+                *dst++ = static_cast<char>(src[i]);
+                i += 1;
+            } else if ((src[i] & 0xfe) == 0xc2 && i + 1 < length && is_utf8_trail(src[i + 1])) {
+                *dst++ = static_cast<char>(((src[i] & 0x1f) << 6) | (src[i + 1] & 0x3f));
+                i += 2;
+            } else {
+                break;
+            }
+        }
+        return i;
+    }
+
+    UTFCPP_TARGET("avx2,popcnt")
+    static size_t utf8_length_from_latin1_avx2(const char* src, size_t length) {
+        size_t non_ascii{0};
+        size_t i{0};
+        for (; i + 32 <= length; i += 32) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            non_ascii += static_cast<size_t>(std::popcount(static_cast<uint32_t>(_mm256_movemask_epi8(bytes))));
+        }
+        for (; i < length; ++i)
+            non_ascii += static_cast<unsigned char>(src[i]) >> 7;
+        return length + non_ascii;
+    }
+
+    UTFCPP_TARGET("avx512f,avx512bw,popcnt")
+    static size_t utf8_length_from_latin1_avx512(const char* src, size_t length) {
+        size_t non_ascii{0};
+        size_t i{0};
+        for (; i + 64 <= length; i += 64)
+            non_ascii += static_cast<size_t>(std::popcount(static_cast<uint64_t>(
+                _mm512_movepi8_mask(_mm512_loadu_si512(src + i)))));
+        const __mmask64 mask = (__mmask64{1} << (length - i)) - 1;
+        non_ascii += static_cast<size_t>(std::popcount(static_cast<uint64_t>(
+            _mm512_movepi8_mask(_mm512_maskz_loadu_epi8(mask, src + i)))));
+        return length + non_ascii;
+    }
+
+#endif // UTFCPP_X86_64
+
+    const cpu_features& detect_cpu_features() {
+#ifdef UTFCPP_X86_64
+        static const cpu_features features{query_cpu_features()};
+#else
+        static const cpu_features features{};
+#endif
+        return features;
+    }
+
+    implementation best_implementation() noexcept {
+        const cpu_features& features = detect_cpu_features();
+        if (features.avx512bw)
+            return implementation::avx512;
+        if (features.avx2)
+            return implementation::avx2;
+#ifdef UTFCPP_X86_64
+        return implementation::sse;
+#else
+        return implementation::scalar;
+#endif
+    }
+
+    // Kernel registry. Each kernel has versions for some of the implementation levels, and is
+    // selected per level as the version of the highest level at or below it; the scalar
+    // version is the baseline for all of them. The selected kernels of every level make up
+    // a table, and the public functions call through the active table.
+
+    template <typename Fn>
+    struct kernel {
+        Fn run;
+        implementation level;   // The level of the selected version
+    };
+
+    using widen_ascii_to_utf16_fn = size_t (*)(const char8_t*, size_t, char16_t*);
+    using transcode_bmp_to_utf8_fn = size_t (*)(const char16_t*, size_t, char8_t*&, const char8_t*);
+    using validate_utf8_fn = size_t (*)(const char8_t*, size_t);
+    using count_utf8_fn = size_t (*)(const char8_t*, size_t);
+    using count_utf16_fn = size_t (*)(const char16_t*, size_t);
+    using widen_ascii_to_utf32_fn = size_t (*)(const char8_t*, size_t, char32_t*);
+    using widen_bmp_to_utf32_fn = size_t (*)(const char16_t*, size_t, char32_t*);
+    using narrow_ascii_from_utf32_fn = size_t (*)(const char32_t*, size_t, char8_t*);
+    using narrow_bmp_from_utf32_fn = size_t (*)(const char32_t*, size_t, char16_t*);
+    using utf8_lead_masks_fn = size_t (*)(const char8_t*, const char8_t*, size_t, uint64_t*, uint64_t*);
+    using widen_latin1_to_utf16_fn = void (*)(const char*, size_t, char16_t*);
+    using narrow_latin1_from_utf16_fn = size_t (*)(const char16_t*, size_t, char*);
+    using transcode_latin1_to_utf8_fn = void (*)(const char*, size_t, char8_t*&, const char8_t*);
+    using transcode_utf8_to_latin1_fn = size_t (*)(const char8_t*, size_t, char*&, const char*);
+    using utf8_length_from_latin1_fn = size_t (*)(const char*, size_t);
+
+    static size_t estimate16_kernel(const char8_t* src, size_t length) {
+        return estimate16(std::u8string_view(src, length));
+    }
+
+    static size_t estimate8_kernel(const char16_t* src, size_t length) {
+        return estimate8(std::u16string_view(src, length));
+    }
+
+    static kernel<widen_ascii_to_utf16_fn> select_widen_ascii_to_utf16(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {widen_ascii_to_utf16_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {widen_ascii_to_utf16_avx2, implementation::avx2};
+        if (level >= implementation::sse)
+            return {widen_ascii_to_utf16_sse2, implementation::sse};
+#endif
+        return {widen_ascii_to_utf16_scalar, implementation::scalar};
+    }
+
+    static kernel<transcode_bmp_to_utf8_fn> select_transcode_bmp_to_utf8(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx2)
+            return {transcode_bmp_to_utf8_avx2, implementation::avx2};
+        if (level >= implementation::sse && detect_cpu_features().ssse3)
+            return {transcode_bmp_to_utf8_ssse3, implementation::sse};
+#endif
+        return {transcode_bmp_to_utf8_scalar, implementation::scalar};
+    }
+
+    static kernel<validate_utf8_fn> select_validate_utf8(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {validate_utf8_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {validate_utf8_avx2, implementation::avx2};
+        if (level >= implementation::sse && detect_cpu_features().ssse3)
+            return {validate_utf8_ssse3, implementation::sse};
+#endif
+        return {validate_utf8_scalar, implementation::scalar};
+    }
+
+    static kernel<count_utf8_fn> select_utf16_length_from_utf8(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {utf16_length_from_utf8_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {utf16_length_from_utf8_avx2, implementation::avx2};
+#endif
+        return {estimate16_kernel, implementation::scalar};
+    }
+
+    static kernel<count_utf16_fn> select_utf8_length_from_utf16(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {utf8_length_from_utf16_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {utf8_length_from_utf16_avx2, implementation::avx2};
+#endif
+        return {estimate8_kernel, implementation::scalar};
+    }
+
+    static kernel<count_utf8_fn> select_count_utf8_code_points(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {count_utf8_code_points_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {count_utf8_code_points_avx2, implementation::avx2};
+#endif
+        return {count_utf8_code_points_scalar, implementation::scalar};
+    }
+
+    static kernel<count_utf16_fn> select_count_utf16_code_points(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {count_utf16_code_points_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {count_utf16_code_points_avx2, implementation::avx2};
+#endif
+        return {count_utf16_code_points_scalar, implementation::scalar};
+    }
+
+    static kernel<widen_ascii_to_utf32_fn> select_widen_ascii_to_utf32(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {widen_ascii_to_utf32_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {widen_ascii_to_utf32_avx2, implementation::avx2};
+#endif
+        return {widen_ascii_to_utf32_scalar, implementation::scalar};
+    }
+
+    static kernel<widen_bmp_to_utf32_fn> select_widen_bmp_to_utf32(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {widen_bmp_to_utf32_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {widen_bmp_to_utf32_avx2, implementation::avx2};
+#endif
+        return {widen_bmp_to_utf32_scalar, implementation::scalar};
+    }
+
+    static kernel<narrow_ascii_from_utf32_fn> select_narrow_ascii_from_utf32(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {narrow_ascii_from_utf32_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {narrow_ascii_from_utf32_avx2, implementation::avx2};
+#endif
+        return {narrow_ascii_from_utf32_scalar, implementation::scalar};
+    }
+
+    static kernel<narrow_bmp_from_utf32_fn> select_narrow_bmp_from_utf32(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {narrow_bmp_from_utf32_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {narrow_bmp_from_utf32_avx2, implementation::avx2};
+#endif
+        return {narrow_bmp_from_utf32_scalar, implementation::scalar};
+    }
+
+    static kernel<utf8_lead_masks_fn> select_utf8_lead_masks(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {utf8_lead_masks_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {utf8_lead_masks_avx2, implementation::avx2};
+        if (level >= implementation::sse && detect_cpu_features().ssse3)
+            return {utf8_lead_masks_ssse3, implementation::sse};
+#endif
+        return {utf8_lead_masks_scalar, implementation::scalar};
+    }
+
+    static kernel<widen_latin1_to_utf16_fn> select_widen_latin1_to_utf16(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {widen_latin1_to_utf16_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {widen_latin1_to_utf16_avx2, implementation::avx2};
+        if (level >= implementation::sse)
+            return {widen_latin1_to_utf16_sse2, implementation::sse};
+#endif
+        return {widen_latin1_to_utf16_scalar, implementation::scalar};
+    }
+
+    static kernel<narrow_latin1_from_utf16_fn> select_narrow_latin1_from_utf16(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {narrow_latin1_from_utf16_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {narrow_latin1_from_utf16_avx2, implementation::avx2};
+        if (level >= implementation::sse)
+            return {narrow_latin1_from_utf16_sse2, implementation::sse};
+#endif
+        return {narrow_latin1_from_utf16_scalar, implementation::scalar};
+    }
+
+    static kernel<transcode_latin1_to_utf8_fn> select_transcode_latin1_to_utf8(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx2)
+            return {transcode_latin1_to_utf8_avx2, implementation::avx2};
+        if (level >= implementation::sse && detect_cpu_features().ssse3)
+            return {transcode_latin1_to_utf8_ssse3, implementation::sse};
+#endif
+        return {transcode_latin1_to_utf8_scalar, implementation::scalar};
+    }
+
+    static kernel<transcode_utf8_to_latin1_fn> select_transcode_utf8_to_latin1(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx2)
+            return {transcode_utf8_to_latin1_avx2, implementation::avx2};
+        if (level >= implementation::sse && detect_cpu_features().ssse3)
+            return {transcode_utf8_to_latin1_ssse3, implementation::sse};
+#endif
+        return {transcode_utf8_to_latin1_scalar, implementation::scalar};
+    }
+
+    static kernel<utf8_length_from_latin1_fn> select_utf8_length_from_latin1(implementation level) {
+#ifdef UTFCPP_X86_64
+        if (level >= implementation::avx512)
+            return {utf8_length_from_latin1_avx512, implementation::avx512};
+        if (level >= implementation::avx2)
+            return {utf8_length_from_latin1_avx2, implementation::avx2};
+#endif
+        return {utf8_length_from_latin1_scalar, implementation::scalar};
+    }
+
+    struct kernel_table {
+        implementation level;
+        kernel<widen_ascii_to_utf16_fn> widen_ascii_to_utf16;
+        kernel<transcode_bmp_to_utf8_fn> transcode_bmp_to_utf8;
+        kernel<validate_utf8_fn> validate_utf8;
+        kernel<count_utf8_fn> utf16_length_from_utf8;
+        kernel<count_utf16_fn> utf8_length_from_utf16;
+        kernel<count_utf8_fn> count_utf8_code_points;
+        kernel<count_utf16_fn> count_utf16_code_points;
+        kernel<widen_ascii_to_utf32_fn> widen_ascii_to_utf32;
+        kernel<widen_bmp_to_utf32_fn> widen_bmp_to_utf32;
+        kernel<narrow_ascii_from_utf32_fn> narrow_ascii_from_utf32;
+        kernel<narrow_bmp_from_utf32_fn> narrow_bmp_from_utf32;
+        kernel<utf8_lead_masks_fn> utf8_lead_masks;
+        kernel<widen_latin1_to_utf16_fn> widen_latin1_to_utf16;
+        kernel<narrow_latin1_from_utf16_fn> narrow_latin1_from_utf16;
+        kernel<transcode_latin1_to_utf8_fn> transcode_latin1_to_utf8;
+        kernel<transcode_utf8_to_latin1_fn> transcode_utf8_to_latin1;
+        kernel<utf8_length_from_latin1_fn> utf8_length_from_latin1;
+    };
+
+    static kernel_table make_kernel_table(implementation level) {
+        return {level,
+                select_widen_ascii_to_utf16(level),
+                select_transcode_bmp_to_utf8(level),
+                select_validate_utf8(level),
+                select_utf16_length_from_utf8(level),
+                select_utf8_length_from_utf16(level),
+                select_count_utf8_code_points(level),
+                select_count_utf16_code_points(level),
+                select_widen_ascii_to_utf32(level),
+                select_widen_bmp_to_utf32(level),
+                select_narrow_ascii_from_utf32(level),
+                select_narrow_bmp_from_utf32(level),
+                select_utf8_lead_masks(level),
+                select_widen_latin1_to_utf16(level),
+                select_narrow_latin1_from_utf16(level),
+                select_transcode_latin1_to_utf8(level),
+                select_transcode_utf8_to_latin1(level),
+                select_utf8_length_from_latin1(level)};
+    }
+
+    static const kernel_table& kernel_table_for(implementation level) {
+        static const kernel_table tables[] {
+            make_kernel_table(implementation::scalar),
+            make_kernel_table(implementation::sse),
+            make_kernel_table(implementation::avx2),
+            make_kernel_table(implementation::avx512)
+        };
+        return tables[static_cast<size_t>(level)];
+    }
+
+    static std::string environment_variable(const char* name) {
+#ifdef _MSC_VER
+        char* value{nullptr};
+        size_t size{0};
+        if (_dupenv_s(&value, &size, name) != 0 || value == nullptr)
+            return {};
+        std::string result(value);
+        std::free(value);
+        return result;
+#else
+        const char* value = std::getenv(name);
+        return value != nullptr ? value : "";
+#endif
+    }
+
+    // The best level, or the one named by UTFCPP_IMPLEMENTATION if the CPU supports it
+    static implementation initial_implementation() {
+        const implementation best = best_implementation();
+        const std::string name = environment_variable("UTFCPP_IMPLEMENTATION");
+        for (implementation level : {implementation::scalar, implementation::sse, implementation::avx2,
+                                     implementation::avx512}) {
+            if (name == implementation_name(level) && level <= best)
+                return level;
+        }
+        return best;
+    }
+
+    static std::atomic<const kernel_table*>& active_table() {
+        static std::atomic<const kernel_table*> table{&kernel_table_for(initial_implementation())};
+        return table;
+    }
+
+    static const kernel_table& active_kernels() {
+        return *active_table().load(std::memory_order_acquire);
+    }
+
+    size_t widen_ascii_to_utf16(const char8_t* src, size_t length, char16_t* dst) {
+        return active_kernels().widen_ascii_to_utf16.run(src, length, dst);
+    }
+
+    size_t transcode_bmp_to_utf8(const char16_t* src, size_t length, char8_t*& dst, const char8_t* dst_end) {
+        return active_kernels().transcode_bmp_to_utf8.run(src, length, dst, dst_end);
+    }
+
+    size_t validate_utf8(const char8_t* src, size_t length) {
+        return active_kernels().validate_utf8.run(src, length);
+    }
+
+    size_t utf16_length_from_utf8(const char8_t* src, size_t length) {
+        return active_kernels().utf16_length_from_utf8.run(src, length);
+    }
+
+    size_t utf8_length_from_utf16(const char16_t* src, size_t length) {
+        return active_kernels().utf8_length_from_utf16.run(src, length);
+    }
+
+    size_t count_utf8_code_points(const char8_t* src, size_t length) {
+        return active_kernels().count_utf8_code_points.run(src, length);
+    }
+
+    size_t count_utf16_code_points(const char16_t* src, size_t length) {
+        return active_kernels().count_utf16_code_points.run(src, length);
+    }
+
+    size_t widen_ascii_to_utf32(const char8_t* src, size_t length, char32_t* dst) {
+        return active_kernels().widen_ascii_to_utf32.run(src, length, dst);
+    }
+
+    size_t widen_bmp_to_utf32(const char16_t* src, size_t length, char32_t* dst) {
+        return active_kernels().widen_bmp_to_utf32.run(src, length, dst);
+    }
+
+    size_t narrow_ascii_from_utf32(const char32_t* src, size_t length, char8_t* dst) {
+        return active_kernels().narrow_ascii_from_utf32.run(src, length, dst);
+    }
+
+    size_t narrow_bmp_from_utf32(const char32_t* src, size_t length, char16_t* dst) {
+        return active_kernels().narrow_bmp_from_utf32.run(src, length, dst);
+    }
+
+    size_t utf8_lead_masks(const char8_t* src, const char8_t* prev_block, size_t block_count,
+                           uint64_t* lead_masks, uint64_t* four_byte_masks) {
+        return active_kernels().utf8_lead_masks.run(src, prev_block, block_count, lead_masks, four_byte_masks);
+    }
+
+    void widen_latin1_to_utf16(const char* src, size_t length, char16_t* dst) {
+        active_kernels().widen_latin1_to_utf16.run(src, length, dst);
+    }
+
+    size_t narrow_latin1_from_utf16(const char16_t* src, size_t length, char* dst) {
+        return active_kernels().narrow_latin1_from_utf16.run(src, length, dst);
+    }
+
+    void transcode_latin1_to_utf8(const char* src, size_t length, char8_t*& dst, const char8_t* dst_end) {
+        active_kernels().transcode_latin1_to_utf8.run(src, length, dst, dst_end);
+    }
+
+    size_t transcode_utf8_to_latin1(const char8_t* src, size_t length, char*& dst, const char* dst_end) {
+        return active_kernels().transcode_utf8_to_latin1.run(src, length, dst, dst_end);
+    }
+
+    size_t utf8_length_from_latin1(const char* src, size_t length) {
+        return active_kernels().utf8_length_from_latin1.run(src, length);
+    }
+
+} // namespace utfcpp::internal
+
+namespace utfcpp {
+    implementation active_implementation() noexcept {
+        return internal::active_kernels().level;
+    }
+
+    implementation best_implementation() noexcept {
+        return internal::best_implementation();
+    }
+
+    void set_implementation(implementation level) {
+        if (level > internal::best_implementation())
+            throw std::invalid_argument("utfcpp: implementation not supported by the CPU");
+        internal::active_table().store(&internal::kernel_table_for(level), std::memory_order_release);
+    }
+
+    const char* implementation_name(implementation level) noexcept {
+        switch (level) {
+        case implementation::scalar: return "scalar";
+        case implementation::sse:    return "sse";
+        case implementation::avx2:   return "avx2";
+        case implementation::avx512: return "avx512";
+        }
+        return "unknown";
+    }
+
+    std::vector<kernel_info> active_kernels() {
+        const internal::kernel_table& table = internal::active_kernels();
+        return {
+            {"widen_ascii_to_utf16", table.widen_ascii_to_utf16.level},
+            {"transcode_bmp_to_utf8", table.transcode_bmp_to_utf8.level},
+            {"validate_utf8", table.validate_utf8.level},
+            {"utf16_length_from_utf8", table.utf16_length_from_utf8.level},
+            {"utf8_length_from_utf16", table.utf8_length_from_utf16.level},
+            {"count_utf8_code_points", table.count_utf8_code_points.level},
+            {"count_utf16_code_points", table.count_utf16_code_points.level},
+            {"widen_ascii_to_utf32", table.widen_ascii_to_utf32.level},
+            {"widen_bmp_to_utf32", table.widen_bmp_to_utf32.level},
+            {"narrow_ascii_from_utf32", table.narrow_ascii_from_utf32.level},
+            {"narrow_bmp_from_utf32", table.narrow_bmp_from_utf32.level},
+            {"utf8_lead_masks", table.utf8_lead_masks.level},
+            {"widen_latin1_to_utf16", table.widen_latin1_to_utf16.level},
+            {"narrow_latin1_from_utf16", table.narrow_latin1_from_utf16.level},
+            {"transcode_latin1_to_utf8", table.transcode_latin1_to_utf8.level},
+            {"transcode_utf8_to_latin1", table.transcode_utf8_to_latin1.level},
+            {"utf8_length_from_latin1", table.utf8_length_from_latin1.level}
+        };
+    }
+} // namespace utfcpp
@@ -0,0 +1,130 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+#ifndef simd_H_7f0c5e3a_2b4d_4c1e_9a6f_d3b8e1f42c17
+#define simd_H_7f0c5e3a_2b4d_4c1e_9a6f_d3b8e1f42c17
+
+#include <cstddef> // std::size_t
+#include <cstdint>
+#include <string_view>
+
+#include "utfcpp20.hpp"
+
+namespace utfcpp::internal
+{
+    // CPU features relevant to the vectorized kernels, detected once via cpuid
+    struct cpu_features {
+        bool ssse3    {false};
+        bool avx2     {false};
+        bool avx512bw {false};
+    };
+    const cpu_features& detect_cpu_features();
+
+    // The highest implementation level the detected CPU features support. The kernels below
+    // dispatch through a table selected for the active level, see utfcpp::set_implementation.
+    implementation best_implementation() noexcept;
+
+    // Widens the leading run of ASCII bytes in [src, src + length) to UTF-16.
+    // Writes one code unit per converted byte to dst and returns the number of
+    // converted bytes; the byte at the returned offset, if any, is not ASCII.
+    // The kernel is selected at runtime based on the detected CPU features.
+    size_t widen_ascii_to_utf16(const char8_t* src, size_t length, char16_t* dst);
+
+    // Portable implementation of the above, used when no vector kernel is available
+    size_t widen_ascii_to_utf16_scalar(const char8_t* src, size_t length, char16_t* dst);
+
+    // Checks UTF-8 validity a block at a time. Returns std::u8string_view::npos if
+    // [src, src + length) is valid; otherwise, the first invalid sequence starts no earlier than three bytes
+    // before the returned offset, which is at most length.
+    size_t validate_utf8(const char8_t* src, size_t length);
+
+    // Portable implementation of the above, which returns the exact start of the error
+    size_t validate_utf8_scalar(const char8_t* src, size_t length);
+
+    // Converts the leading run of code units outside the surrogate range in [src, src + length)
+    // to UTF-8. Writes to dst, which is advanced past the written bytes, and returns the number
+    // of converted code units; the unit at the returned offset, if any, is a surrogate. Vector
+    // stores may write past the converted bytes, but never at or beyond dst_end.
+    size_t transcode_bmp_to_utf8(const char16_t* src, size_t length, char8_t*& dst, const char8_t* dst_end);
+
+    // Portable implementation of the above
+    size_t transcode_bmp_to_utf8_scalar(const char16_t* src, size_t length, char8_t*& dst, const char8_t* dst_end);
+
+    // Exact lengths of valid input converted to the other encoding form, and code point counts.
+    // For invalid input, the lengths are upper bounds for the output of a conversion that stops
+    // at the first error. The scalar fallbacks for the lengths are estimate16 and estimate8.
+    size_t utf16_length_from_utf8(const char8_t* src, size_t length);
+    size_t utf8_length_from_utf16(const char16_t* src, size_t length);
+    size_t count_utf8_code_points(const char8_t* src, size_t length);
+    size_t count_utf16_code_points(const char16_t* src, size_t length);
+
+    // Portable implementations of the code point counts
+    size_t count_utf8_code_points_scalar(const char8_t* src, size_t length);
+    size_t count_utf16_code_points_scalar(const char16_t* src, size_t length);
+
+    // UTF-32 kernels, each converting the leading run of [src, src + length) it can handle and
+    // returning its length: ASCII bytes widened to UTF-32, UTF-16 code units outside the surrogate
+    // range widened to UTF-32, ASCII code points narrowed to UTF-8 and valid BMP code points
+    // narrowed to UTF-16. The element at the returned offset, if any, ends the run.
+    size_t widen_ascii_to_utf32(const char8_t* src, size_t length, char32_t* dst);
+    size_t widen_bmp_to_utf32(const char16_t* src, size_t length, char32_t* dst);
+    size_t narrow_ascii_from_utf32(const char32_t* src, size_t length, char8_t* dst);
+    size_t narrow_bmp_from_utf32(const char32_t* src, size_t length, char16_t* dst);
+
+    // Portable implementations of the above
+    size_t widen_ascii_to_utf32_scalar(const char8_t* src, size_t length, char32_t* dst);
+    size_t widen_bmp_to_utf32_scalar(const char16_t* src, size_t length, char32_t* dst);
+    size_t narrow_ascii_from_utf32_scalar(const char32_t* src, size_t length, char8_t* dst);
+    size_t narrow_bmp_from_utf32_scalar(const char32_t* src, size_t length, char16_t* dst);
+
+    // Classifies the bytes of block_count 64-byte blocks starting at src. Sets bit j of
+    // lead_masks[k] if byte j of block k does not continue a sequence, i.e. starts a code point
+    // in valid UTF-8, and bit j of four_byte_masks[k] if it starts a four-byte sequence.
+    // Validates the blocks in the same pass, as validate_utf8 does, and returns the index of the
+    // first block with an error or block_count. prev_block holds the 64 bytes before src, zeros
+    // at the start of the text; a zero padded block after the text catches a sequence cut off by
+    // its end. As with validate_utf8, an invalid sequence may start up to three bytes before the
+    // returned block.
+    size_t utf8_lead_masks(const char8_t* src, const char8_t* prev_block, size_t block_count,
+                           uint64_t* lead_masks, uint64_t* four_byte_masks);
+
+    // Portable implementation of the above
+    size_t utf8_lead_masks_scalar(const char8_t* src, const char8_t* prev_block, size_t block_count,
+                                  uint64_t* lead_masks, uint64_t* four_byte_masks);
+
+    // Latin-1 kernels. Latin-1 bytes are the code points U+0000 - U+00FF, so widening to UTF-16
+    // and encoding to UTF-8 convert all of [src, src + length): the UTF-8 encoder writes one or two
+    // bytes per input byte to dst, which is advanced past them, and its vector stores never write
+    // at or beyond dst_end. The narrowing kernels convert the leading run of code units that encode
+    // code points up to U+00FF, i.e. UTF-16 units below 0x100 and UTF-8 ASCII bytes and two-byte
+    // sequences led by 0xc2 or 0xc3, and return its length; the sequence at the returned offset,
+    // if any, is invalid or above U+00FF.
+    void widen_latin1_to_utf16(const char* src, size_t length, char16_t* dst);
+    size_t narrow_latin1_from_utf16(const char16_t* src, size_t length, char* dst);
+    void transcode_latin1_to_utf8(const char* src, size_t length, char8_t*& dst, const char8_t* dst_end);
+    size_t transcode_utf8_to_latin1(const char8_t* src, size_t length, char*& dst, const char* dst_end);
+
+    // Exact length of Latin-1 text converted to UTF-8
+    size_t utf8_length_from_latin1(const char* src, size_t length);
+
+    // Portable implementations of the above
+    void widen_latin1_to_utf16_scalar(const char* src, size_t length, char16_t* dst);
+    size_t narrow_latin1_from_utf16_scalar(const char16_t* src, size_t length, char* dst);
+    void transcode_latin1_to_utf8_scalar(const char* src, size_t length, char8_t*& dst, const char8_t* dst_end);
+    size_t transcode_utf8_to_latin1_scalar(const char8_t* src, size_t length, char*& dst, const char* dst_end);
+    size_t utf8_length_from_latin1_scalar(const char* src, size_t length);
+
+}  // namespace utfcpp::internal
+
+#endif // simd_H_7f0c5e3a_2b4d_4c1e_9a6f_d3b8e1f42c17
@@ -14,78 +14,1041 @@
 
 #include "utfcpp20.hpp"
 #include "core.hpp"
+#include "simd.hpp"
+#include "utfcpp20/detail/iterator_inl.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
 
 namespace utfcpp {
     const char* exception::what() const noexcept {
         return "Error from utfcpp20 library";
     }
 
-    void append_to_utf8(std::u8string& utf8string, char32_t code_point) {
-        internal::encode_next_utf8(code_point, utf8string);
+    conversion_result internal::convert_utf8_to_16(std::u8string_view utf8_string, char16_t* out_begin) {
+        auto it{utf8_string.begin()}, end_it{utf8_string.end()};
+        char16_t* out = out_begin;
+        conversion_status status{conversion_status::ok};
+        while (it != end_it) {
+            // Bulk-convert a run of ASCII, then decode the following non-ASCII run
+            const size_t offset = static_cast<size_t>(std::distance(utf8_string.begin(), it));
+            const size_t ascii_length = internal::widen_ascii_to_utf16(
+                utf8_string.data() + offset, utf8_string.size() - offset, out);
+            it += static_cast<std::ptrdiff_t>(ascii_length);
+            out += ascii_length;
+            while (it != end_it && *it >= 0x80) {
+                const char32_t code_point = internal::decode_next_utf8(it, end_it, status);
+                if (status != conversion_status::ok)
+                    return {status, static_cast<size_t>(std::distance(utf8_string.begin(), it)),
+                            static_cast<size_t>(out - out_begin)};
+                out = internal::encode_next_utf16(code_point, out);
+            }
+        }
+        return {status, utf8_string.size(), static_cast<size_t>(out - out_begin)};
     }
 
-    void append_to_utf16(std::u16string& utf16string, char32_t code_point) {
-        internal::encode_next_utf16(code_point, utf16string);
+    conversion_result internal::convert_utf16_to_8(std::u16string_view utf16_string, char8_t* out_begin,
+                                                   const char8_t* out_end) {
+        auto it{utf16_string.begin()}, end_it{utf16_string.end()};
+        char8_t* out = out_begin;
+        conversion_status status{conversion_status::ok};
+        while (it != end_it) {
+            // Bulk-convert a run of BMP code units, then decode the following surrogates
+            const size_t offset = static_cast<size_t>(std::distance(utf16_string.begin(), it));
+            it += static_cast<std::ptrdiff_t>(internal::transcode_bmp_to_utf8(
+                utf16_string.data() + offset, utf16_string.size() - offset, out, out_end));
+            while (it != end_it && internal::is_utf16_surrogate(*it)) {
+                const char32_t code_point = internal::decode_next_utf16(it, end_it, status);
+                if (status != conversion_status::ok)
+                    return {status, static_cast<size_t>(std::distance(utf16_string.begin(), it)),
+                            static_cast<size_t>(out - out_begin)};
+                out = internal::encode_next_utf8(code_point, out);
+            }
+        }
+        return {status, utf16_string.size(), static_cast<size_t>(out - out_begin)};
     }
 
     std::u16string utf8_to_16(std::u8string_view utf8_string) {
-        auto it{utf8_string.begin()}, end_it{utf8_string.end()};
         std::u16string ret16;
-        ret16.reserve(internal::estimate16(utf8_string));
-        try {
-            while (it != end_it)
-                append_to_utf16(ret16, internal::decode_next_utf8(it, end_it));
-        } catch (const exception& e) {
-            size_t pos = static_cast<size_t>(std::distance(utf8_string.begin(), it));
-            throw exception_with_position(pos, e.what());
-        }
+        utf8_to_16(utf8_string, ret16);
         return ret16;
     }
 
     std::u8string utf16_to_8(std::u16string_view utf16_string) {
-        auto it{utf16_string.begin()}, end_it{utf16_string.end()};
         std::u8string ret8;
-        const size_t u8_length = internal::estimate8(utf16_string);
-        ret8.reserve(u8_length);
-        try {
-            while(it != end_it)
-                append_to_utf8(ret8, internal::decode_next_utf16(it, end_it));
-        } catch (const exception& e) {
-            size_t pos = static_cast<size_t>(std::distance(utf16_string.begin(), it));
-            throw exception_with_position(pos, e.what());
+        utf16_to_8(utf16_string, ret8);
+        return ret8;
+    }
+
+    // Converts the valid runs in bulk and replaces each maximal subpart of an ill-formed sequence.
+    // The output needs at most one code unit per replacement on top of utf16_length_from_utf8.
+    static void convert_utf8_to_16_replacing(std::u8string_view utf8_string, std::u16string& utf16_string) {
+        size_t out_size = utf16_string.size();
+        utf16_string.resize(out_size + utf16_length_from_utf8(utf8_string));
+        size_t offset{0};
+        for (;;) {
+            const conversion_result result = internal::convert_utf8_to_16(utf8_string.substr(offset),
+                                                                utf16_string.data() + out_size);
+            out_size += result.written;
+            if (result.status == conversion_status::ok)
+                break;
+            offset += result.position;
+            offset += internal::utf8_maximal_subpart_length(utf8_string.begin() + static_cast<std::ptrdiff_t>(offset),
+                                                            utf8_string.end());
+            utf16_string.resize(utf16_string.size() + 1);
+            utf16_string[out_size++] = static_cast<char16_t>(internal::REPLACEMENT_CHARACTER);
+        }
+        utf16_string.resize(out_size);
+    }
+
+    // Converts the valid runs in bulk and replaces each unpaired surrogate. The output needs
+    // at most three code units per replacement on top of utf8_length_from_utf16.
+    static void convert_utf16_to_8_replacing(std::u16string_view utf16_string, std::u8string& utf8_string) {
+        size_t out_size = utf8_string.size();
+        utf8_string.resize(out_size + utf8_length_from_utf16(utf16_string));
+        size_t offset{0};
+        for (;;) {
+            const conversion_result result = internal::convert_utf16_to_8(utf16_string.substr(offset),
+                                                                utf8_string.data() + out_size,
+                                                                utf8_string.data() + utf8_string.size());
+            out_size += result.written;
+            if (result.status == conversion_status::ok)
+                break;
+            // A lone trail surrogate is reported at itself, and a lone lead at the unit after it
+            offset += result.position;
+            if (offset < utf16_string.size() && internal::is_utf16_trail_surrogate(utf16_string[offset]))
+                ++offset;
+            utf8_string.resize(utf8_string.size() + 3);
+            out_size = static_cast<size_t>(internal::encode_next_utf8(internal::REPLACEMENT_CHARACTER,
+                                                                       utf8_string.data() + out_size) - utf8_string.data());
         }
+        utf8_string.resize(out_size);
+    }
+
+    std::u16string utf8_to_16(std::u8string_view utf8_string, error_mode mode) {
+        if (mode == error_mode::throw_exception)
+            return utf8_to_16(utf8_string);
+        std::u16string ret16;
+        convert_utf8_to_16_replacing(utf8_string, ret16);
+        return ret16;
+    }
+
+    std::u8string utf16_to_8(std::u16string_view utf16_string, error_mode mode) {
+        if (mode == error_mode::throw_exception)
+            return utf16_to_8(utf16_string);
+        std::u8string ret8;
+        convert_utf16_to_8_replacing(utf16_string, ret8);
         return ret8;
     }
 
+    std::u16string utf8_to_16(std::u8string_view utf8_string, parallel_policy policy) {
+        size_t thread_count = (policy.thread_count != 0) ? policy.thread_count : std::thread::hardware_concurrency();
+        thread_count = std::min(thread_count, utf8_string.size() / std::max(policy.min_chunk_size, size_t{1}));
+        if (thread_count <= 1)
+            return utf8_to_16(utf8_string);
 
-    // Class u8_iterator
+        // Split at code point boundaries: move each split point past up to three trail bytes.
+        // Past a valid prefix, a sequential conversion reaches each boundary at the start of a sequence.
+        std::vector<size_t> chunk_starts(thread_count + 1);
+        chunk_starts[thread_count] = utf8_string.size();
+        for (size_t i = 1; i < thread_count; ++i) {
+            size_t start = std::max(utf8_string.size() / thread_count * i, chunk_starts[i - 1]);
+            for (int back = 0; back < 3 && start < utf8_string.size() && internal::is_utf8_trail(utf8_string[start]); ++back)
+                ++start;
+            chunk_starts[i] = start;
+        }
+        auto chunk = [&](size_t i) {
+            return utf8_string.substr(chunk_starts[i], chunk_starts[i + 1] - chunk_starts[i]);
+        };
+
+        // Runs task(i) for each chunk, on the calling thread for the first one and for any chunk
+        // a thread cannot be started for
+        std::vector<std::jthread> workers;
+        workers.reserve(thread_count - 1);
+        auto run_chunks = [&](auto task) noexcept {
+            for (size_t i = 1; i < thread_count; ++i) {
+                try {
+                    workers.emplace_back(task, i);
+                } catch (const std::system_error&) {
+                    task(i);
+                }
+            }
+            task(0);
+            workers.clear();
+        };
+
+        // Each chunk's length is exact for valid input and an upper bound for the converted prefix
+        // otherwise, so a prefix sum gives the chunks disjoint places in the output
+        std::vector<size_t> out_starts(thread_count + 1);
+        run_chunks([&](size_t i) { out_starts[i + 1] = utf16_length_from_utf8(chunk(i)); });
+        for (size_t i = 0; i < thread_count; ++i)
+            out_starts[i + 1] += out_starts[i];
 
-    /* static */ u8_iterator u8_iterator::begin(std::u8string_view str_view) {
-      return u8_iterator(str_view.begin(), str_view.end());
+        std::u16string utf16_string;
+        std::vector<conversion_result> results(thread_count);
+        internal::append_converted(utf16_string, out_starts[thread_count], [&](char16_t* out, char16_t*) {
+            run_chunks([&](size_t i) { results[i] = internal::convert_utf8_to_16(chunk(i), out + out_starts[i]); });
+            return conversion_result{conversion_status::ok, utf8_string.size(), out_starts[thread_count]};
+        });
+
+        for (size_t i = 0; i < thread_count; ++i) {
+            if (results[i].status != conversion_status::ok) {
+                // A chunk ends where the next one starts; decode the failing sequence again without
+                // that limit for the status a sequential conversion reports
+                internal::throw_invalid_utf8(utf8_string, chunk_starts[i] + results[i].position);
+            }
+        }
+        return utf16_string;
     }
 
-    /* static */ u8_iterator u8_iterator::end(std::u8string_view str_view) {
-      return u8_iterator(str_view.end(), str_view.end());
+    void utf8_to_16(std::u8string_view utf8_string, std::u16string& utf16_string) {
+        internal::append_converted_or_throw(utf16_string, utf16_length_from_utf8(utf8_string),
+            [utf8_string](char16_t* out, char16_t*) { return internal::convert_utf8_to_16(utf8_string, out); });
     }
 
-    u8_iterator::u8_iterator(std::u8string_view::iterator begin,
-        std::u8string_view::iterator end): 
-        it{begin}, end_it{end}
-    {}
+    void utf16_to_8(std::u16string_view utf16_string, std::u8string& utf8_string) {
+        internal::append_converted_or_throw(utf8_string, utf8_length_from_utf16(utf16_string),
+            [utf16_string](char8_t* out, char8_t* out_end) { return internal::convert_utf16_to_8(utf16_string, out, out_end); });
+    }
 
-    char32_t u8_iterator::operator * () const {
-        std::u8string_view::iterator temp_it{ it };
-        return internal::decode_next_utf8(temp_it, end_it);
+    conversion_result try_utf8_to_16(std::u8string_view utf8_string, std::u16string& utf16_string) {
+        return internal::append_converted(utf16_string, utf16_length_from_utf8(utf8_string),
+            [utf8_string](char16_t* out, char16_t*) { return internal::convert_utf8_to_16(utf8_string, out); });
+    }
+
+    conversion_result try_utf16_to_8(std::u16string_view utf16_string, std::u8string& utf8_string) {
+        return internal::append_converted(utf8_string, utf8_length_from_utf16(utf16_string),
+            [utf16_string](char8_t* out, char8_t* out_end) { return internal::convert_utf16_to_8(utf16_string, out, out_end); });
+    }
+
+    conversion_result try_utf8_to_16(std::u8string_view utf8_string, std::span<char16_t> utf16_buffer) {
+        // The length is exact for valid input and an upper bound for any converted prefix otherwise
+        const size_t required = utf16_length_from_utf8(utf8_string);
+        if (required > utf16_buffer.size())
+            return {conversion_status::buffer_too_small, utf8_string.size(), required};
+        return internal::convert_utf8_to_16(utf8_string, utf16_buffer.data());
+    }
+
+    conversion_result try_utf16_to_8(std::u16string_view utf16_string, std::span<char8_t> utf8_buffer) {
+        const size_t required = utf8_length_from_utf16(utf16_string);
+        if (required > utf8_buffer.size())
+            return {conversion_status::buffer_too_small, utf16_string.size(), required};
+        return internal::convert_utf16_to_8(utf16_string, utf8_buffer.data(), utf8_buffer.data() + required);
+    }
+
+    std::pmr::u16string utf8_to_16(std::u8string_view utf8_string, std::pmr::memory_resource* resource) {
+        return utf8_to_16(utf8_string, std::pmr::polymorphic_allocator<char16_t>(resource));
+    }
+
+    std::pmr::u8string utf16_to_8(std::u16string_view utf16_string, std::pmr::memory_resource* resource) {
+        return utf16_to_8(utf16_string, std::pmr::polymorphic_allocator<char8_t>(resource));
+    }
+
+    void internal::throw_conversion_error(const conversion_result& result) {
+        throw exception_with_position(result.position, internal::describe(result.status));
+    }
+
+    void internal::throw_invalid_utf8(std::u8string_view utf8_string, size_t position) {
+        // Decode the invalid sequence again for the status
+        auto it{utf8_string.begin() + static_cast<std::ptrdiff_t>(position)};
+        conversion_status status{conversion_status::ok};
+        internal::decode_next_utf8(it, utf8_string.end(), status);
+        throw exception_with_position(position, internal::describe(status));
+    }
+
+    // Converts count strings, string_at(i) being string i, back to back into one buffer of
+    // max_size code units, which is at least the sum of the output lengths of the strings.
+    // An invalid string converts to an empty one.
+    template <typename Batch, typename StringAt, typename Convert>
+    static Batch convert_batch(size_t count, size_t max_size, StringAt string_at, Convert convert) {
+        Batch batch;
+        batch.offsets.resize(count + 1);
+        batch.results.resize(count);
+        internal::append_converted(batch.values, max_size, [&](auto* out_begin, auto* out_end) noexcept {
+            auto* out = out_begin;
+            for (size_t i = 0; i < count; ++i) {
+                batch.offsets[i] = static_cast<size_t>(out - out_begin);
+                batch.results[i] = convert(string_at(i), out, out_end);
+                if (batch.results[i].status == conversion_status::ok)
+                    out += batch.results[i].written;
+            }
+            batch.offsets[count] = static_cast<size_t>(out - out_begin);
+            return conversion_result{conversion_status::ok, count, batch.offsets[count]};
+        });
+        return batch;
+    }
+
+    // Checks Arrow-style offsets: non-decreasing, within the values
+    template <typename Offset>
+    static void check_offsets(size_t values_size, std::span<const Offset> offsets) {
+        for (size_t i = 0; i < offsets.size(); ++i) {
+            if (offsets[i] < 0 || static_cast<size_t>(offsets[i]) > values_size || (i > 0 && offsets[i] < offsets[i - 1]))
+                throw std::invalid_argument("utfcpp: invalid string offsets");
+        }
+    }
+
+    // Converts the values between the first and the last offset in one pass, across the strings.
+    // If the conversion succeeds and no offset splits a sequence, every string is valid and
+    // the output offsets follow from the output lengths of the code units. Otherwise returns false,
+    // and the strings are to be converted one at a time for their results.
+    template <typename Batch, typename Values, typename Offset, typename Splits, typename UnitLength, typename Convert>
+    static bool convert_valid_batch(Batch& batch, Values values, std::span<const Offset> offsets, size_t max_size,
+                                    Splits splits, UnitLength unit_length, Convert convert) {
+        const size_t count = offsets.size() - 1;
+        const auto first = static_cast<size_t>(offsets.front());
+        const auto last = static_cast<size_t>(offsets.back());
+        const conversion_result result = internal::append_converted(batch.values, max_size,
+            [&](auto* out_begin, auto* out_end) noexcept { return convert(values.substr(first, last - first), out_begin, out_end); });
+        if (result.status != conversion_status::ok)
+            return false;
+        // The values are valid, so a sequence is split only at an offset to a trail code unit
+        for (size_t i = 1; i < count; ++i) {
+            if (offsets[i] < offsets.back() && splits(values, static_cast<size_t>(offsets[i])))
+                return false;
+        }
+        // Sum the output lengths of the code units in one loop over the values rather than
+        // calling a length function per string
+        batch.offsets.resize(count + 1);
+        batch.results.resize(count);
+        size_t out{0};
+        for (size_t i = 0, position = first; i < count; ++i) {
+            const size_t string_begin = out;
+            batch.offsets[i] = out;
+            for (const auto string_end = static_cast<size_t>(offsets[i + 1]); position < string_end; ++position)
+                out += unit_length(values[position]);
+            batch.results[i] = {conversion_status::ok, static_cast<size_t>(offsets[i + 1] - offsets[i]), out - string_begin};
+        }
+        batch.offsets[count] = out;
+        return true;
+    }
+
+    // The output lengths are sums of per-code-unit lengths, so the length of the values between
+    // the first and the last offset bounds the output of all the strings between them
+    template <typename Offset>
+    static utf16_batch convert_utf8_to_16_batch(std::u8string_view utf8_values, std::span<const Offset> offsets) {
+        check_offsets(utf8_values.size(), offsets);
+        if (offsets.empty())
+            return {{}, {0}, {}};
+        const std::u8string_view all{utf8_values.substr(static_cast<size_t>(offsets.front()),
+                                                        static_cast<size_t>(offsets.back() - offsets.front()))};
+        const size_t max_size = utf16_length_from_utf8(all);
+        auto convert = [](std::u8string_view utf8_string, char16_t* out, char16_t*) { return internal::convert_utf8_to_16(utf8_string, out); };
+        utf16_batch batch;
+        if (convert_valid_batch(batch, utf8_values, offsets, max_size,
+                [](std::u8string_view values, size_t offset) {
+                    return internal::is_utf8_trail(values[offset]);
+                },
+                [](char8_t unit) { return size_t{!internal::is_utf8_trail(unit)} + size_t{unit >= 0xf0}; }, convert))
+            return batch;
+        return convert_batch<utf16_batch>(offsets.size() - 1, max_size,
+            [&](size_t i) {
+                return utf8_values.substr(static_cast<size_t>(offsets[i]), static_cast<size_t>(offsets[i + 1] - offsets[i]));
+            }, convert);
+    }
+
+    template <typename Offset>
+    static utf8_batch convert_utf16_to_8_batch(std::u16string_view utf16_values, std::span<const Offset> offsets) {
+        check_offsets(utf16_values.size(), offsets);
+        if (offsets.empty())
+            return {{}, {0}, {}};
+        const std::u16string_view all{utf16_values.substr(static_cast<size_t>(offsets.front()),
+                                                          static_cast<size_t>(offsets.back() - offsets.front()))};
+        const size_t max_size = utf8_length_from_utf16(all);
+        auto convert = [](std::u16string_view utf16_string, char8_t* out, char8_t* out_end) {
+            return internal::convert_utf16_to_8(utf16_string, out, out_end);
+        };
+        utf8_batch batch;
+        if (convert_valid_batch(batch, utf16_values, offsets, max_size,
+                [](std::u16string_view values, size_t offset) {
+                    return internal::is_utf16_trail_surrogate(values[offset]);
+                },
+                [](char16_t unit) {
+                    // A surrogate is half of a four-byte sequence
+                    return size_t{1} + size_t{unit >= 0x80} + size_t{unit >= 0x800 && !internal::is_utf16_surrogate(unit)};
+                }, convert))
+            return batch;
+        return convert_batch<utf8_batch>(offsets.size() - 1, max_size,
+            [&](size_t i) {
+                return utf16_values.substr(static_cast<size_t>(offsets[i]), static_cast<size_t>(offsets[i + 1] - offsets[i]));
+            }, convert);
+    }
+
+    utf16_batch utf8_to_16_batch(std::span<const std::u8string_view> utf8_strings) {
+        size_t max_size{0};
+        for (std::u8string_view utf8_string : utf8_strings)
+            max_size += utf16_length_from_utf8(utf8_string);
+        return convert_batch<utf16_batch>(utf8_strings.size(), max_size,
+            [utf8_strings](size_t i) { return utf8_strings[i]; },
+            [](std::u8string_view utf8_string, char16_t* out, char16_t*) { return internal::convert_utf8_to_16(utf8_string, out); });
+    }
+
+    utf16_batch utf8_to_16_batch(std::u8string_view utf8_values, std::span<const int32_t> offsets) {
+        return convert_utf8_to_16_batch(utf8_values, offsets);
+    }
+
+    utf16_batch utf8_to_16_batch(std::u8string_view utf8_values, std::span<const int64_t> offsets) {
+        return convert_utf8_to_16_batch(utf8_values, offsets);
+    }
+
+    utf8_batch utf16_to_8_batch(std::span<const std::u16string_view> utf16_strings) {
+        size_t max_size{0};
+        for (std::u16string_view utf16_string : utf16_strings)
+            max_size += utf8_length_from_utf16(utf16_string);
+        return convert_batch<utf8_batch>(utf16_strings.size(), max_size,
+            [utf16_strings](size_t i) { return utf16_strings[i]; },
+            [](std::u16string_view utf16_string, char8_t* out, char8_t* out_end) {
+                return internal::convert_utf16_to_8(utf16_string, out, out_end);
+            });
+    }
+
+    utf8_batch utf16_to_8_batch(std::u16string_view utf16_values, std::span<const int32_t> offsets) {
+        return convert_utf16_to_8_batch(utf16_values, offsets);
+    }
+
+    utf8_batch utf16_to_8_batch(std::u16string_view utf16_values, std::span<const int64_t> offsets) {
+        return convert_utf16_to_8_batch(utf16_values, offsets);
+    }
+
+    // UTF-32 conversions. Like the UTF-8/UTF-16 ones, these convert into buffers presized with lengths
+    // that are exact for valid input, bulk-convert the runs the vector kernels handle and fall back
+    // to decoding or encoding one code point at a time.
+
+    static conversion_result convert_utf8_to_32(std::u8string_view utf8_string, char32_t* out_begin) {
+        auto it{utf8_string.begin()}, end_it{utf8_string.end()};
+        char32_t* out = out_begin;
+        conversion_status status{conversion_status::ok};
+        while (it != end_it) {
+            const size_t offset = static_cast<size_t>(std::distance(utf8_string.begin(), it));
+            const size_t ascii_length = internal::widen_ascii_to_utf32(
+                utf8_string.data() + offset, utf8_string.size() - offset, out);
+            it += static_cast<std::ptrdiff_t>(ascii_length);
+            out += ascii_length;
+            while (it != end_it && *it >= 0x80) {
+                const char32_t code_point = internal::decode_next_utf8(it, end_it, status);
+                if (status != conversion_status::ok)
+                    return {status, static_cast<size_t>(std::distance(utf8_string.begin(), it)),
+                            static_cast<size_t>(out - out_begin)};
+                *out++ = code_point;
+            }
+        }
+        return {status, utf8_string.size(), static_cast<size_t>(out - out_begin)};
+    }
+
+    static conversion_result convert_utf16_to_32(std::u16string_view utf16_string, char32_t* out_begin) {
+        auto it{utf16_string.begin()}, end_it{utf16_string.end()};
+        char32_t* out = out_begin;
+        conversion_status status{conversion_status::ok};
+        while (it != end_it) {
+            const size_t offset = static_cast<size_t>(std::distance(utf16_string.begin(), it));
+            const size_t bmp_length = internal::widen_bmp_to_utf32(
+                utf16_string.data() + offset, utf16_string.size() - offset, out);
+            it += static_cast<std::ptrdiff_t>(bmp_length);
+            out += bmp_length;
+            while (it != end_it && internal::is_utf16_surrogate(*it)) {
+                const char32_t code_point = internal::decode_next_utf16(it, end_it, status);
+                if (status != conversion_status::ok)
+                    return {status, static_cast<size_t>(std::distance(utf16_string.begin(), it)),
+                            static_cast<size_t>(out - out_begin)};
+                *out++ = code_point;
+            }
+        }
+        return {status, utf16_string.size(), static_cast<size_t>(out - out_begin)};
+    }
+
+    static conversion_result convert_utf32_to_8(std::u32string_view utf32_string, char8_t* out_begin) {
+        size_t i{0};
+        char8_t* out = out_begin;
+        while (i < utf32_string.size()) {
+            const size_t ascii_length = internal::narrow_ascii_from_utf32(
+                utf32_string.data() + i, utf32_string.size() - i, out);
+            i += ascii_length;
+            out += ascii_length;
+            for (; i < utf32_string.size() && utf32_string[i] >= 0x80; ++i) {
+                if (!internal::is_code_point_valid(utf32_string[i]))
+                    return {conversion_status::invalid_code_point, i, static_cast<size_t>(out - out_begin)};
+                out = internal::encode_next_utf8(utf32_string[i], out);
+            }
+        }
+        return {conversion_status::ok, utf32_string.size(), static_cast<size_t>(out - out_begin)};
+    }
+
+    static conversion_result convert_utf32_to_16(std::u32string_view utf32_string, char16_t* out_begin) {
+        size_t i{0};
+        char16_t* out = out_begin;
+        while (i < utf32_string.size()) {
+            const size_t bmp_length = internal::narrow_bmp_from_utf32(
+                utf32_string.data() + i, utf32_string.size() - i, out);
+            i += bmp_length;
+            out += bmp_length;
+            for (; i < utf32_string.size() && (utf32_string[i] >= 0x10000 || internal::is_utf16_surrogate(utf32_string[i])); ++i) {
+                if (!internal::is_code_point_valid(utf32_string[i]))
+                    return {conversion_status::invalid_code_point, i, static_cast<size_t>(out - out_begin)};
+                out = internal::encode_next_utf16(utf32_string[i], out);
+            }
+        }
+        return {conversion_status::ok, utf32_string.size(), static_cast<size_t>(out - out_begin)};
+    }
+
+    std::u32string utf8_to_32(std::u8string_view utf8_string) {
+        std::u32string utf32_string;
+        internal::append_converted_or_throw(utf32_string, count_code_points(utf8_string),
+            [utf8_string](char32_t* out, char32_t*) { return convert_utf8_to_32(utf8_string, out); });
+        return utf32_string;
+    }
+
+    std::u8string utf32_to_8(std::u32string_view utf32_string) {
+        std::u8string utf8_string;
+        encode_utf8(utf32_string, utf8_string);
+        return utf8_string;
+    }
+
+    std::u32string utf16_to_32(std::u16string_view utf16_string) {
+        std::u32string utf32_string;
+        internal::append_converted_or_throw(utf32_string, count_code_points(utf16_string),
+            [utf16_string](char32_t* out, char32_t*) { return convert_utf16_to_32(utf16_string, out); });
+        return utf32_string;
+    }
+
+    std::u16string utf32_to_16(std::u32string_view utf32_string) {
+        std::u16string utf16_string;
+        encode_utf16(utf32_string, utf16_string);
+        return utf16_string;
+    }
+
+    void encode_utf8(std::span<const char32_t> code_points, std::u8string& utf8_string) {
+        const std::u32string_view utf32_string(code_points.data(), code_points.size());
+        internal::append_converted_or_throw(utf8_string, internal::estimate8(utf32_string),
+            [utf32_string](char8_t* out, char8_t*) { return convert_utf32_to_8(utf32_string, out); });
+    }
+
+    void encode_utf16(std::span<const char32_t> code_points, std::u16string& utf16_string) {
+        const std::u32string_view utf32_string(code_points.data(), code_points.size());
+        internal::append_converted_or_throw(utf16_string, internal::estimate16(utf32_string),
+            [utf32_string](char16_t* out, char16_t*) { return convert_utf32_to_16(utf32_string, out); });
+    }
+
+    // Latin-1 conversions. Latin-1 strings are char strings holding one byte per code point
+    // U+0000 - U+00FF. Latin-1 converts to Unicode in one pass; the other way, the vector kernels
+    // stop at the first sequence that is invalid or above U+00FF.
+
+    std::u8string latin1_to_utf8(std::string_view latin1_string) {
+        std::u8string utf8_string;
+        internal::append_converted(utf8_string, utf8_length_from_latin1(latin1_string),
+            [latin1_string](char8_t* out_begin, char8_t* out_end) {
+                char8_t* out = out_begin;
+                internal::transcode_latin1_to_utf8(latin1_string.data(), latin1_string.size(), out, out_end);
+                return conversion_result{conversion_status::ok, latin1_string.size(), static_cast<size_t>(out - out_begin)};
+            });
+        return utf8_string;
+    }
+
+    std::u16string latin1_to_utf16(std::string_view latin1_string) {
+        std::u16string utf16_string;
+        internal::append_converted(utf16_string, latin1_string.size(), [latin1_string](char16_t* out, char16_t*) {
+            internal::widen_latin1_to_utf16(latin1_string.data(), latin1_string.size(), out);
+            return conversion_result{conversion_status::ok, latin1_string.size(), latin1_string.size()};
+        });
+        return utf16_string;
+    }
+
+    // Converts into a buffer of at least latin1_length_from_utf8 bytes, which is exact for valid input.
+    // The sequence the kernel stops at is decoded again for the status.
+    static conversion_result convert_utf8_to_latin1(std::u8string_view utf8_string, char* out_begin, const char* out_end) {
+        char* out = out_begin;
+        const size_t length = internal::transcode_utf8_to_latin1(utf8_string.data(), utf8_string.size(), out, out_end);
+        if (length == utf8_string.size())
+            return {conversion_status::ok, length, static_cast<size_t>(out - out_begin)};
+        auto it{utf8_string.begin() + static_cast<std::ptrdiff_t>(length)};
+        conversion_status status{conversion_status::ok};
+        internal::decode_next_utf8(it, utf8_string.end(), status);
+        if (status == conversion_status::ok)
+            status = conversion_status::unrepresentable;
+        return {status, length, static_cast<size_t>(out - out_begin)};
+    }
+
+    static conversion_result convert_utf16_to_latin1(std::u16string_view utf16_string, char* out_begin) {
+        const size_t length = internal::narrow_latin1_from_utf16(utf16_string.data(), utf16_string.size(), out_begin);
+        if (length == utf16_string.size())
+            return {conversion_status::ok, length, length};
+        auto it{utf16_string.begin() + static_cast<std::ptrdiff_t>(length)};
+        conversion_status status{conversion_status::ok};
+        internal::decode_next_utf16(it, utf16_string.end(), status);
+        if (status == conversion_status::ok)
+            return {conversion_status::unrepresentable, length, length};
+        return {status, static_cast<size_t>(std::distance(utf16_string.begin(), it)), length};
+    }
+
+    std::string utf8_to_latin1(std::u8string_view utf8_string) {
+        std::string latin1_string;
+        internal::append_converted_or_throw(latin1_string, latin1_length_from_utf8(utf8_string),
+            [utf8_string](char* out, char* out_end) { return convert_utf8_to_latin1(utf8_string, out, out_end); });
+        return latin1_string;
+    }
+
+    std::string utf16_to_latin1(std::u16string_view utf16_string) {
+        std::string latin1_string;
+        internal::append_converted_or_throw(latin1_string, utf16_string.size(),
+            [utf16_string](char* out, char*) { return convert_utf16_to_latin1(utf16_string, out); });
+        return latin1_string;
+    }
+
+    // Each replacement consumes at least one code unit, so the output is at most as long as the input
+    std::string utf8_to_latin1(std::u8string_view utf8_string, error_mode mode) {
+        if (mode == error_mode::throw_exception)
+            return utf8_to_latin1(utf8_string);
+        std::string latin1_string;
+        internal::append_converted(latin1_string, utf8_string.size(), [utf8_string](char* out_begin, char* out_end) {
+            char* out = out_begin;
+            size_t offset{0};
+            for (;;) {
+                const conversion_result result = convert_utf8_to_latin1(utf8_string.substr(offset), out, out_end);
+                out += result.written;
+                if (result.status == conversion_status::ok)
+                    break;
+                offset += result.position;
+                const auto it{utf8_string.begin() + static_cast<std::ptrdiff_t>(offset)};
+                offset += (result.status == conversion_status::unrepresentable)
+                    ? static_cast<size_t>(internal::utf8_cp_length(*it))
+                    : internal::utf8_maximal_subpart_length(it, utf8_string.end());
+                *out++ = '?';
+            }
+            return conversion_result{conversion_status::ok, utf8_string.size(), static_cast<size_t>(out - out_begin)};
+        });
+        return latin1_string;
+    }
+
+    std::string utf16_to_latin1(std::u16string_view utf16_string, error_mode mode) {
+        if (mode == error_mode::throw_exception)
+            return utf16_to_latin1(utf16_string);
+        std::string latin1_string;
+        internal::append_converted(latin1_string, utf16_string.size(), [utf16_string](char* out_begin, char*) {
+            char* out = out_begin;
+            size_t offset{0};
+            for (;;) {
+                const conversion_result result = convert_utf16_to_latin1(utf16_string.substr(offset), out);
+                out += result.written;
+                if (result.status == conversion_status::ok)
+                    break;
+                // A surrogate pair is one code point; a lone trail surrogate is reported at itself,
+                // and a lone lead at the unit after it
+                offset += result.position;
+                if (result.status == conversion_status::unrepresentable)
+                    offset += internal::is_utf16_lead_surrogate(utf16_string[offset]) ? 2 : 1;
+                else if (offset < utf16_string.size() && internal::is_utf16_trail_surrogate(utf16_string[offset]))
+                    ++offset;
+                *out++ = '?';
+            }
+            return conversion_result{conversion_status::ok, utf16_string.size(), static_cast<size_t>(out - out_begin)};
+        });
+        return latin1_string;
+    }
+
+    bool is_valid_utf8(std::u8string_view utf8_string) {
+        return internal::validate_utf8(utf8_string.data(), utf8_string.size()) == std::u8string_view::npos;
+    }
+
+    size_t find_invalid_utf8(std::u8string_view utf8_string) {
+        const size_t block = internal::validate_utf8(utf8_string.data(), utf8_string.size());
+        if (block == std::u8string_view::npos)
+            return std::u8string_view::npos;
+        return internal::locate_invalid_utf8(utf8_string, block);
+    }
+
+    size_t internal::locate_invalid_utf8(std::u8string_view utf8_string, size_t block) {
+        // The invalid sequence may start up to three bytes before the reported block. Everything
+        // before that is valid, so trail bytes there belong to sequences that are already complete.
+        size_t start = block > 3 ? block - 3 : 0;
+        if (start > 0)
+            while (start < block && internal::is_utf8_trail(utf8_string[start]))
+                ++start;
+
+        auto it{utf8_string.begin() + static_cast<std::ptrdiff_t>(start)}, end_it{utf8_string.end()};
+        conversion_status status{conversion_status::ok};
+        while (it != end_it) {
+            internal::decode_next_utf8(it, end_it, status);
+            if (status != conversion_status::ok)
+                return static_cast<size_t>(std::distance(utf8_string.begin(), it));
+        }
+        return std::u8string_view::npos;
+    }
+
+    std::u8string sanitize_utf8(std::u8string_view utf8_string) {
+        std::u8string sanitized;
+        sanitized.reserve(utf8_string.size());
+        size_t offset{0};
+        for (;;) {
+            const size_t error = find_invalid_utf8(utf8_string.substr(offset));
+            if (error == std::u8string_view::npos)
+                break;
+            sanitized.append(utf8_string.substr(offset, error));
+            sanitized.append(u8"\ufffd");
+            offset += error;
+            offset += internal::utf8_maximal_subpart_length(utf8_string.begin() + static_cast<std::ptrdiff_t>(offset),
+                                                            utf8_string.end());
+        }
+        sanitized.append(utf8_string.substr(offset));
+        return sanitized;
+    }
+
+    size_t utf16_length_from_utf8(std::u8string_view utf8_string) {
+        return internal::utf16_length_from_utf8(utf8_string.data(), utf8_string.size());
+    }
+
+    size_t utf8_length_from_utf16(std::u16string_view utf16_string) {
+        return internal::utf8_length_from_utf16(utf16_string.data(), utf16_string.size());
+    }
+
+    size_t utf8_length_from_latin1(std::string_view latin1_string) {
+        return internal::utf8_length_from_latin1(latin1_string.data(), latin1_string.size());
+    }
+
+    size_t latin1_length_from_utf8(std::u8string_view utf8_string) {
+        return count_code_points(utf8_string);
+    }
+
+    size_t count_code_points(std::u8string_view utf8_string) {
+        return internal::count_utf8_code_points(utf8_string.data(), utf8_string.size());
+    }
+
+    size_t count_code_points(std::u16string_view utf16_string) {
+        return internal::count_utf16_code_points(utf16_string.data(), utf16_string.size());
+    }
+
+    // The start of the sequence that contains the trail byte at offset: the lead byte up to three
+    // bytes back, if its sequence reaches offset, or offset itself for a stray trail byte
+    static size_t sequence_start(std::u8string_view utf8_string, size_t offset) {
+        for (size_t back = 1; back <= 3 && back <= offset; ++back) {
+            const char8_t unit = utf8_string[offset - back];
+            if (!internal::is_utf8_trail(unit))
+                return (static_cast<size_t>(internal::utf8_cp_length(unit)) > back) ? offset - back : offset;
+        }
+        return offset;
+    }
+
+    size_t find_prev_boundary(std::u8string_view utf8_string, size_t offset) {
+        if (offset > utf8_string.size())
+            throw std::out_of_range("utfcpp: byte offset out of range");
+        if (offset == utf8_string.size() || !internal::is_utf8_trail(utf8_string[offset]))
+            return offset;
+        return sequence_start(utf8_string, offset);
+    }
+
+    size_t find_next_boundary(std::u8string_view utf8_string, size_t offset) {
+        const size_t start = find_prev_boundary(utf8_string, offset);
+        if (start == offset)
+            return offset;
+        // Stop early at a missing trail byte
+        const size_t end = std::min(start + static_cast<size_t>(internal::utf8_cp_length(utf8_string[start])),
+                                    utf8_string.size());
+        while (offset < end && internal::is_utf8_trail(utf8_string[offset]))
+            ++offset;
+        return offset;
+    }
+
+    std::u8string_view truncate_utf8(std::u8string_view utf8_string, size_t max_bytes) {
+        if (max_bytes >= utf8_string.size())
+            return utf8_string;
+        return utf8_string.substr(0, find_prev_boundary(utf8_string, max_bytes));
+    }
+
+    std::vector<std::u8string_view> chunk_utf8(std::u8string_view utf8_string, size_t chunk_size) {
+        if (chunk_size == 0)
+            throw std::invalid_argument("utfcpp: chunk size must not be zero");
+        std::vector<std::u8string_view> chunks;
+        chunks.reserve(utf8_string.size() / chunk_size + 1);
+        for (size_t start = 0; start < utf8_string.size();) {
+            size_t end = (chunk_size < utf8_string.size() - start) ?
+                find_prev_boundary(utf8_string, start + chunk_size) : utf8_string.size();
+            if (end == start)
+                end = find_next_boundary(utf8_string, start + 1);
+            chunks.push_back(utf8_string.substr(start, end - start));
+            start = end;
+        }
+        return chunks;
+    }
+
+    // Class utf8_to_16_stream
+
+    conversion_result utf8_to_16_stream::convert(std::u8string_view utf8_chunk, std::u16string& utf16_string) {
+        const size_t chunk_start = position;
+        const size_t old_size = utf16_string.size();
+        size_t offset{0};
+
+        if (pending_size > 0) {
+            // Complete the pending sequence from the beginning of the chunk
+            char8_t sequence[4];
+            std::copy_n(pending, pending_size, sequence);
+            const size_t sequence_length = static_cast<size_t>(internal::utf8_cp_length(pending[0]));
+            size_t length = pending_size;
+            while (length < sequence_length && offset < utf8_chunk.size())
+                sequence[length++] = utf8_chunk[offset++];
+            const size_t lead_position = chunk_start - pending_size;
+            if (length < sequence_length) {
+                // Still cut off, unless a byte that should be a trail is not
+                for (size_t i = pending_size; i < length; ++i)
+                    if (!internal::is_utf8_trail(sequence[i]))
+                        return {conversion_status::incomplete_sequence, lead_position, 0};
+                std::copy_n(sequence, length, pending);
+                pending_size = length;
+                position = chunk_start + offset;
+                return {conversion_status::ok, position, 0};
+            }
+            const std::u8string_view sequence_view{sequence, length};
+            auto it{sequence_view.begin()};
+            conversion_status status{conversion_status::ok};
+            const char32_t code_point = internal::decode_next_utf8(it, sequence_view.end(), status);
+            if (status != conversion_status::ok)
+                return {status, lead_position + static_cast<size_t>(it - sequence_view.begin()), 0};
+            char16_t units[2];
+            utf16_string.append(units, internal::encode_next_utf16(code_point, units));
+            pending_size = 0;
+        }
+
+        // Hold back a sequence cut off at the end of the chunk; the next chunk completes it
+        const std::u8string_view rest{utf8_chunk.substr(offset)};
+        size_t body_size = rest.size();
+        for (size_t back = 1; back <= 3 && back <= rest.size(); ++back) {
+            const char8_t byte = rest[rest.size() - back];
+            if (!internal::is_utf8_trail(byte)) {
+                if (static_cast<size_t>(internal::utf8_cp_length(byte)) > back)
+                    body_size = rest.size() - back;
+                break;
+            }
+        }
+
+        const std::u8string_view body{rest.substr(0, body_size)};
+        const conversion_result result = internal::append_converted(utf16_string, utf16_length_from_utf8(body),
+            [body](char16_t* out, char16_t*) { return internal::convert_utf8_to_16(body, out); });
+        if (result.status != conversion_status::ok)
+            return {result.status, chunk_start + offset + result.position, utf16_string.size() - old_size};
+
+        pending_size = rest.size() - body_size;
+        std::copy_n(rest.data() + body_size, pending_size, pending);
+        position = chunk_start + utf8_chunk.size();
+        return {conversion_status::ok, position, utf16_string.size() - old_size};
+    }
+
+    void utf8_to_16_stream::feed(std::u8string_view utf8_chunk, std::u16string& utf16_string) {
+        const size_t old_size = utf16_string.size();
+        const conversion_result result = convert(utf8_chunk, utf16_string);
+        if (result.status != conversion_status::ok) {
+            utf16_string.resize(old_size);
+            throw exception_with_position(result.position, internal::describe(result.status));
+        }
+    }
+
+    conversion_result utf8_to_16_stream::try_feed(std::u8string_view utf8_chunk, std::u16string& utf16_string) {
+        return convert(utf8_chunk, utf16_string);
+    }
+
+    void utf8_to_16_stream::finish() {
+        const conversion_result result = try_finish();
+        if (result.status != conversion_status::ok)
+            throw exception_with_position(result.position, internal::describe(result.status));
+    }
+
+    conversion_result utf8_to_16_stream::try_finish() noexcept {
+        const conversion_result result = (pending_size > 0) ?
+            conversion_result{conversion_status::incomplete_sequence, position - pending_size, 0} :
+            conversion_result{conversion_status::ok, position, 0};
+        reset();
+        return result;
+    }
+
+    void utf8_to_16_stream::reset() noexcept {
+        position = 0;
+        pending_size = 0;
+    }
+
+    // Class utf16_to_8_stream
+
+    conversion_result utf16_to_8_stream::convert(std::u16string_view utf16_chunk, std::u8string& utf8_string) {
+        const size_t chunk_start = position;
+        const size_t old_size = utf8_string.size();
+        size_t offset{0};
+
+        if (pending_lead != 0 && !utf16_chunk.empty()) {
+            // Pair the pending lead surrogate with the beginning of the chunk
+            const char16_t pair[2] {pending_lead, utf16_chunk[0]};
+            const std::u16string_view pair_view{pair, 2};
+            auto it{pair_view.begin()};
+            conversion_status status{conversion_status::ok};
+            const char32_t code_point = internal::decode_next_utf16(it, pair_view.end(), status);
+            if (status != conversion_status::ok)
+                return {status, chunk_start - 1 + static_cast<size_t>(it - pair_view.begin()), 0};
+            char8_t bytes[4];
+            utf8_string.append(bytes, internal::encode_next_utf8(code_point, bytes));
+            pending_lead = 0;
+            offset = 1;
+        }
+
+        // Hold back a lead surrogate at the end of the chunk; the next chunk completes the pair
+        std::u16string_view body{utf16_chunk.substr(offset)};
+        char16_t last_lead{0};
+        if (!body.empty() && internal::is_utf16_lead_surrogate(body.back())) {
+            last_lead = body.back();
+            body.remove_suffix(1);
+        }
+
+        const conversion_result result = internal::append_converted(utf8_string, utf8_length_from_utf16(body),
+            [body](char8_t* out, char8_t* out_end) { return internal::convert_utf16_to_8(body, out, out_end); });
+        if (result.status != conversion_status::ok)
+            return {result.status, chunk_start + offset + result.position, utf8_string.size() - old_size};
+
+        if (last_lead != 0)
+            pending_lead = last_lead;
+        position = chunk_start + utf16_chunk.size();
+        return {conversion_status::ok, position, utf8_string.size() - old_size};
+    }
+
+    void utf16_to_8_stream::feed(std::u16string_view utf16_chunk, std::u8string& utf8_string) {
+        const size_t old_size = utf8_string.size();
+        const conversion_result result = convert(utf16_chunk, utf8_string);
+        if (result.status != conversion_status::ok) {
+            utf8_string.resize(old_size);
+            throw exception_with_position(result.position, internal::describe(result.status));
+        }
+    }
+
+    conversion_result utf16_to_8_stream::try_feed(std::u16string_view utf16_chunk, std::u8string& utf8_string) {
+        return convert(utf16_chunk, utf8_string);
+    }
+
+    void utf16_to_8_stream::finish() {
+        const conversion_result result = try_finish();
+        if (result.status != conversion_status::ok)
+            throw exception_with_position(result.position, internal::describe(result.status));
+    }
+
+    conversion_result utf16_to_8_stream::try_finish() noexcept {
+        const conversion_status status = (pending_lead != 0) ?
+            conversion_status::incomplete_sequence : conversion_status::ok;
+        const conversion_result result{status, position, 0};
+        reset();
+        return result;
+    }
+
+    void utf16_to_8_stream::reset() noexcept {
+        position = 0;
+        pending_lead = 0;
+    }
+
+    // Class utf8_to_16_iterator
+
+    /* static */ utf8_to_16_iterator utf8_to_16_iterator::begin(std::u8string_view str_view, error_mode mode) {
+        return utf8_to_16_iterator(str_view, mode);
+    }
+
+    utf8_to_16_iterator::utf8_to_16_iterator(std::u8string_view str_view, error_mode mode) :
+        str_view{str_view}, mode{mode}
+    {
+        convert_block();
+    }
+
+    // Converts up to block_size code units. A block ends before an invalid sequence, which
+    // throws when it starts the next block.
+    void utf8_to_16_iterator::convert_block() {
+        auto it{str_view.begin() + static_cast<std::ptrdiff_t>(offset)}, end_it{str_view.end()};
+        block_start = offset;
+        pos = 0;
+        size = 0;
+        // Leave room for a surrogate pair
+        while (it != end_it && size + 1 < block_size) {
+            const size_t ascii_offset = static_cast<size_t>(std::distance(str_view.begin(), it));
+            const size_t ascii_length = internal::widen_ascii_to_utf16(
+                str_view.data() + ascii_offset, std::min(str_view.size() - ascii_offset, block_size - size),
+                buffer.data() + size);
+            it += static_cast<std::ptrdiff_t>(ascii_length);
+            size += ascii_length;
+            if (it == end_it || size + 1 >= block_size)
+                break;
+
+            const auto sequence_start{it};
+            conversion_status status{conversion_status::ok};
+            const char32_t code_point = (mode == error_mode::replace) ?
+                internal::decode_next_utf8_or_replace(it, end_it) : internal::decode_next_utf8(it, end_it, status);
+            if (status != conversion_status::ok) {
+                if (size == 0)
+                    throw exception_with_position(static_cast<size_t>(std::distance(str_view.begin(), it)),
+                                                  internal::describe(status));
+                it = sequence_start;
+                break;
+            }
+            size = static_cast<size_t>(internal::encode_next_utf16(code_point, buffer.data() + size) - buffer.data());
+        }
+        offset = static_cast<size_t>(std::distance(str_view.begin(), it));
+    }
+
+    utf8_to_16_iterator& utf8_to_16_iterator::operator ++() {
+        if (++pos == size)
+            convert_block();
+        return *this;
+    }
+
+    utf8_to_16_iterator utf8_to_16_iterator::operator ++(int) {
+        utf8_to_16_iterator temp {*this};
+        ++(*this);
+        return temp;
+    }
+
+    // Class utf16_to_8_iterator
+
+    /* static */ utf16_to_8_iterator utf16_to_8_iterator::begin(std::u16string_view str_view, error_mode mode) {
+        return utf16_to_8_iterator(str_view, mode);
+    }
+
+    utf16_to_8_iterator::utf16_to_8_iterator(std::u16string_view str_view, error_mode mode) :
+        str_view{str_view}, mode{mode}
+    {
+        convert_block();
+    }
+
+    // Same as utf8_to_16_iterator::convert_block
+    void utf16_to_8_iterator::convert_block() {
+        auto it{str_view.begin() + static_cast<std::ptrdiff_t>(offset)}, end_it{str_view.end()};
+        block_start = offset;
+        pos = 0;
+        size = 0;
+        // Leave room for a four-byte sequence
+        while (it != end_it && size + 4 <= block_size) {
+            // A BMP code unit takes up to three bytes
+            const size_t bmp_offset = static_cast<size_t>(std::distance(str_view.begin(), it));
+            char8_t* out = buffer.data() + size;
+            it += static_cast<std::ptrdiff_t>(internal::transcode_bmp_to_utf8(
+                str_view.data() + bmp_offset, std::min(str_view.size() - bmp_offset, (block_size - size) / 3),
+                out, buffer.data() + block_size));
+            size = static_cast<size_t>(out - buffer.data());
+            if (it == end_it || size + 4 > block_size || !internal::is_utf16_surrogate(*it))
+                continue;
+
+            const auto sequence_start{it};
+            conversion_status status{conversion_status::ok};
+            const char32_t code_point = (mode == error_mode::replace) ?
+                internal::decode_next_utf16_or_replace(it, end_it) : internal::decode_next_utf16(it, end_it, status);
+            if (status != conversion_status::ok) {
+                if (size == 0)
+                    throw exception_with_position(static_cast<size_t>(std::distance(str_view.begin(), it)),
+                                                  internal::describe(status));
+                it = sequence_start;
+                break;
+            }
+            size = static_cast<size_t>(internal::encode_next_utf8(code_point, buffer.data() + size) - buffer.data());
+        }
+        offset = static_cast<size_t>(std::distance(str_view.begin(), it));
     }
 
-    u8_iterator& u8_iterator::operator ++() {
-        internal::decode_next_utf8(it, end_it);
+    utf16_to_8_iterator& utf16_to_8_iterator::operator ++() {
+        if (++pos == size)
+            convert_block();
         return *this;
     }
 
-    u8_iterator u8_iterator::operator ++(int) {
-        u8_iterator temp {*this};
-        internal::decode_next_utf8(it, end_it);
+    utf16_to_8_iterator utf16_to_8_iterator::operator ++(int) {
+        utf16_to_8_iterator temp {*this};
+        ++(*this);
         return temp;
     }
 } // namespace utfcpp20
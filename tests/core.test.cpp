@@ -13,6 +13,7 @@
 //    limitations under the License.
 
 #include "core.hpp"
+#include "utfcpp20.hpp"
 #include "ftest.h"
 
 TEST(CoreTests, test_decode_next_utf8)
@@ -41,6 +42,79 @@ TEST(CoreTests, test_decode_next_utf8)
     EXPECT_EQ(cp, U'𐌀');
 }
 
+TEST(CoreTests, test_decode_next_utf8_invalid)
+{
+    using namespace utfcpp::internal;
+
+    // A lead byte followed by something other than a trail byte
+    const std::u8string_view missing_trail{u8"\xd1" "A"};
+    auto next_cp = missing_trail.begin();
+    EXPECT_THROW(decode_next_utf8(next_cp, missing_trail.end()), utfcpp::exception);
+    EXPECT_EQ(next_cp, missing_trail.begin());
+
+    // On error the iterator is left at the start of the sequence
+    const char8_t overlong[] = {0xc1, 0x81};
+    const std::u8string_view overlong_view(overlong, 2);
+    auto overlong_it = overlong_view.begin();
+    EXPECT_THROW(decode_next_utf8(overlong_it, overlong_view.end()), utfcpp::exception);
+    EXPECT_EQ(overlong_it, overlong_view.begin());
+}
+
+TEST(CoreTests, test_decode_next_utf8_status)
+{
+    using namespace utfcpp::internal;
+    using utfcpp::conversion_status;
+
+    const std::u8string_view chinese {u8"水手"};
+    auto next_cp = chinese.begin();
+    conversion_status status{conversion_status::ok};
+    EXPECT_EQ(decode_next_utf8(next_cp, chinese.end(), status), U'水');
+    EXPECT_TRUE(status == conversion_status::ok);
+
+    const std::u8string_view truncated {chinese.substr(0, 4)};
+    next_cp = truncated.begin() + 3;
+    decode_next_utf8(next_cp, truncated.end(), status);
+    EXPECT_TRUE(status == conversion_status::incomplete_sequence);
+    EXPECT_EQ(next_cp, truncated.begin() + 3);
+
+    const char8_t surrogate[] = {0xed, 0xa0, 0x80};
+    const std::u8string_view surrogate_view(surrogate, 3);
+    next_cp = surrogate_view.begin();
+    status = conversion_status::ok;
+    decode_next_utf8(next_cp, surrogate_view.end(), status);
+    EXPECT_TRUE(status == conversion_status::invalid_code_point);
+}
+
+TEST(CoreTests, test_decode_next_utf8_engines)
+{
+    using namespace utfcpp::internal;
+    using utfcpp::conversion_status;
+
+    // Both decoding engines agree on all pairs of leading bytes, followed by bytes at the
+    // boundaries of the trail ranges, for every length of input
+    const char8_t followers[] = {0x00, 0x41, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0};
+    int mismatches{0};
+    for (unsigned first = 0; first < 256; ++first) {
+        for (unsigned second = 0; second < 256; ++second) {
+            for (char8_t third : followers) {
+                for (char8_t fourth : followers) {
+                    const char8_t bytes[] = {char8_t(first), char8_t(second), third, fourth};
+                    for (size_t length = 1; length <= 4; ++length) {
+                        const std::u8string_view view(bytes, length);
+                        auto branching_it{view.begin()}, dfa_it{view.begin()};
+                        conversion_status branching_status{conversion_status::ok}, dfa_status{conversion_status::ok};
+                        const char32_t branching_cp = decode_next_utf8_branching(branching_it, view.end(), branching_status);
+                        const char32_t dfa_cp = decode_next_utf8_dfa(dfa_it, view.end(), dfa_status);
+                        if (branching_cp != dfa_cp || branching_it != dfa_it || branching_status != dfa_status)
+                            ++mismatches;
+                    }
+                }
+            }
+        }
+    }
+    EXPECT_EQ(mismatches, 0);
+}
+
 TEST(CoreTests, test_encode_next_utf8)
 {
     using namespace utfcpp::internal;
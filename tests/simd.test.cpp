@@ -0,0 +1,330 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+#include "simd.hpp"
+#include "core.hpp"
+#include "ftest.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+TEST(SimdTests, test_widen_ascii_to_utf16)
+{
+    using namespace utfcpp::internal;
+
+    // Cover the block sizes of all the kernels and the scalar tail
+    for (size_t length = 0; length < 200; ++length) {
+        std::u8string ascii(length, u8'x');
+        std::u16string out(length, u'\0');
+        EXPECT_EQ(widen_ascii_to_utf16(ascii.data(), ascii.size(), out.data()), length);
+        EXPECT_EQ(out, std::u16string(length, u'x'));
+    }
+}
+
+TEST(SimdTests, test_widen_ascii_to_utf16_stops_at_non_ascii)
+{
+    using namespace utfcpp::internal;
+
+    const size_t length {150};
+    for (size_t pos = 0; pos < length; ++pos) {
+        std::u8string mixed(length, u8'a');
+        mixed[pos] = 0xd1;
+        std::u16string out(length, u'\0');
+        EXPECT_EQ(widen_ascii_to_utf16(mixed.data(), mixed.size(), out.data()), pos);
+        EXPECT_EQ(out.substr(0, pos), std::u16string(pos, u'a'));
+        EXPECT_EQ(widen_ascii_to_utf16_scalar(mixed.data(), mixed.size(), out.data()), pos);
+    }
+}
+
+TEST(SimdTests, test_validate_utf8)
+{
+    using namespace utfcpp::internal;
+
+    std::u8string valid;
+    while (valid.size() < 300) {
+        EXPECT_EQ(validate_utf8(valid.data(), valid.size()), std::u8string_view::npos);
+        EXPECT_EQ(validate_utf8_scalar(valid.data(), valid.size()), std::u8string_view::npos);
+        valid += u8"abcшницла水手𐌀";
+    }
+
+    // A default constructed view has no data pointer
+    const std::u8string_view empty;
+    EXPECT_EQ(validate_utf8(empty.data(), empty.size()), std::u8string_view::npos);
+    EXPECT_EQ(validate_utf8_scalar(empty.data(), empty.size()), std::u8string_view::npos);
+}
+
+TEST(SimdTests, test_validate_utf8_finds_errors)
+{
+    using namespace utfcpp::internal;
+
+    // A stray continuation byte, an overlong sequence, a surrogate, a code point above U+10FFFF
+    // and truncated sequences, at every offset past the block boundaries
+    const std::u8string invalid_sequences[] = {
+        {0x80}, {0xc1, 0x81}, {0xed, 0xa0, 0x80}, {0xf4, 0x90, 0x80, 0x80},
+        {0xe6, 0x97, u8'a'}, {0xf0, 0x90, 0x80}, {0xff}
+    };
+    for (const auto& invalid : invalid_sequences) {
+        for (size_t pos = 0; pos < 140; ++pos) {
+            std::u8string str(pos, u8'a');
+            str += invalid;
+            str += u8"шницла";
+            const size_t error = validate_utf8_scalar(str.data(), str.size());
+            EXPECT_EQ(error, pos);
+            const size_t block = validate_utf8(str.data(), str.size());
+            EXPECT_NE(block, std::u8string_view::npos);
+            EXPECT_TRUE(block <= str.size() && error + 3 >= block);
+        }
+    }
+
+    // A sequence cut off by the end of input
+    for (size_t pos = 0; pos < 140; ++pos) {
+        std::u8string str(pos, u8'a');
+        str += u8"水";
+        str.pop_back();
+        EXPECT_EQ(validate_utf8_scalar(str.data(), str.size()), pos);
+        const size_t block = validate_utf8(str.data(), str.size());
+        EXPECT_TRUE(block <= str.size() && pos + 3 >= block);
+    }
+}
+
+TEST(SimdTests, test_transcode_bmp_to_utf8)
+{
+    using namespace utfcpp::internal;
+
+    // ASCII, two and three byte blocks, with the scalar implementation as the reference
+    const std::u16string_view pieces[] = {u"abc", u"шницла", u"水手", u"a\u07ff\u0800\uffff"};
+    std::u16string utf16;
+    for (int i = 0; i < 60; ++i) {
+        utf16 += pieces[i % 4];
+        std::u8string expected(utf16.size() * 3, u8'\0'), actual(utf16.size() * 3, u8'\0');
+        char8_t* expected_end = expected.data();
+        char8_t* actual_end = actual.data();
+        EXPECT_EQ(transcode_bmp_to_utf8_scalar(utf16.data(), utf16.size(), expected_end,
+                                               expected.data() + expected.size()), utf16.size());
+        EXPECT_EQ(transcode_bmp_to_utf8(utf16.data(), utf16.size(), actual_end,
+                                        actual.data() + actual.size()), utf16.size());
+        EXPECT_EQ(actual_end - actual.data(), expected_end - expected.data());
+        EXPECT_EQ(actual, expected);
+    }
+}
+
+TEST(SimdTests, test_transcode_bmp_to_utf8_stops_at_surrogate)
+{
+    using namespace utfcpp::internal;
+
+    for (size_t pos = 0; pos < 70; ++pos) {
+        std::u16string utf16(pos, u'ш');
+        utf16 += u"𐌀水";
+        std::u8string utf8(utf16.size() * 3, u8'\0');
+        char8_t* end = utf8.data();
+        EXPECT_EQ(transcode_bmp_to_utf8(utf16.data(), utf16.size(), end, utf8.data() + utf8.size()), pos);
+        EXPECT_EQ(static_cast<size_t>(end - utf8.data()), pos * 2);
+    }
+}
+
+TEST(SimdTests, test_lengths_and_counts)
+{
+    using namespace utfcpp::internal;
+
+    // Mixed lengths, including stray trail bytes and lone surrogates, against the scalar functions
+    const std::u8string_view utf8_pieces[] = {u8"abc", u8"шницла", u8"水手", u8"𐌀", u8"\x80\xf4"};
+    const std::u16string_view utf16_pieces[] = {u"abc", u"Ћирилица", u"水手", u"𐌀", u"\xdc00\xd800"};
+    std::u8string utf8;
+    std::u16string utf16;
+    for (int i = 0; i < 80; ++i) {
+        utf8 += utf8_pieces[i % 5];
+        utf16 += utf16_pieces[i % 5];
+        for (size_t length = utf8.size() - utf8_pieces[i % 5].size(); length <= utf8.size(); ++length) {
+            const std::u8string_view prefix{utf8.data(), length};
+            EXPECT_EQ(utf16_length_from_utf8(prefix.data(), prefix.size()), estimate16(prefix));
+            EXPECT_EQ(count_utf8_code_points(prefix.data(), prefix.size()),
+                      count_utf8_code_points_scalar(prefix.data(), prefix.size()));
+        }
+        EXPECT_EQ(utf8_length_from_utf16(utf16.data(), utf16.size()), estimate8(utf16));
+        EXPECT_EQ(count_utf16_code_points(utf16.data(), utf16.size()),
+                  count_utf16_code_points_scalar(utf16.data(), utf16.size()));
+    }
+}
+
+TEST(SimdTests, test_utf32_kernels)
+{
+    using namespace utfcpp::internal;
+
+    // Cover the block sizes of all the kernels, with the run ending at every position
+    for (size_t length = 0; length < 80; ++length) {
+        for (size_t stop = 0; stop <= length; ++stop) {
+            std::u8string utf8(length, u8'a');
+            std::u16string utf16(length, u'水');
+            std::u32string ascii(length, U'a'), bmp(length, U'水');
+            if (stop < length) {
+                utf8[stop] = 0xd1;
+                utf16[stop] = 0xd800;
+                ascii[stop] = U'л';
+                bmp[stop] = (stop % 2) ? U'𐌀' : U'\xdfff';
+            }
+            std::u32string wide(length, U'\0');
+            EXPECT_EQ(widen_ascii_to_utf32(utf8.data(), length, wide.data()), stop);
+            EXPECT_EQ(wide.substr(0, stop), std::u32string(stop, U'a'));
+            EXPECT_EQ(widen_bmp_to_utf32(utf16.data(), length, wide.data()), stop);
+            EXPECT_EQ(wide.substr(0, stop), std::u32string(stop, U'水'));
+
+            std::u8string narrow8(length, u8'\0');
+            EXPECT_EQ(narrow_ascii_from_utf32(ascii.data(), length, narrow8.data()), stop);
+            EXPECT_EQ(narrow8.substr(0, stop), std::u8string(stop, u8'a'));
+            std::u16string narrow16(length, u'\0');
+            EXPECT_EQ(narrow_bmp_from_utf32(bmp.data(), length, narrow16.data()), stop);
+            EXPECT_EQ(narrow16.substr(0, stop), std::u16string(stop, u'水'));
+
+            EXPECT_EQ(widen_ascii_to_utf32_scalar(utf8.data(), length, wide.data()), stop);
+            EXPECT_EQ(narrow_bmp_from_utf32_scalar(bmp.data(), length, narrow16.data()), stop);
+        }
+    }
+}
+
+TEST(SimdTests, test_utf8_lead_masks)
+{
+    using namespace utfcpp::internal;
+
+    // All byte values in every position of the blocks
+    std::u8string bytes(256 * 3, u8'\0');
+    for (size_t i = 0; i < bytes.size(); ++i)
+        bytes[i] = static_cast<char8_t>(i * 7 + i / 256);
+    const size_t block_count = bytes.size() / 64;
+    const char8_t no_prev_block[64] {};
+    std::vector<uint64_t> leads(block_count), four_byte_leads(block_count);
+    std::vector<uint64_t> scalar_leads(block_count), scalar_four_byte_leads(block_count);
+    const size_t invalid = utf8_lead_masks(bytes.data(), no_prev_block, block_count, leads.data(), four_byte_leads.data());
+    EXPECT_EQ(invalid, utf8_lead_masks_scalar(bytes.data(), no_prev_block, block_count, scalar_leads.data(),
+                                              scalar_four_byte_leads.data()));
+    EXPECT_EQ(invalid, 0);
+    EXPECT_TRUE(leads == scalar_leads);
+    EXPECT_TRUE(four_byte_leads == scalar_four_byte_leads);
+    EXPECT_EQ(scalar_leads[0] & 1, 1); // The byte 0x00
+
+    // Valid text ending in a zero padded block, and the same text cut off inside a sequence
+    std::u8string text;
+    while (text.size() < 64 * 4)
+        text += u8"text Ωμέγα 世界 😃 ";
+    text.resize(text.rfind(u8' ', 64 * 4 - 1) + 1);
+    text.resize(64 * 4, u8' ');
+    text.resize(64 * 5, u8'\0');
+    const size_t text_blocks = text.size() / 64;
+    std::vector<uint64_t> text_leads(text_blocks), text_four_byte_leads(text_blocks);
+    EXPECT_EQ(utf8_lead_masks(text.data(), no_prev_block, text_blocks, text_leads.data(), text_four_byte_leads.data()),
+              text_blocks);
+    text.resize(64 * 4);
+    text[text.size() - 1] = u8'\xe4';
+    EXPECT_EQ(utf8_lead_masks(text.data(), no_prev_block, 4, text_leads.data(), text_four_byte_leads.data()), 4);
+    text.resize(64 * 5, u8'\0');
+    EXPECT_EQ(utf8_lead_masks(text.data(), no_prev_block, text_blocks, text_leads.data(), text_four_byte_leads.data()),
+              4);
+}
+
+TEST(SimdTests, test_latin1_kernels)
+{
+    using namespace utfcpp::internal;
+
+    // Cover the block sizes of all the kernels, with the run ending at every position
+    for (size_t length = 0; length < 100; ++length) {
+        std::string latin1(length, '\0');
+        for (size_t i = 0; i < length; ++i)
+            latin1[i] = static_cast<char>((i * 37 + length) & 0xff);
+
+        std::u16string utf16(length, u'\0'), expected16(length, u'\0');
+        widen_latin1_to_utf16(latin1.data(), length, utf16.data());
+        widen_latin1_to_utf16_scalar(latin1.data(), length, expected16.data());
+        EXPECT_EQ(utf16, expected16);
+
+        std::u8string utf8(2 * length, u8'\0'), expected8(2 * length, u8'\0');
+        char8_t* utf8_end = utf8.data();
+        char8_t* expected8_end = expected8.data();
+        transcode_latin1_to_utf8(latin1.data(), length, utf8_end, utf8.data() + utf8.size());
+        transcode_latin1_to_utf8_scalar(latin1.data(), length, expected8_end, expected8.data() + expected8.size());
+        EXPECT_EQ(utf8, expected8);
+        utf8.resize(static_cast<size_t>(utf8_end - utf8.data()));
+        EXPECT_EQ(utf8.size(), static_cast<size_t>(expected8_end - expected8.data()));
+        EXPECT_EQ(utf8_length_from_latin1(latin1.data(), length), utf8.size());
+        EXPECT_EQ(utf8_length_from_latin1_scalar(latin1.data(), length), utf8.size());
+
+        for (size_t stop = 0; stop <= length; ++stop) {
+            std::u16string stopped16 = utf16;
+            std::u8string stopped8 = utf8.substr(0, utf8_length_from_latin1_scalar(latin1.data(), stop));
+            const size_t stop8 = stopped8.size();
+            if (stop < length) {
+                stopped16[stop] = (stop % 2) ? u'\x100' : u'\xd800';
+                stopped8 += (stop % 2) ? u8"Ā" : u8"\x80";
+                stopped8 += utf8.substr(stop8);
+            }
+            std::string narrow(length, '\0');
+            EXPECT_EQ(narrow_latin1_from_utf16(stopped16.data(), length, narrow.data()), stop);
+            EXPECT_EQ(narrow_latin1_from_utf16_scalar(stopped16.data(), length, narrow.data()), stop);
+            EXPECT_EQ(narrow.substr(0, stop), latin1.substr(0, stop));
+
+            std::string narrow8(stopped8.size(), '\0');
+            char* narrow8_end = narrow8.data();
+            EXPECT_EQ(transcode_utf8_to_latin1(stopped8.data(), stopped8.size(), narrow8_end,
+                                               narrow8.data() + narrow8.size()), stop8);
+            EXPECT_EQ(narrow8.substr(0, static_cast<size_t>(narrow8_end - narrow8.data())), latin1.substr(0, stop));
+            narrow8_end = narrow8.data();
+            EXPECT_EQ(transcode_utf8_to_latin1_scalar(stopped8.data(), stopped8.size(), narrow8_end,
+                                                      narrow8.data() + narrow8.size()), stop8);
+        }
+    }
+}
+
+TEST(SimdTests, test_kernels_at_every_level)
+{
+    using namespace utfcpp::internal;
+    using utfcpp::implementation;
+
+    std::u8string utf8;
+    for (size_t i = 0; i < 40; ++i)
+        utf8 += (i % 5) ? u8"text " : u8"Ωμέγα 世界 ";
+    const std::u16string utf16 = utfcpp::utf8_to_16(utf8);
+
+    const implementation initial = utfcpp::active_implementation();
+    for (implementation level : {implementation::scalar, implementation::sse, implementation::avx2,
+                                 implementation::avx512}) {
+        if (level > best_implementation())
+            break;
+        utfcpp::set_implementation(level);
+        EXPECT_EQ(validate_utf8(utf8.data(), utf8.size()), std::u8string_view::npos);
+        EXPECT_EQ(validate_utf8(nullptr, 0), std::u8string_view::npos);
+
+        std::u8string padded{utf8.substr(0, utf8.rfind(u8' ', 127) + 1)};
+        padded.resize(192, u8'\0');
+        const char8_t no_prev_block[64] {};
+        uint64_t leads[3], four_byte_leads[3], scalar_leads[3], scalar_four_byte_leads[3];
+        EXPECT_EQ(utf8_lead_masks(padded.data(), no_prev_block, 3, leads, four_byte_leads), 3);
+        utf8_lead_masks_scalar(padded.data(), no_prev_block, 3, scalar_leads, scalar_four_byte_leads);
+        EXPECT_TRUE(std::equal(leads, leads + 3, scalar_leads));
+        EXPECT_TRUE(std::equal(four_byte_leads, four_byte_leads + 3, scalar_four_byte_leads));
+        EXPECT_EQ(utf16_length_from_utf8(utf8.data(), utf8.size()), utf16.size());
+        EXPECT_EQ(utf8_length_from_utf16(utf16.data(), utf16.size()), utf8.size());
+        EXPECT_EQ(count_utf8_code_points(utf8.data(), utf8.size()),
+                  count_utf8_code_points_scalar(utf8.data(), utf8.size()));
+
+        std::u16string widened(utf8.size(), u'\0');
+        const size_t ascii = widen_ascii_to_utf16(utf8.data(), utf8.size(), widened.data());
+        EXPECT_EQ(ascii, widen_ascii_to_utf16_scalar(utf8.data(), utf8.size(), widened.data()));
+
+        std::u8string narrowed(utf8.size(), u8'\0');
+        char8_t* dst = narrowed.data();
+        EXPECT_EQ(transcode_bmp_to_utf8(utf16.data(), utf16.size(), dst, narrowed.data() + narrowed.size()),
+                  utf16.size());
+        EXPECT_EQ(narrowed, utf8);
+    }
+    utfcpp::set_implementation(initial);
+}
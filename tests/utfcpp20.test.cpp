@@ -16,6 +16,13 @@
 #include "ftest.h"
 
 #include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory_resource>
+#include <ranges>
+#include <stdexcept>
+#include <vector>
 
 TEST(UtfTests, test_append_to_utf8)
 {
@@ -47,6 +54,31 @@ TEST(UtfTests, test_utf8_to_16)
     EXPECT_THROW(utfcpp::utf8_to_16(invalid_view), utfcpp::exception);
 }
 
+TEST(UtfTests, test_utf8_to_16_long_input)
+{
+    // Long ASCII runs go through the vectorized path
+    std::u8string utf8(100, u8'a');
+    std::u16string utf16(100, u'a');
+    EXPECT_EQ(utfcpp::utf8_to_16(utf8), utf16);
+
+    for (int i = 0; i < 20; ++i) {
+        utf8 += u8"шницла水手𐌀";
+        utf16 += u"шницла水手𐌀";
+        utf8.append(static_cast<size_t>(i), u8'z');
+        utf16.append(static_cast<size_t>(i), u'z');
+    }
+    EXPECT_EQ(utfcpp::utf8_to_16(utf8), utf16);
+
+    // The error position is reported past a long ASCII prefix
+    utf8.push_back(static_cast<char8_t>(0xfa));
+    try {
+        utfcpp::utf8_to_16(utf8);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception& e) {
+        EXPECT_EQ(e.position(), utf8.size() - 1);
+    }
+}
+
 TEST(UtfTests, test_utf16_to_8)
 {
     EXPECT_EQ(utfcpp::utf16_to_8(u"aл"), u8"aл");
@@ -57,6 +89,27 @@ TEST(UtfTests, test_utf16_to_8)
     EXPECT_THROW(utfcpp::utf16_to_8(invalid_view), utfcpp::exception);
 }
 
+TEST(UtfTests, test_utf16_to_8_long_input)
+{
+    std::u16string utf16;
+    std::u8string utf8;
+    for (int i = 0; i < 30; ++i) {
+        utf16 += u"Hello шницла 水手 𐌀 ";
+        utf8 += u8"Hello шницла 水手 𐌀 ";
+    }
+    EXPECT_EQ(utfcpp::utf16_to_8(utf16), utf8);
+
+    // An unpaired trail surrogate after a long BMP run
+    utf16 += u"水手";
+    utf16.push_back(static_cast<char16_t>(0xdd1e));
+    try {
+        utfcpp::utf16_to_8(utf16);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception& e) {
+        EXPECT_EQ(e.position(), utf16.size() - 1);
+    }
+}
+
 TEST(UtfTests, test_utf8_to_16_exception_position)
 {
     // Invalid UTF-8: unexpected continuation byte at position 5
@@ -85,6 +138,710 @@ TEST(UtfTests, test_utf16_to_8_exception_position)
     }
 }
 
+TEST(UtfTests, test_try_utf8_to_16)
+{
+    std::u16string utf16{u"x"};
+    utfcpp::conversion_result result = utfcpp::try_utf8_to_16(u8"aл𐌀", utf16);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::ok);
+    EXPECT_EQ(result.position, 7);
+    EXPECT_EQ(result.written, 4);
+    EXPECT_EQ(utf16, u"xaл𐌀");
+
+    // The converted prefix is kept, and the position matches the exception
+    const char utf8_invalid[] = "\xe6\x97\xa5\xd1\x88\xfa";
+    std::u8string_view invalid_view(reinterpret_cast<const char8_t*>(utf8_invalid), strlen(utf8_invalid));
+    utf16.clear();
+    result = utfcpp::try_utf8_to_16(invalid_view, utf16);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::invalid_lead);
+    EXPECT_EQ(result.position, 5);
+    EXPECT_EQ(result.written, 2);
+    EXPECT_EQ(utf16, u"日ш");
+
+    const char overlong[] = "a\xc1\x81";
+    utf16.clear();
+    result = utfcpp::try_utf8_to_16(reinterpret_cast<const char8_t*>(overlong), utf16);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::overlong_sequence);
+    EXPECT_EQ(result.position, 1);
+    EXPECT_EQ(utf16, u"a");
+
+    const char truncated[] = "ab\xe2\x82";
+    utf16.clear();
+    result = utfcpp::try_utf8_to_16(reinterpret_cast<const char8_t*>(truncated), utf16);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::incomplete_sequence);
+    EXPECT_EQ(result.position, 2);
+    EXPECT_EQ(utf16, u"ab");
+}
+
+TEST(UtfTests, test_try_utf16_to_8)
+{
+    std::u8string utf8{u8"x"};
+    utfcpp::conversion_result result = utfcpp::try_utf16_to_8(u"aл𐌀", utf8);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::ok);
+    EXPECT_EQ(result.position, 4);
+    EXPECT_EQ(result.written, 7);
+    EXPECT_EQ(utf8, u8"xaл𐌀");
+
+    const char16_t utf16_invalid[] = {0x41, 0x0448, 0x65e5, 0xdd1e};
+    std::u16string_view invalid_view(utf16_invalid, 4);
+    utf8.clear();
+    result = utfcpp::try_utf16_to_8(invalid_view, utf8);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::invalid_lead);
+    EXPECT_EQ(result.position, 3);
+    EXPECT_EQ(result.written, 6);
+    EXPECT_EQ(utf8, u8"Aш日");
+}
+
+TEST(UtfTests, test_utf8_to_16_append)
+{
+    std::u16string utf16{u"x"};
+    utfcpp::utf8_to_16(u8"aл", utf16);
+    utfcpp::utf8_to_16(u8"𐌀", utf16);
+    EXPECT_EQ(utf16, u"xaл𐌀");
+
+    // On error the original content is kept
+    const char utf8_invalid[] = "\xe6\x97\xa5\xd1\x88\xfa";
+    std::u8string_view invalid_view(reinterpret_cast<const char8_t*>(utf8_invalid), strlen(utf8_invalid));
+    EXPECT_THROW(utfcpp::utf8_to_16(invalid_view, utf16), utfcpp::exception);
+    EXPECT_EQ(utf16, u"xaл𐌀");
+}
+
+TEST(UtfTests, test_utf16_to_8_append)
+{
+    std::u8string utf8{u8"x"};
+    utfcpp::utf16_to_8(u"aл", utf8);
+    utfcpp::utf16_to_8(u"𐌀", utf8);
+    EXPECT_EQ(utf8, u8"xaл𐌀");
+
+    const char16_t utf16_invalid[] = {0x41, 0x0448, 0x65e5, 0xdd1e};
+    EXPECT_THROW(utfcpp::utf16_to_8(std::u16string_view(utf16_invalid, 4), utf8), utfcpp::exception);
+    EXPECT_EQ(utf8, u8"xaл𐌀");
+}
+
+TEST(UtfTests, test_try_utf8_to_16_span)
+{
+    char16_t buffer[8] {};
+    utfcpp::conversion_result result = utfcpp::try_utf8_to_16(u8"aл𐌀", buffer);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::ok);
+    EXPECT_EQ(result.written, 4);
+    EXPECT_EQ(std::u16string_view(buffer, result.written), u"aл𐌀");
+
+    result = utfcpp::try_utf8_to_16(u8"aл𐌀", std::span<char16_t>(buffer, 3));
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::buffer_too_small);
+    EXPECT_EQ(result.position, 7);
+    EXPECT_EQ(result.written, 4);
+
+    const char utf8_invalid[] = "\xe6\x97\xa5\xd1\x88\xfa";
+    std::u8string_view invalid_view(reinterpret_cast<const char8_t*>(utf8_invalid), strlen(utf8_invalid));
+    result = utfcpp::try_utf8_to_16(invalid_view, buffer);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::invalid_lead);
+    EXPECT_EQ(result.position, 5);
+    EXPECT_EQ(std::u16string_view(buffer, result.written), u"日ш");
+}
+
+TEST(UtfTests, test_try_utf16_to_8_span)
+{
+    char8_t buffer[8] {};
+    utfcpp::conversion_result result = utfcpp::try_utf16_to_8(u"aл𐌀", buffer);
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::ok);
+    EXPECT_EQ(result.written, 7);
+    EXPECT_EQ(std::u8string_view(buffer, result.written), u8"aл𐌀");
+
+    result = utfcpp::try_utf16_to_8(u"aл𐌀", std::span<char8_t>(buffer, 6));
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::buffer_too_small);
+    EXPECT_EQ(result.position, 4);
+    EXPECT_EQ(result.written, 7);
+}
+
+TEST(UtfTests, test_batch_conversions)
+{
+    const char8_t invalid8[] = {0x61, 0xd1, 0x88, 0xed, 0xa0, 0x80, 0};
+    const std::vector<std::u8string_view> utf8_strings {u8"aл水", u8"", invalid8, u8"𐌀 and a longer string in ASCII"};
+    const utfcpp::utf16_batch batch16 = utfcpp::utf8_to_16_batch(utf8_strings);
+    EXPECT_EQ(batch16.values, u"aл水𐌀 and a longer string in ASCII");
+    EXPECT_TRUE(batch16.offsets == std::vector<size_t>({0, 3, 3, 3, 34}));
+    EXPECT_TRUE(batch16.results[0].status == utfcpp::conversion_status::ok);
+    EXPECT_TRUE(batch16.results[2].status == utfcpp::conversion_status::invalid_code_point);
+    EXPECT_EQ(batch16.results[2].position, 3);
+
+    // The same strings back to back, with Arrow-style offsets
+    std::u8string utf8_values;
+    std::vector<int32_t> offsets32 {0};
+    for (std::u8string_view utf8_string : utf8_strings) {
+        utf8_values += utf8_string;
+        offsets32.push_back(static_cast<int32_t>(utf8_values.size()));
+    }
+    const utfcpp::utf16_batch values16 = utfcpp::utf8_to_16_batch(utf8_values, offsets32);
+    EXPECT_EQ(values16.values, batch16.values);
+    EXPECT_TRUE(values16.offsets == batch16.offsets);
+    const std::vector<int64_t> offsets64(offsets32.begin(), offsets32.end());
+    EXPECT_EQ(utfcpp::utf8_to_16_batch(utf8_values, offsets64).values, batch16.values);
+
+    const std::u16string invalid16 = std::u16string(u"aл") + char16_t(0xdc00);
+    const std::vector<std::u16string_view> utf16_strings {u"aл水", invalid16, u"𐌀"};
+    const utfcpp::utf8_batch batch8 = utfcpp::utf16_to_8_batch(utf16_strings);
+    EXPECT_EQ(batch8.values, u8"aл水𐌀");
+    EXPECT_TRUE(batch8.offsets == std::vector<size_t>({0, 6, 6, 10}));
+    EXPECT_TRUE(batch8.results[1].status == utfcpp::conversion_status::invalid_lead);
+    EXPECT_EQ(batch8.results[1].position, 2);
+    const std::vector<int32_t> offsets16 {0, 3, 3};
+    const utfcpp::utf8_batch values8 = utfcpp::utf16_to_8_batch(u"aл水", offsets16);
+    EXPECT_EQ(values8.values, u8"aл水");
+    EXPECT_TRUE(values8.offsets == std::vector<size_t>({0, 6, 6}));
+    const std::vector<int32_t> valid_offsets16 {0, 2, 4, 5};
+    const utfcpp::utf8_batch valid8 = utfcpp::utf16_to_8_batch(u"𐌀𐌀a", valid_offsets16);
+    EXPECT_TRUE(valid8.offsets == std::vector<size_t>({0, 4, 8, 9}));
+    EXPECT_EQ(valid8.results[1].written, 4);
+
+    // Valid values with an offset inside a sequence: both strings around it are invalid
+    const std::vector<int32_t> split_offsets {0, 2, 4};
+    const utfcpp::utf16_batch split16 = utfcpp::utf8_to_16_batch(u8"水a", split_offsets);
+    EXPECT_EQ(split16.values, u"");
+    EXPECT_TRUE(split16.results[0].status == utfcpp::conversion_status::incomplete_sequence);
+    EXPECT_TRUE(split16.results[1].status == utfcpp::conversion_status::invalid_lead);
+    const std::vector<int32_t> split_offsets16 {0, 1, 2};
+    EXPECT_TRUE(utfcpp::utf16_to_8_batch(u"𐌀", split_offsets16).results[1].status != utfcpp::conversion_status::ok);
+
+    EXPECT_TRUE(utfcpp::utf8_to_16_batch(std::span<const std::u8string_view>{}).offsets == std::vector<size_t>({0}));
+    EXPECT_TRUE(utfcpp::utf8_to_16_batch(u8"", std::span<const int32_t>{}).offsets == std::vector<size_t>({0}));
+    const std::vector<int32_t> bad_offsets {0, 4, 2};
+    EXPECT_THROW(utfcpp::utf8_to_16_batch(u8"abcd", bad_offsets), std::invalid_argument);
+}
+
+TEST(UtfTests, test_utf8_to_16_replace)
+{
+    using utfcpp::error_mode;
+    EXPECT_EQ(utfcpp::utf8_to_16(u8"aл水手𐌀", error_mode::replace), u"aл水手𐌀");
+
+    // Each maximal subpart becomes one U+FFFD (the examples from the Unicode Standard, 3.9)
+    const char8_t mixed[] = {0x61, 0xf1, 0x80, 0x80, 0xe1, 0x80, 0xc2, 0x62, 0x80, 0x63, 0x80, 0xbf, 0x64, 0};
+    EXPECT_EQ(utfcpp::utf8_to_16(mixed, error_mode::replace), u"a\ufffd\ufffd\ufffdb\ufffdc\ufffd\ufffdd");
+    const char8_t non_shortest[] = {0xc0, 0xaf, 0xe0, 0x80, 0xbf, 0xf0, 0x81, 0x82, 0x41, 0};
+    EXPECT_EQ(utfcpp::utf8_to_16(non_shortest, error_mode::replace), std::u16string(8, u'\ufffd') + u"A");
+    const char8_t surrogates[] = {0xed, 0xa0, 0x80, 0xed, 0xbf, 0xbf, 0xed, 0xaf, 0x41, 0};
+    EXPECT_EQ(utfcpp::utf8_to_16(surrogates, error_mode::replace), std::u16string(8, u'\ufffd') + u"A");
+    const char8_t other[] = {0xf4, 0x91, 0x92, 0x93, 0xff, 0x41, 0x80, 0xbf, 0x42, 0};
+    EXPECT_EQ(utfcpp::utf8_to_16(other, error_mode::replace), u"\ufffd\ufffd\ufffd\ufffd\ufffdA\ufffd\ufffdB");
+    const char8_t truncated[] = {0xe1, 0x80, 0xe2, 0xf0, 0x91, 0x92, 0xf1, 0xbf, 0x41, 0};
+    EXPECT_EQ(utfcpp::utf8_to_16(truncated, error_mode::replace), u"\ufffd\ufffd\ufffd\ufffdA");
+
+    // Stray trail bytes need more room than the valid input would
+    EXPECT_EQ(utfcpp::utf8_to_16(std::u8string(100, 0x80), error_mode::replace), std::u16string(100, u'\ufffd'));
+    EXPECT_THROW(utfcpp::utf8_to_16(mixed, error_mode::throw_exception), utfcpp::exception);
+}
+
+TEST(UtfTests, test_utf8_to_16_parallel)
+{
+    std::u8string utf8;
+    for (int i = 0; i < 200; ++i)
+        utf8 += (i % 3) ? u8"Long ASCII text, then Ћирилица 水手" : u8"𐌀𐌁𐌂";
+    const utfcpp::parallel_policy policy {4, 64};
+    EXPECT_EQ(utfcpp::utf8_to_16(utf8, policy), utfcpp::utf8_to_16(utf8));
+    EXPECT_EQ(utfcpp::utf8_to_16(u8"aл水手𐌀", policy), u"aл水手𐌀");
+    EXPECT_EQ(utfcpp::utf8_to_16(utf8, utfcpp::parallel_policy{}), utfcpp::utf8_to_16(utf8));
+
+    // Errors anywhere, including next to chunk boundaries, are reported as without threads
+    for (size_t pos = 0; pos < utf8.size(); pos += 7) {
+        for (char8_t invalid : {char8_t(0x80), char8_t(0xc0), char8_t(0xe6), char8_t(0xf4)}) {
+            std::u8string broken {utf8};
+            broken[pos] = invalid;
+            std::string expected, actual;
+            try {
+                utfcpp::utf8_to_16(broken);
+            } catch (const utfcpp::exception_with_position& e) {
+                expected = e.what();
+            }
+            try {
+                utfcpp::utf8_to_16(broken, policy);
+            } catch (const utfcpp::exception_with_position& e) {
+                actual = e.what();
+            }
+            EXPECT_EQ(actual, expected);
+        }
+    }
+}
+
+TEST(UtfTests, test_utf16_to_8_replace)
+{
+    using utfcpp::error_mode;
+    EXPECT_EQ(utfcpp::utf16_to_8(u"aл水手𐌀", error_mode::replace), u8"aл水手𐌀");
+
+    // Lone trail, lead followed by a non-trail, lead followed by a lead, lead at the end
+    const std::u16string invalid = std::u16string(u"a") + char16_t(0xdc00) + u'b' + char16_t(0xd800) + u'c'
+                                 + char16_t(0xd800) + u"𐌀" + char16_t(0xdbff);
+    EXPECT_EQ(utfcpp::utf16_to_8(invalid, error_mode::replace), u8"a\ufffdb\ufffdc\ufffd𐌀\ufffd");
+    EXPECT_EQ(utfcpp::utf16_to_8(std::u16string(100, char16_t(0xdc00)), error_mode::replace),
+              utfcpp::utf16_to_8(std::u16string(100, u'\ufffd')));
+    EXPECT_THROW(utfcpp::utf16_to_8(invalid, error_mode::throw_exception), utfcpp::exception);
+}
+
+TEST(UtfTests, test_sanitize_utf8)
+{
+    EXPECT_EQ(utfcpp::sanitize_utf8(u8""), u8"");
+    EXPECT_EQ(utfcpp::sanitize_utf8(u8"aл水手𐌀"), u8"aл水手𐌀");
+
+    const char8_t mixed[] = {0x61, 0xf1, 0x80, 0x80, 0xe1, 0x80, 0xc2, 0x62, 0x80, 0x63, 0x80, 0xbf, 0x64, 0};
+    EXPECT_EQ(utfcpp::sanitize_utf8(mixed), u8"a\ufffd\ufffd\ufffdb\ufffdc\ufffd\ufffdd");
+
+    // The result is valid and converts like the lossy conversion, for errors in a long string
+    std::u8string str;
+    for (int i = 0; i < 100; ++i)
+        str += (i % 7) ? u8"шн𐌀 text " : u8"\xed\xa0\x80\xe6\x97";
+    const std::u8string sanitized = utfcpp::sanitize_utf8(str);
+    EXPECT_TRUE(utfcpp::is_valid_utf8(sanitized));
+    EXPECT_EQ(utfcpp::utf8_to_16(sanitized), utfcpp::utf8_to_16(str, utfcpp::error_mode::replace));
+}
+
+TEST(UtfTests, test_utf32_conversions)
+{
+    const std::u32string utf32 {U"aл水手𐌀 шницла 𐌀𐌀"};
+    EXPECT_EQ(utfcpp::utf8_to_32(u8"aл水手𐌀 шницла 𐌀𐌀"), utf32);
+    EXPECT_EQ(utfcpp::utf16_to_32(u"aл水手𐌀 шницла 𐌀𐌀"), utf32);
+    EXPECT_EQ(utfcpp::utf32_to_8(utf32), u8"aл水手𐌀 шницла 𐌀𐌀");
+    EXPECT_EQ(utfcpp::utf32_to_16(utf32), u"aл水手𐌀 шницла 𐌀𐌀");
+    EXPECT_EQ(utfcpp::utf8_to_32(u8""), U"");
+    EXPECT_EQ(utfcpp::utf32_to_8(U""), u8"");
+
+    // Long enough for the vector kernels, with runs of ASCII, BMP and supplementary code points
+    std::u32string long_utf32;
+    for (int i = 0; i < 100; ++i)
+        long_utf32 += (i % 3) ? U"Long ASCII text, then Ћирилица 水手" : U"𐌀𐌁𐌂";
+    const std::u8string long_utf8 = utfcpp::utf32_to_8(long_utf32);
+    const std::u16string long_utf16 = utfcpp::utf32_to_16(long_utf32);
+    EXPECT_EQ(long_utf8, utfcpp::utf16_to_8(long_utf16));
+    EXPECT_EQ(utfcpp::utf8_to_32(long_utf8), long_utf32);
+    EXPECT_EQ(utfcpp::utf16_to_32(long_utf16), long_utf32);
+}
+
+TEST(UtfTests, test_utf32_conversion_errors)
+{
+    // Errors in UTF-8 and UTF-16 are reported at the same positions as by the UTF-16 and UTF-8 conversions
+    const char8_t invalid8[] = {0x61, 0xd1, 0x88, 0xed, 0xa0, 0x80, 0};
+    try {
+        utfcpp::utf8_to_32(invalid8);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 3);
+    }
+    const std::u16string invalid16 = std::u16string(u"aл") + char16_t(0xdc00);
+    EXPECT_THROW(utfcpp::utf16_to_32(invalid16), utfcpp::exception_with_position);
+
+    // Surrogates and values above U+10FFFF are invalid in UTF-32
+    for (char32_t invalid : {U'\xd800', U'\xdfff', char32_t(0x110000), char32_t(0xffffffff)}) {
+        std::u32string str(40, U'a');
+        str += invalid;
+        try {
+            utfcpp::utf32_to_8(str);
+            EXPECT_TRUE(false); // Expected exception_with_position
+        } catch (const utfcpp::exception_with_position& e) {
+            EXPECT_EQ(e.position(), 40);
+        }
+        try {
+            utfcpp::utf32_to_16(str);
+            EXPECT_TRUE(false); // Expected exception_with_position
+        } catch (const utfcpp::exception_with_position& e) {
+            EXPECT_EQ(e.position(), 40);
+        }
+    }
+}
+
+TEST(UtfTests, test_encode_utf8_utf16)
+{
+    const std::vector<char32_t> code_points {U'a', U'л', U'水', U'𐌀'};
+    std::u8string utf8 {u8"prefix "};
+    utfcpp::encode_utf8(code_points, utf8);
+    EXPECT_EQ(utf8, u8"prefix aл水𐌀");
+    std::u16string utf16 {u"prefix "};
+    utfcpp::encode_utf16(code_points, utf16);
+    EXPECT_EQ(utf16, u"prefix aл水𐌀");
+
+    // Invalid code points throw and leave the string unchanged
+    const std::vector<char32_t> invalid {U'a', U'л', char32_t(0xd800)};
+    try {
+        utfcpp::encode_utf8(invalid, utf8);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 2);
+    }
+    EXPECT_EQ(utf8, u8"prefix aл水𐌀");
+    EXPECT_THROW(utfcpp::encode_utf16(invalid, utf16), utfcpp::exception_with_position);
+    EXPECT_EQ(utf16, u"prefix aл水𐌀");
+}
+
+TEST(UtfTests, test_latin1_conversions)
+{
+    // "Zürich café" in Latin-1, long enough for the vector kernels
+    const std::string latin1 = std::string("Z\xfcrich caf\xe9 ") + std::string(40, '\xa0') + "end";
+    std::u8string expected8 = u8"Zürich café ";
+    for (int i = 0; i < 40; ++i)
+        expected8 += u8"\u00a0";
+    expected8 += u8"end";
+    EXPECT_EQ(utfcpp::latin1_to_utf8(latin1), expected8);
+    EXPECT_EQ(utfcpp::utf8_length_from_latin1(latin1), expected8.size());
+    EXPECT_EQ(utfcpp::latin1_length_from_utf8(expected8), latin1.size());
+    EXPECT_EQ(utfcpp::utf8_to_latin1(expected8), latin1);
+    const std::u16string utf16 = utfcpp::latin1_to_utf16(latin1);
+    EXPECT_EQ(utf16, utfcpp::utf8_to_16(expected8));
+    EXPECT_EQ(utfcpp::utf16_to_latin1(utf16), latin1);
+    EXPECT_EQ(utfcpp::latin1_to_utf8(""), u8"");
+    EXPECT_EQ(utfcpp::utf8_to_latin1(u8""), "");
+
+    // Code points above U+00FF are not representable
+    try {
+        utfcpp::utf8_to_latin1(u8"caf\u00e9 \u0160");
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 6);
+        EXPECT_EQ(std::string(e.what()), std::string("Code point not representable 6"));
+    }
+    try {
+        utfcpp::utf16_to_latin1(u"caf\u00e9 \u0160");
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 5);
+    }
+    // Invalid input is reported as by the other conversions
+    const char8_t invalid8[] = {0x61, 0xc3, 0xa9, 0xed, 0xa0, 0x80, 0};
+    try {
+        utfcpp::utf8_to_latin1(invalid8);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 3);
+        EXPECT_EQ(std::string(e.what()), std::string("Invalid code point 3"));
+    }
+
+    // The lossy conversions replace code points above U+00FF and invalid sequences with '?'
+    EXPECT_EQ(utfcpp::utf8_to_latin1(u8"caf\u00e9 \u0160\U00010300.", utfcpp::error_mode::replace), "caf\xe9 ??.");
+    EXPECT_EQ(utfcpp::utf8_to_latin1(invalid8, utfcpp::error_mode::replace), "a\xe9???");
+    const std::u16string invalid16 = std::u16string(u"\u00e9\u0160\U00010300") + char16_t(0xdc00) + u"x" + char16_t(0xd800);
+    EXPECT_EQ(utfcpp::utf16_to_latin1(invalid16, utfcpp::error_mode::replace), "\xe9???x?");
+    EXPECT_THROW(utfcpp::utf16_to_latin1(invalid16, utfcpp::error_mode::throw_exception), utfcpp::exception_with_position);
+}
+
+TEST(UtfTests, test_is_valid_utf8)
+{
+    EXPECT_TRUE(utfcpp::is_valid_utf8(u8""));
+    EXPECT_TRUE(utfcpp::is_valid_utf8(u8"aл水手𐌀"));
+
+    const char utf8_invalid[] = "\xe6\x97\xa5\xd1\x88\xfa";
+    std::u8string_view invalid_view(reinterpret_cast<const char8_t*>(utf8_invalid), strlen(utf8_invalid));
+    EXPECT_TRUE(!utfcpp::is_valid_utf8(invalid_view));
+
+    // Missing trail byte
+    const char missing_trail[] = "\xd1" "A";
+    EXPECT_TRUE(!utfcpp::is_valid_utf8(reinterpret_cast<const char8_t*>(missing_trail)));
+}
+
+TEST(UtfTests, test_find_invalid_utf8)
+{
+    EXPECT_EQ(utfcpp::find_invalid_utf8(u8"aл水手𐌀"), std::u8string_view::npos);
+
+    const char utf8_invalid[] = "\xe6\x97\xa5\xd1\x88\xfa";
+    std::u8string_view invalid_view(reinterpret_cast<const char8_t*>(utf8_invalid), strlen(utf8_invalid));
+    EXPECT_EQ(utfcpp::find_invalid_utf8(invalid_view), 5);
+
+    // The position matches the one reported by the conversion, for errors
+    // anywhere in a long string
+    const std::u8string invalid_sequences[] = {
+        {0x80}, {0xc0, 0x80}, {0xe0, 0x9f, 0xbf}, {0xed, 0xbf, 0xbf}, {0xf0, 0x8f, 0xbf, 0xbf},
+        {0xf4, 0x90, 0x80, 0x80}, {0xf5, 0x80, 0x80, 0x80}, {0xe6, 0x97}, {0xf8, 0x88, 0x80, 0x80, 0x80}
+    };
+    for (const auto& invalid : invalid_sequences) {
+        std::u8string str;
+        for (int i = 0; i < 40; ++i) {
+            const std::u8string bad = str + invalid + u8"xyz";
+            const size_t expected_pos = str.size();
+            EXPECT_TRUE(!utfcpp::is_valid_utf8(bad));
+            EXPECT_EQ(utfcpp::find_invalid_utf8(bad), expected_pos);
+            try {
+                utfcpp::utf8_to_16(bad);
+                EXPECT_TRUE(false); // Expected exception_with_position
+            } catch (const utfcpp::exception& e) {
+                EXPECT_EQ(e.position(), expected_pos);
+            }
+            str += (i % 2) ? u8"a" : u8"шн𐌀";
+        }
+    }
+}
+
+TEST(UtfTests, test_utf16_length_from_utf8)
+{
+    using namespace utfcpp;
+    EXPECT_EQ(utf16_length_from_utf8(u8""), 0);
+    EXPECT_EQ(utf16_length_from_utf8(u8"abcdxyz"), 7);
+    EXPECT_EQ(utf16_length_from_utf8(u8"шницла"), 6);
+    EXPECT_EQ(utf16_length_from_utf8(u8"水手"), 2);
+    EXPECT_EQ(utf16_length_from_utf8(u8"𐌀"), 2);
+
+    std::u8string long_string;
+    for (int i = 0; i < 100; ++i)
+        long_string += u8"Mixed шницла 水手 𐌀 text";
+    EXPECT_EQ(utf16_length_from_utf8(long_string), utf8_to_16(long_string).size());
+}
+
+TEST(UtfTests, test_utf8_length_from_utf16)
+{
+    using namespace utfcpp;
+    EXPECT_EQ(utf8_length_from_utf16(u""), 0);
+    EXPECT_EQ(utf8_length_from_utf16(u"A valid ascii string"), 20);
+    EXPECT_EQ(utf8_length_from_utf16(u"Ћирилица"), 16);
+    EXPECT_EQ(utf8_length_from_utf16(u"水手"), 6);
+    EXPECT_EQ(utf8_length_from_utf16(u"𐌀"), 4);
+
+    std::u16string long_string;
+    for (int i = 0; i < 100; ++i)
+        long_string += u"Mixed Ћирилица 水手 𐌀 text";
+    EXPECT_EQ(utf8_length_from_utf16(long_string), utf16_to_8(long_string).size());
+}
+
+TEST(UtfTests, test_count_code_points)
+{
+    using namespace utfcpp;
+    EXPECT_EQ(count_code_points(u8""), 0);
+    EXPECT_EQ(count_code_points(u8"шницла"), 6);
+    EXPECT_EQ(count_code_points(u8"水手 𐌀"), 4);
+    EXPECT_EQ(count_code_points(u""), 0);
+    EXPECT_EQ(count_code_points(u"Ћирилица"), 8);
+    EXPECT_EQ(count_code_points(u"水手 𐌀"), 4);
+
+    std::u8string long_string;
+    for (int i = 0; i < 100; ++i)
+        long_string += u8"шницла 𐌀 ";
+    EXPECT_EQ(count_code_points(long_string), 900);
+    EXPECT_EQ(count_code_points(utf8_to_16(long_string)), 900);
+}
+
+TEST(UtfTests, test_utf8_to_16_stream)
+{
+    const std::u8string utf8 {u8"aл水手𐌀 шницла 𐌀𐌀"};
+    const std::u16string expected {utfcpp::utf8_to_16(utf8)};
+    const std::u8string_view view {utf8};
+
+    // Split into two chunks at every position, including inside sequences
+    utfcpp::utf8_to_16_stream stream;
+    for (size_t split = 0; split <= utf8.size(); ++split) {
+        std::u16string utf16;
+        stream.feed(view.substr(0, split), utf16);
+        stream.feed(view.substr(split), utf16);
+        stream.finish();
+        EXPECT_EQ(utf16, expected);
+    }
+
+    // One byte at a time
+    std::u16string utf16;
+    for (char8_t byte : utf8)
+        stream.feed(std::u8string_view(&byte, 1), utf16);
+    stream.finish();
+    EXPECT_EQ(utf16, expected);
+}
+
+TEST(UtfTests, test_utf8_to_16_stream_errors)
+{
+    // Errors are reported at the positions utf8_to_16 reports, wherever the input is split
+    const std::u8string invalid_sequences[] = {
+        {0x80}, {0xc0, 0x80}, {0xe0, 0x9f, 0xbf}, {0xed, 0xbf, 0xbf}, {0xf4, 0x90, 0x80, 0x80},
+        {0xe6, 0x97}, {0xf0, 0x9f, 0x98}
+    };
+    for (const auto& invalid : invalid_sequences) {
+        const std::u8string bad = u8"ab𐌀" + invalid + u8"xyz";
+        for (size_t split = 0; split <= bad.size(); ++split) {
+            utfcpp::utf8_to_16_stream stream;
+            std::u16string utf16;
+            const utfcpp::conversion_result first = stream.try_feed(std::u8string_view(bad).substr(0, split), utf16);
+            const utfcpp::conversion_result result = (first.status == utfcpp::conversion_status::ok) ?
+                stream.try_feed(std::u8string_view(bad).substr(split), utf16) : first;
+            EXPECT_TRUE(result.status != utfcpp::conversion_status::ok);
+            EXPECT_EQ(result.position, 6);
+            EXPECT_EQ(utf16, u"ab𐌀");
+        }
+    }
+
+    // A sequence cut off at the end of the stream is only an error at finish
+    utfcpp::utf8_to_16_stream stream;
+    std::u16string utf16;
+    stream.feed(u8"ab\xe6\x97", utf16);
+    EXPECT_EQ(utf16, u"ab");
+    try {
+        stream.finish();
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 2);
+    }
+
+    // The stream is reset after finish, and feed leaves the output unchanged on error
+    stream.feed(u8"a", utf16);
+    EXPECT_THROW(stream.feed(u8"b\x80", utf16), utfcpp::exception_with_position);
+    EXPECT_EQ(utf16, u"aba");
+    stream.reset();
+    EXPECT_TRUE(stream.try_finish().status == utfcpp::conversion_status::ok);
+}
+
+TEST(UtfTests, test_utf16_to_8_stream)
+{
+    const std::u16string utf16 {u"aл水手𐌀 шницла 𐌀𐌀"};
+    const std::u8string expected {utfcpp::utf16_to_8(utf16)};
+    const std::u16string_view view {utf16};
+
+    utfcpp::utf16_to_8_stream stream;
+    for (size_t split = 0; split <= utf16.size(); ++split) {
+        std::u8string utf8;
+        stream.feed(view.substr(0, split), utf8);
+        stream.feed(view.substr(split), utf8);
+        stream.finish();
+        EXPECT_EQ(utf8, expected);
+    }
+
+    std::u8string utf8;
+    for (char16_t unit : utf16)
+        stream.feed(std::u16string_view(&unit, 1), utf8);
+    stream.finish();
+    EXPECT_EQ(utf8, expected);
+}
+
+TEST(UtfTests, test_utf16_to_8_stream_errors)
+{
+    // A lead surrogate followed by a non-trail, and a lone trail surrogate
+    const std::u16string invalid_sequences[] = {{0xd800, u'x'}, {0xdc00}};
+    for (const auto& invalid : invalid_sequences) {
+        const std::u16string bad = u"ab𐌀" + invalid + u"xyz";
+        size_t expected_pos{0};
+        try {
+            utfcpp::utf16_to_8(bad);
+        } catch (const utfcpp::exception_with_position& e) {
+            expected_pos = e.position();
+        }
+        for (size_t split = 0; split <= bad.size(); ++split) {
+            utfcpp::utf16_to_8_stream stream;
+            std::u8string utf8;
+            const utfcpp::conversion_result first = stream.try_feed(std::u16string_view(bad).substr(0, split), utf8);
+            const utfcpp::conversion_result result = (first.status == utfcpp::conversion_status::ok) ?
+                stream.try_feed(std::u16string_view(bad).substr(split), utf8) : first;
+            EXPECT_TRUE(result.status != utfcpp::conversion_status::ok);
+            EXPECT_EQ(result.position, expected_pos);
+            EXPECT_EQ(utf8, u8"ab𐌀");
+        }
+    }
+
+    utfcpp::utf16_to_8_stream stream;
+    std::u8string utf8;
+    const char16_t lead[] {0xd800, 0};
+    stream.feed(lead, utf8);
+    EXPECT_EQ(utf8, u8"");
+    const utfcpp::conversion_result result = stream.try_finish();
+    EXPECT_TRUE(result.status == utfcpp::conversion_status::incomplete_sequence);
+    EXPECT_EQ(result.position, 1);
+}
+
+template <typename Char>
+static void write_file(const std::filesystem::path& path, std::basic_string_view<Char> content)
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size() * sizeof(Char)));
+}
+
+template <typename Char>
+static std::basic_string<Char> read_file(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    const std::string bytes {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    std::basic_string<Char> content(bytes.size() / sizeof(Char), Char{});
+    std::copy_n(bytes.data(), content.size() * sizeof(Char), reinterpret_cast<char*>(content.data()));
+    return content;
+}
+
+TEST(UtfTests, test_transcode_file)
+{
+    // The host is assumed little endian, so UTF-16LE files hold the units of a std::u16string
+    const std::filesystem::path dir = std::filesystem::temp_directory_path();
+    const std::filesystem::path utf8_path = dir / "utfcpp20_test_utf8.txt";
+    const std::filesystem::path utf16_path = dir / "utfcpp20_test_utf16.txt";
+    const std::filesystem::path out_path = dir / "utfcpp20_test_out.txt";
+
+    // More than a block of input, so that sequences are split between blocks
+    std::u8string utf8;
+    while (utf8.size() < 3'000'000)
+        utf8 += u8"Long ASCII text, then Ћирилица 水手 𐌀";
+    write_file<char8_t>(utf8_path, utf8);
+    utfcpp::transcode_file(utf8_path, utf16_path, utfcpp::file_encoding::utf8, utfcpp::file_encoding::utf16le);
+    EXPECT_TRUE(read_file<char16_t>(utf16_path) == utfcpp::utf8_to_16(utf8));
+    utfcpp::transcode_file(utf16_path, out_path, utfcpp::file_encoding::utf16le, utfcpp::file_encoding::utf8);
+    EXPECT_TRUE(read_file<char8_t>(out_path) == utf8);
+    utfcpp::validate_file(utf8_path, utfcpp::file_encoding::utf8);
+    utfcpp::validate_file(utf16_path, utfcpp::file_encoding::utf16le);
+
+    write_file<char8_t>(utf8_path, u8"");
+    utfcpp::transcode_file(utf8_path, out_path, utfcpp::file_encoding::utf8, utfcpp::file_encoding::utf16le);
+    EXPECT_TRUE(read_file<char16_t>(out_path).empty());
+
+    // Errors are reported at the positions the converters report, and the output is removed
+    const char8_t invalid8[] = {0x61, 0xd1, 0x88, 0xed, 0xa0, 0x80, 0};
+    write_file<char8_t>(utf8_path, invalid8);
+    for (utfcpp::file_encoding to : {utfcpp::file_encoding::utf16le, utfcpp::file_encoding::utf8}) {
+        try {
+            utfcpp::transcode_file(utf8_path, out_path, utfcpp::file_encoding::utf8, to);
+            EXPECT_TRUE(false); // Expected exception_with_position
+        } catch (const utfcpp::exception_with_position& e) {
+            EXPECT_EQ(e.position(), 3);
+        }
+        EXPECT_TRUE(!std::filesystem::exists(out_path));
+    }
+    EXPECT_THROW(utfcpp::validate_file(utf8_path, utfcpp::file_encoding::utf8), utfcpp::exception_with_position);
+
+    const std::u16string invalid16 = std::u16string(u"aл") + char16_t(0xdc00);
+    write_file<char16_t>(utf16_path, invalid16);
+    try {
+        utfcpp::validate_file(utf16_path, utfcpp::file_encoding::utf16le);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 2);
+    }
+
+    // A byte left over at the end of UTF-16 is an incomplete code unit
+    write_file<char8_t>(utf16_path, std::u8string_view(u8"a\0b", 3));
+    try {
+        utfcpp::transcode_file(utf16_path, out_path, utfcpp::file_encoding::utf16le, utfcpp::file_encoding::utf8);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 1);
+    }
+
+    // Validation reports the errors conversion does: an unpaired trail surrogate, a lead surrogate
+    // followed by another unit or by the end of input, and a byte left over
+    const std::u8string_view invalid16le[] = {
+        std::u8string_view(u8"a\0\x00\xdc", 4),
+        std::u8string_view(u8"a\0\x00\xd8" u8"b\0", 6),
+        std::u8string_view(u8"a\0\x00\xd8", 4),
+        std::u8string_view(u8"a\0\x00\xd8\x00\xdc" u8"b", 7),
+    };
+    for (std::u8string_view bytes : invalid16le) {
+        write_file<char8_t>(utf16_path, bytes);
+        size_t converted_position{0};
+        std::string converted_message;
+        try {
+            utfcpp::transcode_file(utf16_path, out_path, utfcpp::file_encoding::utf16le, utfcpp::file_encoding::utf8);
+            EXPECT_TRUE(false); // Expected exception_with_position
+        } catch (const utfcpp::exception_with_position& e) {
+            converted_position = e.position();
+            converted_message = e.what();
+        }
+        try {
+            utfcpp::validate_file(utf16_path, utfcpp::file_encoding::utf16le);
+            EXPECT_TRUE(false); // Expected exception_with_position
+        } catch (const utfcpp::exception_with_position& e) {
+            EXPECT_EQ(e.position(), converted_position);
+            EXPECT_EQ(std::string(e.what()), converted_message);
+        }
+    }
+
+    EXPECT_THROW(utfcpp::transcode_file(utf8_path, utf8_path, utfcpp::file_encoding::utf8, utfcpp::file_encoding::utf8),
+                 std::filesystem::filesystem_error);
+    EXPECT_THROW(utfcpp::validate_file(dir / "utfcpp20_test_missing.txt", utfcpp::file_encoding::utf8),
+                 std::filesystem::filesystem_error);
+
+    std::filesystem::remove(utf8_path);
+    std::filesystem::remove(utf16_path);
+    std::filesystem::remove(out_path);
+}
+
 TEST(u8_iteratorTests, test_iterator_construction)
 {
     const std::u8string_view empty_view{u8""};
@@ -169,4 +926,463 @@ TEST(u8_iteratorTests, test_invalid_utf8_sequences)
     EXPECT_THROW(utfcpp::utf8_to_16(surrogate_view), utfcpp::exception);
 }
 
+TEST(u8_iteratorTests, test_iterator_replace)
+{
+    using utfcpp::u8_iterator, utfcpp::error_mode;
+    const char8_t mixed[] = {0x61, 0xf1, 0x80, 0x80, 0xe1, 0x80, 0xc2, 0x62, 0};
+    const std::u8string_view view {mixed};
+    std::u32string decoded;
+    for (auto it = u8_iterator::begin(view, error_mode::replace); it != u8_iterator::end(view); ++it)
+        decoded += *it;
+    EXPECT_EQ(decoded, U"a\ufffd\ufffd\ufffdb");
+}
+
+TEST(u8_iteratorTests, test_iterator_decrement)
+{
+    std::u8string_view mixed{u8"aл水𐌀b"};
+    utfcpp::u8_iterator it{utfcpp::u8_iterator::end(mixed)};
+    EXPECT_EQ(*(--it), U'b');
+    EXPECT_EQ(*(it--), U'b');
+    EXPECT_EQ(*it, U'𐌀');
+    EXPECT_EQ(*(--it), U'水');
+    EXPECT_EQ(*(--it), U'л');
+    EXPECT_EQ(*(--it), U'a');
+    EXPECT_EQ(it, utfcpp::u8_iterator::begin(mixed));
+    EXPECT_EQ(*(++it), U'л');
+
+    // Backward iteration over invalid input throws, or visits the same positions as forward iteration
+    const char8_t invalid[] = {0x61, 0x80, 0xf0, 0x80, 0x80, 0xe2, 0x82, 0xd1, 0x88, 0x80, 0};
+    const std::u8string_view invalid_view{invalid};
+    it = utfcpp::u8_iterator::end(invalid_view);
+    EXPECT_THROW(--it, utfcpp::exception);
+    EXPECT_EQ(it, utfcpp::u8_iterator::end(invalid_view));
+
+    using utfcpp::error_mode;
+    std::vector<utfcpp::u8_iterator> forward;
+    for (auto fwd = utfcpp::u8_iterator::begin(invalid_view, error_mode::replace); fwd != std::default_sentinel; ++fwd)
+        forward.push_back(fwd);
+    EXPECT_EQ(forward.size(), 8);
+    it = utfcpp::u8_iterator::end(invalid_view, error_mode::replace);
+    for (auto fwd = forward.rbegin(); fwd != forward.rend(); ++fwd) {
+        --it;
+        EXPECT_EQ(it, *fwd);
+        EXPECT_EQ(*it, **fwd);
+    }
+}
+
+TEST(u8_viewTests, test_view)
+{
+    static_assert(std::bidirectional_iterator<utfcpp::u8_iterator>);
+    static_assert(std::ranges::bidirectional_range<utfcpp::u8_view>);
+    static_assert(std::ranges::view<utfcpp::u8_view>);
+    static_assert(std::ranges::borrowed_range<utfcpp::u8_view>);
+
+    EXPECT_TRUE(utfcpp::u8_view{}.empty());
+    EXPECT_TRUE(utfcpp::u8_view{u8""}.empty());
+
+    const utfcpp::u8_view view{u8"aл水𐌀b"};
+    std::u32string decoded;
+    for (char32_t cp : view)
+        decoded += cp;
+    EXPECT_EQ(decoded, U"aл水𐌀b");
+
+    EXPECT_EQ(std::ranges::distance(view), 5);
+    EXPECT_EQ(std::ranges::count_if(view, [](char32_t cp) { return cp > 0xffff; }), 1);
+    EXPECT_EQ(*std::ranges::find(view, U'水'), U'水');
+    EXPECT_TRUE(std::ranges::find(view, U'w') == std::default_sentinel);
+
+    std::u32string reversed;
+    for (char32_t cp : view | std::views::reverse)
+        reversed += cp;
+    EXPECT_EQ(reversed, U"b𐌀水лa");
+
+    std::u32string replaced;
+    const char8_t invalid[] = {0x61, 0x80, 0x62, 0};
+    for (char32_t cp : utfcpp::u8_view{invalid, utfcpp::error_mode::replace})
+        replaced += cp;
+    EXPECT_EQ(replaced, U"a\ufffdb");
+}
+
+TEST(u16_iteratorTests, test_iterator_iteration)
+{
+    const std::u16string_view empty_view{u""};
+    EXPECT_EQ(utfcpp::u16_iterator::begin(empty_view), utfcpp::u16_iterator::end(empty_view));
+
+    std::u16string_view mixed{u"aл水𐌀b"};
+    utfcpp::u16_iterator it{utfcpp::u16_iterator::begin(mixed)};
+    EXPECT_EQ(*it, U'a');
+    EXPECT_EQ(*(++it), U'л');
+    EXPECT_EQ(*(it++), U'л');
+    EXPECT_EQ(*it, U'水');
+    EXPECT_EQ(*(++it), U'𐌀');
+    EXPECT_EQ(*(++it), U'b');
+    EXPECT_EQ(++it, utfcpp::u16_iterator::end(mixed));
+    EXPECT_TRUE(it == std::default_sentinel);
+
+    EXPECT_EQ(*(--it), U'b');
+    EXPECT_EQ(*(it--), U'b');
+    EXPECT_EQ(*it, U'𐌀');
+    EXPECT_EQ(*(--it), U'水');
+    EXPECT_EQ(*(--it), U'л');
+    EXPECT_EQ(*(--it), U'a');
+    EXPECT_EQ(it, utfcpp::u16_iterator::begin(mixed));
+
+    auto found = std::find(utfcpp::u16_iterator::begin(mixed), utfcpp::u16_iterator::end(mixed), U'𐌀');
+    EXPECT_EQ(*found, U'𐌀');
+}
+
+TEST(u16_iteratorTests, test_invalid_utf16_sequences)
+{
+    // Lone trail, lead followed by a lead, lead at the end
+    const std::u16string invalid = std::u16string(u"a") + char16_t(0xdc00) + char16_t(0xd800) + u"𐌀"
+                                 + char16_t(0xdbff);
+    EXPECT_THROW({
+        utfcpp::u16_iterator it = utfcpp::u16_iterator::begin(invalid);
+        (void)*(++it);
+    }, utfcpp::exception);
+    utfcpp::u16_iterator it = utfcpp::u16_iterator::end(invalid);
+    EXPECT_THROW(--it, utfcpp::exception);
+    EXPECT_EQ(it, utfcpp::u16_iterator::end(invalid));
+
+    // Backward iteration in the replace mode visits the same positions as forward iteration
+    using utfcpp::error_mode;
+    std::vector<utfcpp::u16_iterator> forward;
+    std::u32string decoded;
+    for (auto fwd = utfcpp::u16_iterator::begin(invalid, error_mode::replace); fwd != std::default_sentinel; ++fwd) {
+        forward.push_back(fwd);
+        decoded += *fwd;
+    }
+    EXPECT_EQ(decoded, U"a\ufffd\ufffd𐌀\ufffd");
+    it = utfcpp::u16_iterator::end(invalid, error_mode::replace);
+    for (auto fwd = forward.rbegin(); fwd != forward.rend(); ++fwd) {
+        --it;
+        EXPECT_EQ(it, *fwd);
+        EXPECT_EQ(*it, **fwd);
+    }
+}
+
+TEST(u16_viewTests, test_view)
+{
+    static_assert(std::bidirectional_iterator<utfcpp::u16_iterator>);
+    static_assert(std::ranges::bidirectional_range<utfcpp::u16_view>);
+    static_assert(std::ranges::view<utfcpp::u16_view>);
+    static_assert(std::ranges::borrowed_range<utfcpp::u16_view>);
+
+    EXPECT_TRUE(utfcpp::u16_view{}.empty());
+
+    const utfcpp::u16_view view{u"aл水𐌀b"};
+    std::u32string decoded;
+    for (char32_t cp : view)
+        decoded += cp;
+    EXPECT_EQ(decoded, U"aл水𐌀b");
+    EXPECT_EQ(std::ranges::distance(view), 5);
+
+    std::u32string reversed;
+    for (char32_t cp : view | std::views::reverse)
+        reversed += cp;
+    EXPECT_EQ(reversed, U"b𐌀水лa");
+}
+
+TEST(utf8_indexTests, test_index)
+{
+    // Long enough for many checkpoints and a partial last block
+    std::u8string utf8;
+    for (int i = 0; i < 300; ++i)
+        utf8 += (i % 3) ? u8"ASCII, Ћирилица 水手" : u8"𐌀𐌁";
+    const utfcpp::utf8_index index(utf8);
+    EXPECT_EQ(index.code_point_count(), utfcpp::count_code_points(utf8));
+    EXPECT_EQ(index.utf16_length(), utfcpp::utf16_length_from_utf8(utf8));
+
+    // Compare with a walk over the string
+    size_t code_point_index{0}, utf16_offset{0};
+    for (size_t byte_offset = 0; byte_offset < utf8.size(); ++byte_offset) {
+        const char8_t byte = utf8[byte_offset];
+        if ((byte & 0xc0) == 0x80) {
+            // Inside a sequence
+            EXPECT_EQ(index.code_point_at_byte(byte_offset), code_point_index - 1);
+            continue;
+        }
+        EXPECT_EQ(index.byte_offset(code_point_index), byte_offset);
+        EXPECT_EQ(index.utf16_offset(code_point_index), utf16_offset);
+        EXPECT_EQ(index.code_point_at_byte(byte_offset), code_point_index);
+        EXPECT_EQ(index.code_point_at_utf16(utf16_offset), code_point_index);
+        if (byte >= 0xf0)
+            EXPECT_EQ(index.code_point_at_utf16(utf16_offset + 1), code_point_index);
+        utf16_offset += (byte >= 0xf0) ? 2 : 1;
+        ++code_point_index;
+    }
+    EXPECT_EQ(index.byte_offset(code_point_index), utf8.size());
+    EXPECT_EQ(index.code_point_at_utf16(utf16_offset), code_point_index);
+    EXPECT_THROW(index.byte_offset(code_point_index + 1), std::out_of_range);
+    EXPECT_THROW(index.code_point_at_byte(utf8.size() + 1), std::out_of_range);
+
+    const utfcpp::utf8_index empty(u8"");
+    EXPECT_EQ(empty.code_point_count(), 0);
+    EXPECT_EQ(empty.byte_offset(0), 0);
+    EXPECT_EQ(empty.code_point_at_utf16(0), 0);
+
+    const char8_t invalid[] = {0x61, 0xd1, 0x88, 0xed, 0xa0, 0x80, 0};
+    try {
+        utfcpp::utf8_index invalid_index(invalid);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 3);
+    }
+}
+
+TEST(utf8_indexTests, test_append)
+{
+    std::u8string utf8;
+    utfcpp::utf8_index index;
+    for (int i = 0; i < 200; ++i) {
+        utf8 += (i % 2) ? u8"aл水" : u8"𐌀 text ";
+        index.append(utf8);
+    }
+    const utfcpp::utf8_index full(utf8);
+    EXPECT_EQ(index.code_point_count(), full.code_point_count());
+    EXPECT_EQ(index.utf16_length(), full.utf16_length());
+    for (size_t i = 0; i <= full.code_point_count(); i += 7) {
+        EXPECT_EQ(index.byte_offset(i), full.byte_offset(i));
+        EXPECT_EQ(index.utf16_offset(i), full.utf16_offset(i));
+    }
+
+    // Invalid appended text leaves the index unchanged
+    const size_t size = utf8.size();
+    utf8 += u8"ab";
+    utf8 += char8_t(0xc0);
+    try {
+        index.append(utf8);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), size + 2);
+    }
+    EXPECT_EQ(index.code_point_count(), full.code_point_count());
+    EXPECT_EQ(index.byte_offset(index.code_point_count()), size);
 
+    // A view shorter than the indexed string does not extend it
+    EXPECT_THROW(index.append(std::u8string_view(utf8).substr(0, size - 1)), std::invalid_argument);
+    EXPECT_EQ(index.code_point_count(), full.code_point_count());
+    index.append(std::u8string_view(utf8).substr(0, size));
+    EXPECT_EQ(index.code_point_count(), full.code_point_count());
+}
+
+TEST(UtfTests, test_implementation_selection)
+{
+    using utfcpp::implementation;
+
+    const implementation initial = utfcpp::active_implementation();
+    EXPECT_TRUE(initial <= utfcpp::best_implementation());
+
+    const std::u8string utf8 {u8"Hello, Мир 世界 \U0001F600 and more ASCII text after it"};
+    const std::u16string utf16 = utfcpp::utf8_to_16(utf8);
+    for (implementation level : {implementation::scalar, implementation::sse, implementation::avx2,
+                                 implementation::avx512}) {
+        if (level > utfcpp::best_implementation()) {
+            EXPECT_THROW(utfcpp::set_implementation(level), std::invalid_argument);
+            continue;
+        }
+        utfcpp::set_implementation(level);
+        EXPECT_EQ(utfcpp::active_implementation(), level);
+        for (const utfcpp::kernel_info& kernel : utfcpp::active_kernels())
+            EXPECT_TRUE(kernel.level <= level);
+        EXPECT_EQ(utfcpp::utf8_to_16(utf8), utf16);
+        EXPECT_EQ(utfcpp::utf16_to_8(utf16), utf8);
+        EXPECT_EQ(utfcpp::find_invalid_utf8(utf8.substr(0, 12)), 11);
+    }
+    utfcpp::set_implementation(implementation::scalar);
+    for (const utfcpp::kernel_info& kernel : utfcpp::active_kernels())
+        EXPECT_EQ(kernel.level, implementation::scalar);
+
+    utfcpp::set_implementation(initial);
+    EXPECT_EQ(std::string(utfcpp::implementation_name(implementation::avx2)), "avx2");
+}
+
+TEST(UtfTests, test_boundaries)
+{
+    // a, two-byte, three-byte and four-byte sequences
+    const std::u8string_view utf8 {u8"aж世\U0001F600"};
+    const size_t prev[] {0, 1, 1, 3, 3, 3, 6, 6, 6, 6, 10};
+    const size_t next[] {0, 1, 3, 3, 6, 6, 6, 10, 10, 10, 10};
+    for (size_t offset = 0; offset <= utf8.size(); ++offset) {
+        EXPECT_EQ(utfcpp::find_prev_boundary(utf8, offset), prev[offset]);
+        EXPECT_EQ(utfcpp::find_next_boundary(utf8, offset), next[offset]);
+        EXPECT_EQ(utfcpp::truncate_utf8(utf8, offset), utf8.substr(0, prev[offset]));
+    }
+    EXPECT_EQ(utfcpp::truncate_utf8(utf8, 100), utf8);
+    EXPECT_THROW(utfcpp::find_prev_boundary(utf8, 11), std::out_of_range);
+    EXPECT_THROW(utfcpp::find_next_boundary(utf8, 11), std::out_of_range);
+
+    // Stray trail bytes are sequences of their own; a missing trail ends a sequence early
+    const std::u8string_view invalid {u8"a\x80\x80\xe4\xb8z"};
+    EXPECT_EQ(utfcpp::find_prev_boundary(invalid, 2), 2);
+    EXPECT_EQ(utfcpp::find_next_boundary(invalid, 1), 1);
+    EXPECT_EQ(utfcpp::find_prev_boundary(invalid, 4), 3);
+    EXPECT_EQ(utfcpp::find_next_boundary(invalid, 4), 5);
+}
+
+TEST(UtfTests, test_chunk_utf8)
+{
+    std::u8string utf8;
+    for (int i = 0; i < 50; ++i)
+        utf8 += u8"aж世\U0001F600";
+
+    for (size_t chunk_size = 1; chunk_size < 20; ++chunk_size) {
+        const std::vector<std::u8string_view> chunks = utfcpp::chunk_utf8(utf8, chunk_size);
+        std::u8string joined;
+        for (std::u8string_view chunk : chunks) {
+            EXPECT_TRUE(utfcpp::is_valid_utf8(chunk));
+            EXPECT_TRUE(chunk.size() <= std::max(chunk_size, utfcpp::find_next_boundary(chunk, 1)));
+            joined += chunk;
+        }
+        EXPECT_EQ(joined, utf8);
+    }
+    EXPECT_TRUE(utfcpp::chunk_utf8(u8"", 4).empty());
+    EXPECT_THROW(utfcpp::chunk_utf8(utf8, 0), std::invalid_argument);
+}
+
+TEST(UtfTests, test_equal_and_compare)
+{
+    const std::u8string utf8 {u8"Hello, Мир 世界 \U0001F600 and a long enough ASCII tail to fill blocks"};
+    const std::u16string utf16 = utfcpp::utf8_to_16(utf8);
+    const std::u32string utf32 = utfcpp::utf8_to_32(utf8);
+    EXPECT_TRUE(utfcpp::equal(utf8, utf16));
+    EXPECT_TRUE(utfcpp::equal(utf8, utf32));
+    EXPECT_TRUE(utfcpp::equal(utf16, utf32));
+    EXPECT_TRUE(utfcpp::equal(u8"", u""));
+    EXPECT_TRUE(utfcpp::compare(utf8, utf16) == 0);
+
+    // A difference at every position, ordered by code point
+    for (size_t i = 0; i < utf32.size(); ++i) {
+        std::u32string greater = utf32;
+        greater[i] = U'\U0010FFFF';
+        EXPECT_FALSE(utfcpp::equal(utf8, greater));
+        EXPECT_TRUE(utfcpp::compare(utf8, greater) < 0);
+        EXPECT_TRUE(utfcpp::compare(utfcpp::utf32_to_16(greater), utf32) > 0);
+        EXPECT_TRUE(utfcpp::compare(utfcpp::utf32_to_8(greater), utf32) > 0);
+    }
+
+    // Prefixes order first
+    EXPECT_TRUE(utfcpp::compare(std::u8string_view(utf8).substr(0, 5), utf16) < 0);
+    EXPECT_TRUE(utfcpp::compare(utf8, std::u16string_view(utf16).substr(0, 5)) > 0);
+
+    // Code point order differs from UTF-16 code unit order
+    EXPECT_TRUE(utfcpp::compare(u8"\uffff", u"\U00010000") < 0);
+    EXPECT_TRUE(utfcpp::compare(u"\uffff", U"\U00010000") < 0);
+
+    // Invalid sequences compare as U+FFFD
+    EXPECT_TRUE(utfcpp::equal(u8"a\xff" u8"b", u"a\xdc00" u"b"));
+}
+
+TEST(UtfTests, test_hash_code_points)
+{
+    const std::u8string utf8 {u8"Hello, Мир 世界 \U0001F600 and a long enough ASCII tail to fill blocks"};
+    const uint64_t hash = utfcpp::hash_code_points(utf8);
+    EXPECT_EQ(utfcpp::hash_code_points(utfcpp::utf8_to_16(utf8)), hash);
+    EXPECT_EQ(utfcpp::hash_code_points(utfcpp::utf8_to_32(utf8)), hash);
+    EXPECT_NE(utfcpp::hash_code_points(std::u8string_view(utf8).substr(1)), hash);
+    EXPECT_EQ(utfcpp::hash_code_points(u8"a\xff" u8"b"), utfcpp::hash_code_points(u"a\ufffdb"));
+    EXPECT_EQ(utfcpp::hash_code_points(u8""), utfcpp::hash_code_points(U""));
+}
+
+TEST(UtfTests, test_lazy_conversion_views)
+{
+    std::u8string utf8;
+    for (int i = 0; i < 40; ++i)
+        utf8 += (i % 3) ? u8"plain ASCII text " : u8"Мир 世界 \U0001F600 ";
+    const std::u16string utf16 = utfcpp::utf8_to_16(utf8);
+
+    std::u16string converted16;
+    for (char16_t unit : utf8 | utfcpp::views::to_utf16)
+        converted16 += unit;
+    EXPECT_EQ(converted16, utf16);
+
+    std::u8string converted8;
+    std::ranges::copy(utf16 | utfcpp::views::to_utf8, std::back_inserter(converted8));
+    EXPECT_EQ(converted8, utf8);
+
+    // Composes with the standard adaptors
+    auto first = utf8 | utfcpp::views::to_utf16 | std::views::take(100);
+    EXPECT_TRUE(std::ranges::equal(first, utf16.substr(0, 100)));
+    static_assert(std::ranges::forward_range<utfcpp::utf8_to_16_view>);
+    static_assert(std::ranges::borrowed_range<utfcpp::utf16_to_8_view>);
+
+    // Iterators compare by position
+    auto it = utfcpp::utf8_to_16_view(utf8).begin();
+    auto copy = it;
+    std::ranges::advance(it, 200);
+    std::ranges::advance(copy, 200);
+    EXPECT_TRUE(it == copy);
+}
+
+TEST(UtfTests, test_lazy_conversion_views_invalid)
+{
+    // The code units before an invalid sequence are visited before the error is thrown
+    std::u8string utf8(100, u8'a');
+    utf8 += char8_t(0xc0);
+    std::u16string converted;
+    try {
+        for (char16_t unit : utfcpp::utf8_to_16_view(utf8))
+            converted += unit;
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 100);
+    }
+    EXPECT_EQ(converted, std::u16string(100, u'a'));
+
+    std::u16string replaced;
+    std::ranges::copy(utf8 | utfcpp::views::to_utf16(utfcpp::error_mode::replace), std::back_inserter(replaced));
+    EXPECT_EQ(replaced, utfcpp::utf8_to_16(utf8, utfcpp::error_mode::replace));
+
+    std::u16string utf16(70, u'b');
+    utf16 += u'\xd800';
+    utf16 += u"cd";
+    EXPECT_THROW(static_cast<void>(std::ranges::distance(utf16 | utfcpp::views::to_utf8)), utfcpp::exception_with_position);
+    std::u8string replaced8;
+    std::ranges::copy(utf16 | utfcpp::views::to_utf8(utfcpp::error_mode::replace), std::back_inserter(replaced8));
+    EXPECT_EQ(replaced8, utfcpp::utf16_to_8(utf16, utfcpp::error_mode::replace));
+}
+
+TEST(UtfTests, test_pmr_conversions)
+{
+    // All the memory comes from the arena, which fails rather than fall back to the heap
+    std::byte buffer[4096];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+
+    const std::u8string_view utf8 {u8"Hello, Мир 世界 \U0001F600 and some ASCII"};
+    const std::pmr::u16string utf16 = utfcpp::utf8_to_16(utf8, &arena);
+    EXPECT_TRUE(std::u16string_view(utf16) == utfcpp::utf8_to_16(utf8));
+    EXPECT_TRUE(utf16.get_allocator().resource() == &arena);
+    const std::pmr::u8string back = utfcpp::utf16_to_8(utf16, &arena);
+    EXPECT_TRUE(std::u8string_view(back) == utf8);
+
+    std::pmr::u16string appended(u"> ", &arena);
+    utfcpp::utf8_to_16(utf8, appended);
+    EXPECT_TRUE(std::u16string_view(appended) == u"> " + utfcpp::utf8_to_16(utf8));
+
+    // Any allocator
+    const auto with_allocator = utfcpp::utf16_to_8(utf16, std::pmr::polymorphic_allocator<char8_t>(&arena));
+    EXPECT_TRUE(std::u8string_view(with_allocator) == utf8);
+
+    // Invalid input throws like the std::u16string overloads and keeps the original content
+    std::u8string invalid {u8"abc"};
+    invalid += char8_t(0xc0);
+    try {
+        utfcpp::utf8_to_16(invalid, appended);
+        EXPECT_TRUE(false); // Expected exception_with_position
+    } catch (const utfcpp::exception_with_position& e) {
+        EXPECT_EQ(e.position(), 3);
+        EXPECT_EQ(std::string(e.what()), std::string("Incomplete sequence 3"));
+    }
+    EXPECT_TRUE(std::u16string_view(appended) == u"> " + utfcpp::utf8_to_16(utf8));
+}
+
+TEST(UtfTests, test_exception_with_position_messages)
+{
+    EXPECT_EQ(std::string(utfcpp::exception_with_position(7).what()), "UTF error at position 7");
+    const utfcpp::exception_with_position inline_message(size_t(-1), "Overlong sequence");
+    EXPECT_EQ(std::string(inline_message.what()), "Overlong sequence 18446744073709551615");
+    EXPECT_EQ(std::string(inline_message.what()), "Overlong sequence 18446744073709551615");
+    const std::string long_message(100, 'x');
+    EXPECT_EQ(std::string(utfcpp::exception_with_position(1, long_message.c_str()).what()), long_message + " 1");
+    EXPECT_EQ(std::string(utfcpp::exception_with_position(2, std::string("custom")).what()), "custom 2");
+}
@@ -0,0 +1,68 @@
+//    Copyright 2024 Nemanja Trifunovic
+
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+
+//        http://www.apache.org/licenses/LICENSE-2.0
+
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+
+// utfconv: converts text files between UTF-8 and UTF-16LE, or validates them.
+//
+//    utfconv <from> <to> <input> <output>
+//    utfconv --validate <encoding> <input>
+//
+// Encodings are utf8 and utf16le. Exits with 0 on success, 1 on invalid input and 2 on
+// usage or I/O errors.
+
+#include "utfcpp20.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <optional>
+
+static std::optional<utfcpp::file_encoding> parse_encoding(const char* name) {
+    if (std::strcmp(name, "utf8") == 0)
+        return utfcpp::file_encoding::utf8;
+    if (std::strcmp(name, "utf16le") == 0)
+        return utfcpp::file_encoding::utf16le;
+    return std::nullopt;
+}
+
+static int usage() {
+    std::cerr << "usage: utfconv <from> <to> <input> <output>\n"
+                 "       utfconv --validate <encoding> <input>\n"
+                 "encodings: utf8, utf16le\n";
+    return 2;
+}
+
+int main(int argc, char* argv[]) {
+    const bool validate = (argc == 4 && std::strcmp(argv[1], "--validate") == 0);
+    if (!validate && argc != 5)
+        return usage();
+
+    const auto from = parse_encoding(argv[validate ? 2 : 1]);
+    const auto to = validate ? from : parse_encoding(argv[2]);
+    if (!from || !to)
+        return usage();
+
+    const char* input = argv[3];
+    try {
+        if (validate)
+            utfcpp::validate_file(input, *from);
+        else
+            utfcpp::transcode_file(input, argv[4], *from, *to);
+    } catch (const utfcpp::exception& e) {
+        std::cerr << input << ": " << e.what() << '\n';
+        return 1;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 2;
+    }
+    return 0;
+}